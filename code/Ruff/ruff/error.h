@@ -40,10 +40,11 @@ namespace ruff
             }
         }
 
+        // one slot per thread so concurrent calls can't see or clear each other's errors
         RUFF_FORCE_INLINE
         static error_t** get_error_address()
         {
-            static error_t* err = nullptr;
+            static thread_local error_t* err = nullptr;
             return &err;
         }
 
@@ -30,9 +30,15 @@
 #include "spark/error.h"
 // api
 #include "spark/enums.h"
+#include "spark/device.h"
+#include "spark/work_size.h"
+#include "spark/profile.h"
+#include "spark/log.h"
 #include "spark/node.h"
 #include "spark/runtime.h"
 #include "spark/codegen.h"
+#include "spark/event.h"
+#include "spark/command_list.h"
 #include "spark/device_buffer.h"
 // kernel authoring
 #include "spark/meta.h"
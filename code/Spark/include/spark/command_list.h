@@ -0,0 +1,38 @@
+#pragma once
+
+namespace spark
+{
+    // sequence of kernel launches recorded once (see Kernel::record) and replayed with a single call;
+    // recorded kernels and buffers must outlive the list
+    struct command_list
+    {
+        command_list()
+        : _list(spark_create_command_list(SPARK_THROW_ON_ERROR()),
+            [](spark_command_list_t* list)
+            {
+                spark_destroy_command_list(list, SPARK_THROW_ON_ERROR());
+            })
+        { }
+
+        void run() const
+        {
+            spark_run_command_list(_list.get(), SPARK_THROW_ON_ERROR());
+        }
+
+        device_event run_async(std::initializer_list<device_event> wait_list) const
+        {
+            auto waitList = get_wait_list(wait_list);
+            return device_event(spark_run_command_list_async(_list.get(), waitList.data(), static_cast<uint32_t>(waitList.size()), SPARK_THROW_ON_ERROR()));
+        }
+
+        device_event run_async() const
+        {
+            return run_async({});
+        }
+
+        spark_command_list_t* get() const { return _list.get(); }
+
+    private:
+        std::shared_ptr<spark_command_list_t> _list;
+    };
+}
\ No newline at end of file
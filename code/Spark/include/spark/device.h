@@ -0,0 +1,18 @@
+#pragma once
+
+// description of an OpenCL device (or the host for the cpu backend)
+typedef struct spark_device_info
+{
+    char name[256];
+    char vendor[256];
+    char version[256];
+    // device_index is the position among all of the platform's devices (CL_DEVICE_TYPE_ALL
+    // order), the same whatever type filter spark_enumerate_devices was called with
+    uint32_t platform_index;
+    uint32_t device_index;
+    spark_device_type_t type;
+    uint32_t compute_units;
+    size_t max_work_group_size;
+    uint64_t local_mem_size;
+    uint64_t global_mem_size;
+} spark_device_info_t;
\ No newline at end of file
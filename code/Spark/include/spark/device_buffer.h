@@ -6,15 +6,80 @@ namespace spark
     template<typename T> struct device_buffer1d;
     template<typename T> struct device_buffer2d;
 
+    // tag for buffers whose contents are fully written before being read,
+    // skips the zero fill done on creation
+    struct uninitialized_t {};
+    constexpr uninitialized_t uninitialized{};
+
+    // tag for buffers wrapping caller memory (CL_MEM_USE_HOST_PTR) rather than copying it
+    struct use_host_ptr_t {};
+    constexpr use_host_ptr_t use_host_ptr{};
+
+    // host view of a mapped device buffer region, unmapped on destruction
+    template<typename T>
+    struct mapped_span
+    {
+        mapped_span(const mapped_span&) = delete;
+        mapped_span& operator=(const mapped_span&) = delete;
+
+        mapped_span(std::shared_ptr<spark_buffer_t> buffer, size_t offset, size_t count, spark::shared::MapAccess access)
+        : _buffer(std::move(buffer))
+        , _count(count)
+        , _data(static_cast<T*>(spark_map_buffer(_buffer.get(), sizeof(T) * offset, sizeof(T) * count, static_cast<spark_map_access_t>(access), SPARK_THROW_ON_ERROR())))
+        { }
+
+        mapped_span(mapped_span&& that)
+        : _buffer(std::move(that._buffer))
+        , _count(that._count)
+        , _data(that._data)
+        {
+            that._data = nullptr;
+        }
+
+        ~mapped_span()
+        {
+            if(_data != nullptr)
+            {
+                spark_unmap_buffer(_buffer.get(), _data, SPARK_THROW_ON_ERROR());
+            }
+        }
+
+        T* data() const { return _data; }
+        T* begin() const { return _data; }
+        T* end() const { return _data + _count; }
+        T& operator[](size_t index) const { return _data[index]; }
+
+        size_t count() const { return _count;}
+        size_t size() const { return count() * sizeof(T); }
+
+    private:
+        std::shared_ptr<spark_buffer_t> _buffer;
+        const size_t _count;
+        T* _data;
+    };
+
     template<typename T>
     struct device_buffer1d
     {
         device_buffer1d(const device_buffer1d&) = default;
         device_buffer1d(device_buffer1d&&) = default;
 
-        device_buffer1d(size_t count, const T* data)
+        device_buffer1d(size_t count, const T* data) : device_buffer1d(count, data, spark::shared::BufferFlags::None) {}
+
+        device_buffer1d(size_t count, const T* data, spark::shared::BufferFlags flags)
         : _count(count)
-        , _buffer(spark_create_buffer(size(), data, SPARK_THROW_ON_ERROR()),
+        , _buffer(spark_create_buffer_ex(size(), data, static_cast<spark_buffer_flags_t>(flags), SPARK_THROW_ON_ERROR()),
+            [](spark_buffer_t* buffer)
+            {
+                spark_destroy_buffer(buffer, SPARK_THROW_ON_ERROR());
+            })
+        { }
+
+        // wraps data directly, kernels write to it so it can't be const; it must stay
+        // valid for the buffer's lifetime and be accessed through map()
+        device_buffer1d(size_t count, T* data, use_host_ptr_t)
+        : _count(count)
+        , _buffer(spark_create_buffer_from_host_ptr(size(), data, SPARK_THROW_ON_ERROR()),
             [](spark_buffer_t* buffer)
             {
                 spark_destroy_buffer(buffer, SPARK_THROW_ON_ERROR());
@@ -23,6 +88,7 @@ namespace spark
 
         // zero fill
         device_buffer1d(size_t count) : device_buffer1d(count, nullptr) {}
+        device_buffer1d(size_t count, uninitialized_t) : device_buffer1d(count, nullptr, spark::shared::BufferFlags::Uninitialized) {}
         template<size_t N>
         device_buffer1d(const T (&arr)[N]) : device_buffer1d(N, arr) {}
 
@@ -78,6 +144,41 @@ namespace spark
             read(0, N, dest);
         }
 
+        // zero-copy host access where the device shares memory with the host
+        mapped_span<T> map(size_t offset, size_t count, spark::shared::MapAccess access) const
+        {
+            return mapped_span<T>(_buffer, offset, count, access);
+        }
+
+        mapped_span<T> map(spark::shared::MapAccess access) const
+        {
+            return map(0, _count, access);
+        }
+
+        // queues the transfer behind wait_list and returns without waiting for it;
+        // data/dest must stay valid until the returned event completes
+        device_event write_async(size_t offset, size_t count, const T* data, std::initializer_list<device_event> wait_list = {})
+        {
+            auto waitList = get_wait_list(wait_list);
+            return device_event(spark_write_buffer_async(_buffer.get(), sizeof(T) * offset, sizeof(T) * count, data, waitList.data(), static_cast<uint32_t>(waitList.size()), SPARK_THROW_ON_ERROR()));
+        }
+
+        device_event write_async(const T* data, std::initializer_list<device_event> wait_list = {})
+        {
+            return write_async(0, _count, data, wait_list);
+        }
+
+        device_event read_async(size_t offset, size_t count, T* dest, std::initializer_list<device_event> wait_list = {}) const
+        {
+            auto waitList = get_wait_list(wait_list);
+            return device_event(spark_read_buffer_async(_buffer.get(), sizeof(T) * offset, sizeof(T) * count, dest, waitList.data(), static_cast<uint32_t>(waitList.size()), SPARK_THROW_ON_ERROR()));
+        }
+
+        device_event read_async(T* dest, std::initializer_list<device_event> wait_list = {}) const
+        {
+            return read_async(0, _count, dest, wait_list);
+        }
+
         size_t count() const { return _count;}
         size_t size() const { return count() * sizeof(T); }
 
@@ -98,7 +199,20 @@ namespace spark
         , _height(height)
         { }
 
+        device_buffer2d(size_t width, size_t height, const T* data, spark::shared::BufferFlags flags)
+        : device_buffer1d<T>(width*height, data, flags)
+        , _width(width)
+        , _height(height)
+        { }
+
+        device_buffer2d(size_t width, size_t height, T* data, use_host_ptr_t)
+        : device_buffer1d<T>(width*height, data, use_host_ptr)
+        , _width(width)
+        , _height(height)
+        { }
+
         device_buffer2d(size_t width, size_t height) : device_buffer2d(width, height, nullptr) {}
+        device_buffer2d(size_t width, size_t height, uninitialized_t) : device_buffer2d(width, height, nullptr, spark::shared::BufferFlags::Uninitialized) {}
         template<size_t M, size_t N>
         device_buffer2d(const T (&arr)[M][N]) : device_buffer2d(N, M, arr) {}
 
@@ -121,4 +235,43 @@ namespace spark
         const size_t _width;
         const size_t _height;
     };
+
+    // page-locked host staging memory, mapped for its whole lifetime; transfers to and
+    // from a pinned_buffer avoid the driver's intermediate copy
+    template<typename T>
+    struct pinned_buffer
+    {
+        pinned_buffer(const pinned_buffer&) = delete;
+        pinned_buffer& operator=(const pinned_buffer&) = delete;
+
+        pinned_buffer(size_t count)
+        : _count(count)
+        , _data(nullptr)
+        , _buffer(spark_create_buffer_ex(size(), nullptr, static_cast<spark_buffer_flags_t>(spark::shared::BufferFlags::Pinned), SPARK_THROW_ON_ERROR()),
+            [this](spark_buffer_t* buffer)
+            {
+                // still unmapped if the map itself threw
+                if(_data != nullptr)
+                {
+                    spark_unmap_buffer(buffer, _data, SPARK_THROW_ON_ERROR());
+                }
+                spark_destroy_buffer(buffer, SPARK_THROW_ON_ERROR());
+            })
+        {
+            _data = static_cast<T*>(spark_map_buffer(_buffer.get(), 0, size(), static_cast<spark_map_access_t>(spark::shared::MapAccess::ReadWrite), SPARK_THROW_ON_ERROR()));
+        }
+
+        T* data() { return _data; }
+        const T* data() const { return _data; }
+        T& operator[](size_t index) { return _data[index]; }
+        const T& operator[](size_t index) const { return _data[index]; }
+
+        size_t count() const { return _count;}
+        size_t size() const { return count() * sizeof(T); }
+
+    private:
+        const size_t _count;
+        T* _data;
+        std::shared_ptr<spark_buffer_t> _buffer;
+    };
 }
\ No newline at end of file
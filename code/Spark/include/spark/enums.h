@@ -4,6 +4,12 @@ typedef uint32_t spark_control_t;
 typedef uint32_t spark_datatype_t;
 typedef uint32_t spark_operator_t;
 typedef uint32_t spark_property_t;
+typedef uint32_t spark_backend_t;
+typedef uint32_t spark_device_type_t;
+typedef uint32_t spark_buffer_flags_t;
+typedef uint32_t spark_map_access_t;
+typedef uint32_t spark_log_level_t;
+typedef uint32_t spark_partition_t;
 
 namespace spark
 {
@@ -47,6 +53,8 @@ namespace spark
             ElseIf,
             Else,
             While,
+            // children are the init, condition and step expressions then the body
+            For,
 
             Count
         };
@@ -612,6 +620,79 @@ namespace spark
         {
             return static_cast<Property>(static_cast<spark_property_t>(left) - static_cast<spark_property_t>(right));
         }
+
+        // device backend a context executes kernels on
+        enum class Backend : spark_backend_t
+        {
+            OpenCL,
+            Cpu,
+
+            Count
+        };
+
+        // kinds of OpenCL device a context may be created on
+        enum class DeviceType : spark_device_type_t
+        {
+            Default,
+            Cpu,
+            Gpu,
+            Accelerator,
+            All,
+
+            Count
+        };
+
+        // buffer creation options, may be or'd together
+        enum class BufferFlags : spark_buffer_flags_t
+        {
+            None = 0,
+            // host-visible staging memory (CL_MEM_ALLOC_HOST_PTR) for fast transfers
+            Pinned = 1 << 0,
+            // skip the zero fill for buffers the caller overwrites anyway
+            Uninitialized = 1 << 1,
+        };
+
+        inline constexpr BufferFlags operator|(const BufferFlags left, const BufferFlags right)
+        {
+            return static_cast<BufferFlags>(static_cast<spark_buffer_flags_t>(left) | static_cast<spark_buffer_flags_t>(right));
+        }
+
+        // severity of a log message, messages below the current level are never formatted
+        enum class LogLevel : spark_log_level_t
+        {
+            Trace,
+            Debug,
+            Info,
+            Warning,
+            Error,
+            // as a level, silences everything
+            None,
+
+            Count
+        };
+
+        // how a mapped buffer region will be accessed
+        enum class MapAccess : spark_map_access_t
+        {
+            Read,
+            Write,
+            ReadWrite,
+
+            Count
+        };
+
+        // how the devices of a multi-device context share a kernel's buffer argument
+        enum class Partition : spark_partition_t
+        {
+            // every device sees the whole buffer, kernels writing it run whole
+            Replicated,
+            // the work-items at each index of the launch's outer dimension only access the
+            // matching slice of the buffer (its size divided evenly over that dimension), so
+            // kernels writing it are split with each device filling in its own slices
+            Partitioned,
+
+            Count
+        };
     }
 }
 
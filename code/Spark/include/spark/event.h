@@ -0,0 +1,53 @@
+#pragma once
+
+namespace spark
+{
+    // completion handle for an asynchronous launch or transfer
+    struct device_event
+    {
+        device_event() = default;
+
+        explicit device_event(spark_event_t* event)
+        : _event(event,
+            [](spark_event_t* event)
+            {
+                spark_destroy_event(event, SPARK_THROW_ON_ERROR());
+            })
+        { }
+
+        // blocks until the command has completed
+        void wait() const
+        {
+            const spark_event_t* event = _event.get();
+            if(event != nullptr)
+            {
+                spark_wait_for_events(&event, 1, SPARK_THROW_ON_ERROR());
+            }
+        }
+
+        spark_event_t* get() const { return _event.get(); }
+
+    private:
+        std::shared_ptr<spark_event_t> _event;
+    };
+
+    // raw handles to pass as a wait list
+    inline std::vector<const spark_event_t*> get_wait_list(std::initializer_list<device_event> events)
+    {
+        std::vector<const spark_event_t*> waitList;
+        for(const auto& event : events)
+        {
+            if(event.get() != nullptr)
+            {
+                waitList.push_back(event.get());
+            }
+        }
+        return waitList;
+    }
+
+    inline void wait_all(std::initializer_list<device_event> events)
+    {
+        auto waitList = get_wait_list(events);
+        spark_wait_for_events(waitList.data(), static_cast<uint32_t>(waitList.size()), SPARK_THROW_ON_ERROR());
+    }
+}
\ No newline at end of file
@@ -6,6 +6,37 @@ namespace spark
 
     namespace client
     {
+        // routes kernel arguments either straight to the kernel or into a recorded command
+        struct arg_binder
+        {
+            spark_kernel_t* kernel;
+            spark_command_list_t* list;
+
+            void set_buffer(uint32_t index, spark_buffer_t* buffer) const
+            {
+                if(list != nullptr)
+                {
+                    spark_command_list_set_kernel_arg_buffer(list, index, buffer, SPARK_THROW_ON_ERROR());
+                }
+                else
+                {
+                    spark_set_kernel_arg_buffer(kernel, index, buffer, SPARK_THROW_ON_ERROR());
+                }
+            }
+
+            void set_primitive(uint32_t index, size_t size, const void* data) const
+            {
+                if(list != nullptr)
+                {
+                    spark_command_list_set_kernel_arg_primitive(list, index, size, data, SPARK_THROW_ON_ERROR());
+                }
+                else
+                {
+                    spark_set_kernel_arg_primitive(kernel, index, size, data, SPARK_THROW_ON_ERROR());
+                }
+            }
+        };
+
         inline
         SPARK_NEVER_INLINE
         spark_node_t* functor_operator(spark::shared::Datatype returnType, spark_node_t* functionNode)
@@ -288,76 +319,178 @@ namespace spark
 
         void set_work_dimensions(size_t dim1)
         {
-            set_work_dimensions(dim1, 1, 1);
+            _work_size.dimensions = 1;
+            _work_size.global_size[0] = dim1;
         }
 
         void set_work_dimensions(size_t dim1, size_t dim2)
         {
-            set_work_dimensions(dim1, dim2, 1);
+            _work_size.dimensions = 2;
+            _work_size.global_size[0] = dim1;
+            _work_size.global_size[1] = dim2;
         }
 
         void set_work_dimensions(size_t dim1, size_t dim2, size_t dim3)
         {
-            _work_dimensions[0] = dim1;
-            _work_dimensions[1] = dim2;
-            _work_dimensions[2] = dim3;
+            _work_size.dimensions = 3;
+            _work_size.global_size[0] = dim1;
+            _work_size.global_size[1] = dim2;
+            _work_size.global_size[2] = dim3;
+        }
+
+        // work-group shape for subsequent launches, must have as many dimensions as the
+        // work dimensions and divide them evenly; clear_local_size hands the choice back to the driver
+        void set_local_size(size_t local1)
+        {
+            set_local_size(local1, 0, 0);
+        }
+
+        void set_local_size(size_t local1, size_t local2)
+        {
+            set_local_size(local1, local2, 0);
+        }
+
+        void set_local_size(size_t local1, size_t local2, size_t local3)
+        {
+            _work_size.local_size[0] = local1;
+            _work_size.local_size[1] = local2;
+            _work_size.local_size[2] = local3;
+        }
+
+        void clear_local_size()
+        {
+            set_local_size(0, 0, 0);
+        }
+
+        // name reported in profiling statistics
+        void set_name(const char* name)
+        {
+            spark_set_kernel_name(this->_kernel.get(), name, SPARK_THROW_ON_ERROR());
+        }
+
+        // generated OpenCL C, or C++ on the cpu backend
+        const char* source() const
+        {
+            return spark_get_kernel_source(this->_kernel.get(), SPARK_THROW_ON_ERROR());
+        }
+
+        // without an explicit local size, time candidate work-group shapes over the first
+        // launches of each global size and keep the fastest (remembered across runs);
+        // those first launches block until complete; ignored on the cpu backend
+        void set_autotune(bool enabled)
+        {
+            spark_set_kernel_autotune(this->_kernel.get(), enabled, SPARK_THROW_ON_ERROR());
+        }
+
+        // how the buffer passed as parameter (counted from 0) is shared between devices when a
+        // multi-device context splits the launch; a kernel is only split if it declares
+        // every buffer it writes Partitioned
+        void set_partition(size_t param, spark::shared::Partition partition)
+        {
+            spark_set_kernel_arg_partition(this->_kernel.get(), arg_index(param), static_cast<spark_partition_t>(partition), SPARK_THROW_ON_ERROR());
+        }
+
+        // arguments actually rebound on the device, and rebinds skipped because the value hadn't changed
+        void get_arg_stats(uint64_t* updates, uint64_t* skips) const
+        {
+            spark_get_kernel_arg_stats(this->_kernel.get(), updates, skips, SPARK_THROW_ON_ERROR());
         }
 
         void operator()(const typename PARAMS::host_type&... args) const
         {
-            run(0, args...);
+            set_args({this->_kernel.get(), nullptr}, 0, args...);
+            spark_run_kernel(this->_kernel.get(), &_work_size, SPARK_THROW_ON_ERROR());
+        }
+
+        // queues the launch behind wait_list and returns without waiting for it to finish
+        device_event run_async(std::initializer_list<device_event> wait_list, const typename PARAMS::host_type&... args) const
+        {
+            set_args({this->_kernel.get(), nullptr}, 0, args...);
+            auto waitList = get_wait_list(wait_list);
+            return device_event(spark_run_kernel_async(this->_kernel.get(), &_work_size, waitList.data(), static_cast<uint32_t>(waitList.size()), SPARK_THROW_ON_ERROR()));
+        }
+
+        device_event run_async(const typename PARAMS::host_type&... args) const
+        {
+            return run_async({}, args...);
+        }
+
+        // appends a launch with the current work dimensions and these arguments to list
+        void record(command_list& list, const typename PARAMS::host_type&... args) const
+        {
+            spark_command_list_add_kernel(list.get(), this->_kernel.get(), &_work_size, SPARK_THROW_ON_ERROR());
+            set_args({this->_kernel.get(), list.get()}, 0, args...);
         }
     private:
 
+        // device arguments each parameter is passed as, see set_arg
         template<typename T>
-        uint32_t set_arg(uint32_t idx, const T& arg) const
+        static constexpr uint32_t arg_count(const T*) { return 1; }
+        template<typename T>
+        static constexpr uint32_t arg_count(const device_buffer1d<T>*) { return 2; }
+        template<typename T>
+        static constexpr uint32_t arg_count(const device_buffer2d<T>*) { return 3; }
+
+        // index of the first device argument of parameter param
+        static uint32_t arg_index(size_t param)
         {
-            spark_set_kernel_arg_primitive(this->_kernel.get(), idx++, sizeof(arg), &arg, SPARK_THROW_ON_ERROR());
+            const uint32_t counts[] = {arg_count(static_cast<const typename PARAMS::host_type*>(nullptr))..., 0};
+            SPARK_ASSERT(param < sizeof...(PARAMS));
+
+            uint32_t index = 0;
+            for(size_t k = 0; k < param; k++)
+            {
+                index += counts[k];
+            }
+            return index;
+        }
+
+        template<typename T>
+        uint32_t set_arg(const client::arg_binder& binder, uint32_t idx, const T& arg) const
+        {
+            binder.set_primitive(idx++, sizeof(arg), &arg);
             return idx;
         }
 
         template<typename T>
-        uint32_t set_arg(uint32_t idx, const device_buffer1d<T>& buffer) const
+        uint32_t set_arg(const client::arg_binder& binder, uint32_t idx, const device_buffer1d<T>& buffer) const
         {
             // buffer
-            spark_set_kernel_arg_buffer(this->_kernel.get(), idx++, buffer._buffer.get(), SPARK_THROW_ON_ERROR());
+            binder.set_buffer(idx++, buffer._buffer.get());
 
             // buffer length
             int32_t size = (int32_t)buffer.size();
-            spark_set_kernel_arg_primitive(this->_kernel.get(), idx++, sizeof(size), &size, SPARK_THROW_ON_ERROR());
+            binder.set_primitive(idx++, sizeof(size), &size);
 
             return idx;
         }
 
         template<typename T>
-        uint32_t set_arg(uint32_t idx, const device_buffer2d<T>& buffer) const
+        uint32_t set_arg(const client::arg_binder& binder, uint32_t idx, const device_buffer2d<T>& buffer) const
         {
             // buffer
-            spark_set_kernel_arg_buffer(this->_kernel.get(), idx++, buffer._buffer.get(), SPARK_THROW_ON_ERROR());
+            binder.set_buffer(idx++, buffer._buffer.get());
 
             // dimensions
             int32_t width = buffer.width();
             int32_t height = buffer.height();
-            spark_set_kernel_arg_primitive(this->_kernel.get(), idx++, sizeof(width), &width, SPARK_THROW_ON_ERROR());
-            spark_set_kernel_arg_primitive(this->_kernel.get(), idx++, sizeof(height), &height, SPARK_THROW_ON_ERROR());
+            binder.set_primitive(idx++, sizeof(width), &width);
+            binder.set_primitive(idx++, sizeof(height), &height);
 
             return idx;
         }
 
-        void run(uint32_t) const
-        {
-            spark_run_kernel(this->_kernel.get(), _work_dimensions[0], _work_dimensions[1], _work_dimensions[2], SPARK_THROW_ON_ERROR());
-        }
+        void set_args(const client::arg_binder&, uint32_t) const {}
 
         template<typename Arg, typename...Args>
-        void run(uint32_t idx, Arg&& arg, Args&&... args) const
+        void set_args(const client::arg_binder& binder, uint32_t idx, Arg&& arg, Args&&... args) const
         {
-            idx = set_arg(idx, arg);
-            run(idx, std::forward<Args>(args)...);
+            idx = set_arg(binder, idx, arg);
+            set_args(binder, idx, std::forward<Args>(args)...);
         }
 
         std::shared_ptr<spark_kernel_t> _kernel;
-        size_t _work_dimensions[3] = {0};
+        spark_work_size_t _work_size = {0, {0, 0, 0}, {0, 0, 0}};
     };
 
     /// Return operator
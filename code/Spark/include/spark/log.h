@@ -0,0 +1,4 @@
+#pragma once
+
+// receives every log message at or above the current level; may be called from any thread
+typedef void (*spark_log_callback_t)(spark_log_level_t level, const char* message, void* user_data);
\ No newline at end of file
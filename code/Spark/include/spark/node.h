@@ -24,6 +24,7 @@ extern "C" void spark_add_child_node(spark_node_t* root, spark_node_t* node, spa
 extern "C" bool spark_node_get_attached(spark_node_t* node, spark_error_t** error);
 // node property set
 extern "C" void spark_node_make_entrypoint(spark_node_t* node, spark_error_t** error);
+extern "C" void spark_node_set_unroll(spark_node_t* node, uint32_t count, spark_error_t** error);
 
 // source scope
 extern "C" void spark_push_scope_node(spark_node_t* node, spark_error_t** error);
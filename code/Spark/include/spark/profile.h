@@ -0,0 +1,17 @@
+#pragma once
+
+// aggregate timings for one kernel (or transfer kind) recorded while profiling is enabled
+typedef struct spark_profile_stats
+{
+    char name[128];
+    uint64_t count;
+    // device execution time (end - start) in nanoseconds
+    uint64_t total_ns;
+    uint64_t min_ns;
+    uint64_t max_ns;
+    // percentiles over the most recent samples
+    uint64_t p50_ns;
+    uint64_t p99_ns;
+    // time spent waiting between being queued and starting execution
+    uint64_t total_queued_ns;
+} spark_profile_stats_t;
\ No newline at end of file
@@ -14,16 +14,20 @@ namespace spark
 
 			_range->init();
 
-			auto while_node = spark_create_control_node(static_cast<spark_control_t>(spark::shared::Control::While), SPARK_THROW_ON_ERROR());
-			spark_add_child_node(scope, while_node, SPARK_THROW_ON_ERROR());
-			spark_push_scope_node(while_node, SPARK_THROW_ON_ERROR());
+			auto for_node = spark_create_control_node(static_cast<spark_control_t>(spark::shared::Control::For), SPARK_THROW_ON_ERROR());
+			spark_add_child_node(scope, for_node, SPARK_THROW_ON_ERROR());
+			if(_range->_unroll > 0)
+			{
+				spark_node_set_unroll(for_node, _range->_unroll, SPARK_THROW_ON_ERROR());
+			}
+			spark_push_scope_node(for_node, SPARK_THROW_ON_ERROR());
 
-			int32_t true_val = 1;
-			auto true_node = spark_create_constant_node(static_cast<spark_datatype_t>(Int::type), &true_val, sizeof(true_val), SPARK_THROW_ON_ERROR());
-			spark_add_child_node(while_node, true_node, SPARK_THROW_ON_ERROR());
+			spark_add_child_node(for_node, _range->init_node(), SPARK_THROW_ON_ERROR());
+			spark_add_child_node(for_node, _range->condition_node(), SPARK_THROW_ON_ERROR());
+			spark_add_child_node(for_node, _range->step_node(), SPARK_THROW_ON_ERROR());
 
 			auto body_scope = spark_create_scope_block_node(SPARK_THROW_ON_ERROR());
-			spark_add_child_node(while_node, body_scope, SPARK_THROW_ON_ERROR());
+			spark_add_child_node(for_node, body_scope, SPARK_THROW_ON_ERROR());
 			spark_push_scope_node(body_scope, SPARK_THROW_ON_ERROR());
 		}
 
@@ -31,7 +35,6 @@ namespace spark
 		{
 			if(_range)
 			{
-				_range->update_value();
 				spark_pop_scope_node(SPARK_THROW_ON_ERROR());
 				spark_pop_scope_node(SPARK_THROW_ON_ERROR());
 				spark_pop_scope_node(SPARK_THROW_ON_ERROR());
@@ -41,10 +44,6 @@ namespace spark
 
 		bool operator!=(const iterator&)
 		{
-			if(_result)
-			{
-				_range->compare();
-			}
 			return _result;
 		}
 
@@ -64,18 +63,29 @@ namespace spark
 		bool _result = true;
 	};
 
+	// how many times a Range loop's body should be repeated per iteration,
+	// Unroll(1) keeps the loop rolled
+	struct Unroll
+	{
+		explicit Unroll(uint32_t count) : count(count) {}
+		uint32_t count;
+	};
+
 	template<typename TYPE>
 	struct Range
 	{
 		Range(const spark::client::rvalue<TYPE>& start, const spark::client::rvalue<TYPE>& stop) : Range(start, stop, 1) {}
+		Range(const spark::client::rvalue<TYPE>& start, const spark::client::rvalue<TYPE>& stop, const Unroll& unroll) : Range(start, stop, 1, unroll) {}
+		Range(const spark::client::rvalue<TYPE>& start, const spark::client::rvalue<TYPE>& stop, const spark::client::rvalue<TYPE>& step) : Range(start, stop, step, Unroll(0)) {}
 
-		Range(const spark::client::rvalue<TYPE>& start, const spark::client::rvalue<TYPE>& stop, const spark::client::rvalue<TYPE>& step)
+		Range(const spark::client::rvalue<TYPE>& start, const spark::client::rvalue<TYPE>& stop, const spark::client::rvalue<TYPE>& step, const Unroll& unroll)
 		: _temp_start(start._node)
 		, _temp_stop(stop._node)
 		, _temp_step(step._node)
 		, _val(spark::client::null_construct)
 		, _stop(spark::client::null_construct)
 		, _step(spark::client::null_construct)
+		, _unroll(unroll.count)
 		{
 
 		}
@@ -91,15 +101,16 @@ namespace spark
 			return iterator<Range>();
 		}
 
+		// the bounds are copied so the body can't change the trip count
 		void init()
 		{
-			Int start = _temp_start;
-			Int stop = _temp_stop;
-			Int step = _temp_step;
+			TYPE stop = _temp_stop;
+			TYPE step = _temp_step;
 
-			_val._node = start._node;
 			_stop._node = stop._node;
 			_step._node = step._node;
+			// declared by the for statement's init assignment
+			_val._node = spark_create_symbol_node(static_cast<spark_datatype_t>(TYPE::type), SPARK_THROW_ON_ERROR());
 		}
 
 		const TYPE get_value()
@@ -107,23 +118,35 @@ namespace spark
 			return std::move(_val);
 		}
 
-		void update_value()
+		spark_node_t* init_node()
 		{
-			_val = _val + _step;
+			const auto dt = static_cast<spark_datatype_t>(TYPE::type);
+			const auto op = static_cast<spark_operator_t>(spark::shared::Operator::Assignment);
+			return spark_create_operator2_node(dt, op, _val._node, _temp_start._node);
 		}
 
-		void compare()
+		spark_node_t* condition_node()
 		{
-			If(_val >= _stop)
-			{
-			 	Break();
-			}
+			const auto dt = static_cast<spark_datatype_t>(int_type<TYPE>::type);
+			const auto op = static_cast<spark_operator_t>(spark::shared::Operator::LessThan);
+			return spark_create_operator2_node(dt, op, _val._node, _stop._node);
+		}
+
+		spark_node_t* step_node()
+		{
+			const auto dt = static_cast<spark_datatype_t>(TYPE::type);
+			const auto add = static_cast<spark_operator_t>(spark::shared::Operator::Add);
+			const auto op = static_cast<spark_operator_t>(spark::shared::Operator::Assignment);
+			return spark_create_operator2_node(dt, op, _val._node, spark_create_operator2_node(dt, add, _val._node, _step._node));
 		}
+
 		spark::client::rvalue<TYPE> _temp_start;
 		spark::client::rvalue<TYPE> _temp_stop;
 		spark::client::rvalue<TYPE> _temp_step;
 		TYPE _val;
 		TYPE _stop;
 		TYPE _step;
+		// 0 leaves unrolling to the optimizer
+		uint32_t _unroll;
 	};
 }
\ No newline at end of file
@@ -3,19 +3,66 @@
 typedef struct spark_context spark_context_t;
 typedef struct spark_kernel spark_kernel_t;
 typedef struct spark_buffer spark_buffer_t;
+typedef struct spark_event spark_event_t;
+typedef struct spark_command_list spark_command_list_t;
 
 extern "C" spark_context_t* spark_create_context(spark_error_t** error);
+extern "C" spark_context_t* spark_create_context_for_backend(spark_backend_t backend, spark_error_t** error);
+extern "C" size_t spark_enumerate_devices(spark_device_type_t device_type, spark_device_info_t* infos, size_t info_count, spark_error_t** error);
+extern "C" spark_context_t* spark_create_context_ex(spark_device_type_t device_type, uint32_t platform_index, uint32_t device_index, spark_error_t** error);
+extern "C" spark_context_t* spark_create_context_multi_device(spark_device_type_t device_type, uint32_t platform_index, spark_error_t** error);
+extern "C" void spark_get_context_device_info(spark_context_t* context, spark_device_info_t* info, spark_error_t** error);
+extern "C" uint32_t spark_get_split_device_count(spark_context_t* context, spark_error_t** error);
+extern "C" void spark_set_profiling(spark_context_t* context, bool enabled, spark_error_t** error);
+extern "C" size_t spark_get_profile_stats(spark_context_t* context, spark_profile_stats_t* stats, size_t stats_count, spark_error_t** error);
+extern "C" void spark_reset_profile_stats(spark_context_t* context, spark_error_t** error);
+extern "C" uint32_t spark_create_queue(spark_context_t* context, bool out_of_order, spark_error_t** error);
+extern "C" void spark_set_current_queue(spark_context_t* context, uint32_t queue, spark_error_t** error);
 extern "C" void spark_set_current_context(spark_context_t* context, spark_error_t** error);
+extern "C" spark_context_t* spark_get_current_context(spark_error_t** error);
 extern "C" void spark_destroy_context(spark_context_t* context, spark_error_t** error);
+extern "C" void spark_get_program_cache_stats(spark_context_t* context, uint64_t* hits, uint64_t* misses, spark_error_t** error);
+extern "C" void spark_get_buffer_pool_stats(spark_context_t* context, uint64_t* hits, uint64_t* misses, uint64_t* cached_bytes, spark_error_t** error);
 
 extern "C" spark_kernel_t* spark_create_kernel(spark_node_t* root, spark_error_t** error);
 extern "C" const char* spark_get_kernel_source(spark_kernel_t* kernel, spark_error_t** error);
 extern "C" void spark_set_kernel_arg_buffer(spark_kernel_t* kernel, uint32_t index, spark_buffer_t* buffer, spark_error_t** error);
 extern "C" void spark_set_kernel_arg_primitive(spark_kernel_t* kernel, uint32_t index, size_t size, const void* data, spark_error_t** error);
-extern "C" void spark_run_kernel(spark_kernel_t* kernel, size_t dim1, size_t dim2, size_t dim3, spark_error_t** error);
+extern "C" void spark_get_kernel_arg_stats(spark_kernel_t* kernel, uint64_t* updates, uint64_t* skips, spark_error_t** error);
+extern "C" void spark_set_kernel_name(spark_kernel_t* kernel, const char* name, spark_error_t** error);
+extern "C" void spark_set_kernel_autotune(spark_kernel_t* kernel, bool enabled, spark_error_t** error);
+extern "C" void spark_set_kernel_arg_partition(spark_kernel_t* kernel, uint32_t index, spark_partition_t partition, spark_error_t** error);
+extern "C" void spark_run_kernel(spark_kernel_t* kernel, const spark_work_size_t* work_size, spark_error_t** error);
+extern "C" spark_event_t* spark_run_kernel_async(spark_kernel_t* kernel, const spark_work_size_t* work_size, const spark_event_t* const* wait_list, uint32_t wait_count, spark_error_t** error);
 extern "C" void spark_destroy_kernel(spark_kernel_t* kernel, spark_error_t** error);
 
+extern "C" spark_command_list_t* spark_create_command_list(spark_error_t** error);
+extern "C" void spark_command_list_add_kernel(spark_command_list_t* list, spark_kernel_t* kernel, const spark_work_size_t* work_size, spark_error_t** error);
+extern "C" void spark_command_list_set_kernel_arg_buffer(spark_command_list_t* list, uint32_t index, spark_buffer_t* buffer, spark_error_t** error);
+extern "C" void spark_command_list_set_kernel_arg_primitive(spark_command_list_t* list, uint32_t index, size_t size, const void* data, spark_error_t** error);
+extern "C" void spark_run_command_list(spark_command_list_t* list, spark_error_t** error);
+extern "C" spark_event_t* spark_run_command_list_async(spark_command_list_t* list, const spark_event_t* const* wait_list, uint32_t wait_count, spark_error_t** error);
+extern "C" void spark_destroy_command_list(spark_command_list_t* list, spark_error_t** error);
+
 extern "C" spark_buffer_t* spark_create_buffer(size_t bytes, const void* data, spark_error_t** error);
+extern "C" spark_buffer_t* spark_create_buffer_ex(size_t bytes, const void* data, spark_buffer_flags_t flags, spark_error_t** error);
+extern "C" spark_buffer_t* spark_create_buffer_from_host_ptr(size_t bytes, void* data, spark_error_t** error);
 extern "C" void spark_write_buffer(spark_buffer_t* buffer, size_t offset, size_t bytes, const void* data, spark_error_t** error);
 extern "C" void spark_read_buffer(spark_buffer_t* buffer, size_t offset, size_t bytes, void* dest, spark_error_t** error);
-extern "C" void spark_destroy_buffer(spark_buffer_t* buffer, spark_error_t** error);
\ No newline at end of file
+extern "C" spark_event_t* spark_write_buffer_async(spark_buffer_t* buffer, size_t offset, size_t bytes, const void* data, const spark_event_t* const* wait_list, uint32_t wait_count, spark_error_t** error);
+extern "C" spark_event_t* spark_read_buffer_async(spark_buffer_t* buffer, size_t offset, size_t bytes, void* dest, const spark_event_t* const* wait_list, uint32_t wait_count, spark_error_t** error);
+extern "C" void* spark_map_buffer(spark_buffer_t* buffer, size_t offset, size_t bytes, spark_map_access_t access, spark_error_t** error);
+extern "C" void spark_unmap_buffer(spark_buffer_t* buffer, void* ptr, spark_error_t** error);
+extern "C" void spark_destroy_buffer(spark_buffer_t* buffer, spark_error_t** error);
+
+extern "C" void spark_get_kernel_cache_stats(uint64_t* hits, uint64_t* misses, spark_error_t** error);
+extern "C" void spark_reset_kernel_cache_stats(spark_error_t** error);
+
+extern "C" void spark_set_log_level(spark_log_level_t level, spark_error_t** error);
+extern "C" void spark_set_log_callback(spark_log_callback_t callback, void* user_data, spark_error_t** error);
+
+extern "C" void spark_set_tracing(bool enabled, spark_error_t** error);
+extern "C" void spark_write_trace(const char* path, spark_error_t** error);
+
+extern "C" void spark_wait_for_events(const spark_event_t* const* events, uint32_t count, spark_error_t** error);
+extern "C" void spark_destroy_event(spark_event_t* event, spark_error_t** error);
\ No newline at end of file
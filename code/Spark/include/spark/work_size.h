@@ -0,0 +1,11 @@
+#pragma once
+
+// ndrange of a kernel launch
+typedef struct spark_work_size
+{
+    // number of meaningful entries in global_size and local_size (1 to 3)
+    uint32_t dimensions;
+    size_t global_size[3];
+    // work-group shape, all zero lets the driver choose
+    size_t local_size[3];
+} spark_work_size_t;
\ No newline at end of file
@@ -0,0 +1,192 @@
+#include "spark.hpp"
+
+#include "node.hpp"
+#include "error.hpp"
+#include "analysis.hpp"
+
+using spark::shared::Control;
+using spark::shared::Operator;
+
+namespace spark
+{
+    namespace lib
+    {
+        // pointer symbol id -> indices of the entry point parameters it may point into
+        typedef std::unordered_map<spark_symbolid_t, std::vector<uint32_t>> alias_map;
+
+        // collects the parameters an address expression may point into; values loaded
+        // through a dereference or returned from a call can't be kernel arguments
+        static void findPointerRoots(const spark_node_t* node, const alias_map& aliases, std::vector<uint32_t>& roots)
+        {
+            if(node->_type == spark_nodetype::symbol)
+            {
+                auto found = aliases.find(node->_symbol.id);
+                if(found != aliases.end())
+                {
+                    roots.insert(roots.end(), found->second.begin(), found->second.end());
+                }
+                return;
+            }
+
+            if(node->_type != spark_nodetype::operation)
+            {
+                return;
+            }
+
+            switch(node->_operator.id)
+            {
+                case Operator::Dereference:
+                case Operator::Call:
+                    return;
+                default:
+                    for(auto child : node->_children)
+                    {
+                        findPointerRoots(child, aliases, roots);
+                    }
+            }
+        }
+
+        // the parameters written by storing to lvalue
+        static void findStoreRoots(const spark_node_t* lvalue, const alias_map& aliases, std::vector<uint32_t>& roots)
+        {
+            // stores to a local variable don't write memory
+            if(lvalue->_type == spark_nodetype::symbol)
+            {
+                return;
+            }
+
+            // strip swizzles and the outermost dereference down to the address
+            while(lvalue->_type == spark_nodetype::operation &&
+                  (lvalue->_operator.id == Operator::Property || lvalue->_operator.id == Operator::Dereference))
+            {
+                lvalue = lvalue->_children.front();
+            }
+            findPointerRoots(lvalue, aliases, roots);
+        }
+
+        // records pointer assignments between symbols, returns true if any alias grew
+        static bool findAliases(const spark_node_t* node, alias_map& aliases)
+        {
+            bool changed = false;
+            if(node->_type == spark_nodetype::operation &&
+               node->_operator.id == Operator::Assignment &&
+               node->_children.front()->_type == spark_nodetype::symbol &&
+               node->_children.front()->_symbol.type.GetPointer())
+            {
+                std::vector<uint32_t> roots;
+                findPointerRoots(node->_children.back(), aliases, roots);
+
+                auto& targets = aliases[node->_children.front()->_symbol.id];
+                for(auto root : roots)
+                {
+                    if(std::find(targets.begin(), targets.end(), root) == targets.end())
+                    {
+                        targets.push_back(root);
+                        changed = true;
+                    }
+                }
+            }
+
+            for(auto child : node->_children)
+            {
+                changed |= findAliases(child, aliases);
+            }
+            return changed;
+        }
+
+        static void findWrites(const spark_node_t* node, const alias_map& aliases, std::vector<bool>& written)
+        {
+            std::vector<uint32_t> roots;
+            if(node->_type == spark_nodetype::operation)
+            {
+                switch(node->_operator.id)
+                {
+                    case Operator::Assignment:
+                    case Operator::PrefixIncrement:
+                    case Operator::PrefixDecrement:
+                    case Operator::PostfixIncrement:
+                    case Operator::PostfixDecrement:
+                        findStoreRoots(node->_children.front(), aliases, roots);
+                        break;
+                    case Operator::Call:
+                        // the callee may store through any pointer it's given
+                        for(size_t k = 1; k < node->_children.size(); k++)
+                        {
+                            findPointerRoots(node->_children[k], aliases, roots);
+                        }
+                        break;
+                    default:
+                        break;
+                }
+            }
+
+            for(auto root : roots)
+            {
+                written[root] = true;
+            }
+
+            for(auto child : node->_children)
+            {
+                findWrites(child, aliases, written);
+            }
+        }
+
+        std::vector<bool> findWrittenArguments(spark_node_t* root)
+        {
+            SPARK_ASSERT(root->_type == spark_nodetype::control && root->_control == Control::Root);
+
+            for(auto func : root->_children)
+            {
+                if(func->_type != spark_nodetype::function || !func->_function.entrypoint)
+                {
+                    continue;
+                }
+
+                auto parameterList = func->_children.front();
+                SPARK_ASSERT(parameterList->_type == spark_nodetype::control && parameterList->_control == Control::ParameterList);
+
+                alias_map aliases;
+                for(uint32_t k = 0; k < parameterList->_children.size(); k++)
+                {
+                    auto param = parameterList->_children[k];
+                    if(param->_symbol.type.GetPointer())
+                    {
+                        aliases[param->_symbol.id].push_back(k);
+                    }
+                }
+
+                // aliases can be chained through locals in any order, so repeat until stable
+                auto functionBody = func->_children.back();
+                while(findAliases(functionBody, aliases));
+
+                std::vector<bool> written(parameterList->_children.size(), false);
+                findWrites(functionBody, aliases, written);
+                return written;
+            }
+            return {};
+        }
+
+        bool readsGlobalSize(const spark_node_t* node)
+        {
+            if(node->_type == spark_nodetype::operation && node->_operator.id == Operator::NormalizedIndex)
+            {
+                return true;
+            }
+            return std::any_of(node->_children.begin(), node->_children.end(), readsGlobalSize);
+        }
+
+        const spark_node_t* findEntryPoint(const spark_node_t* root)
+        {
+            SPARK_ASSERT(root->_type == spark_nodetype::control && root->_control == Control::Root);
+
+            for(auto func : root->_children)
+            {
+                if(func->_type == spark_nodetype::function && func->_function.entrypoint)
+                {
+                    return func;
+                }
+            }
+            return nullptr;
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,18 @@
+#pragma once
+
+namespace spark
+{
+    namespace lib
+    {
+        // for each parameter of the entry point (ie kernel argument index) whether the
+        // kernel may write through it; conservative, anything passed to another function
+        // or stored through an alias of the parameter counts as written
+        std::vector<bool> findWrittenArguments(spark_node_t* root);
+
+        // whether any function reads the launch's global size (through NormalizedIndex)
+        bool readsGlobalSize(const spark_node_t* node);
+
+        // the entry point's function node, null if the program has none
+        const spark_node_t* findEntryPoint(const spark_node_t* root);
+    }
+}
\ No newline at end of file
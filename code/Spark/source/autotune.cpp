@@ -0,0 +1,161 @@
+#include "spark.hpp"
+
+#include "autotune.hpp"
+#include "cache.hpp"
+
+using std::string;
+
+namespace spark
+{
+    namespace lib
+    {
+        static const char* tuningExtension = "tune";
+        // timed launches per candidate after its warm-up
+        static const size_t samplesPerCandidate = 3;
+
+        static std::vector<std::array<size_t, 3>> getCandidates(size_t max_work_group_size, const spark_work_size_t& work_size)
+        {
+            std::vector<std::array<size_t, 3>> candidates;
+            candidates.push_back({0, 0, 0});
+
+            auto tryCandidate = [&](size_t x, size_t y)
+            {
+                if(x * y > max_work_group_size ||
+                   work_size.global_size[0] % x != 0 ||
+                   work_size.global_size[1] % y != 0)
+                {
+                    return;
+                }
+                candidates.push_back({x, y, 1});
+            };
+
+            if(work_size.dimensions == 1)
+            {
+                for(size_t x = 32; x <= 1024; x <<= 1)
+                {
+                    tryCandidate(x, 1);
+                }
+            }
+            else
+            {
+                // 3d ranges are tuned over their first two dimensions
+                for(size_t x = 4; x <= 64; x <<= 1)
+                {
+                    for(size_t y = 1; y <= 16; y <<= 1)
+                    {
+                        tryCandidate(x, y);
+                    }
+                }
+            }
+            return candidates;
+        }
+
+        static bool loadTuning(uint64_t key, std::array<size_t, 3>& local_size)
+        {
+            std::vector<uint8_t> contents;
+            if(!kernel_cache::load(key, tuningExtension, contents))
+            {
+                kernel_cache::record(false);
+                return false;
+            }
+            const string line(contents.begin(), contents.end());
+            unsigned long long x, y, z;
+            if(::sscanf(line.c_str(), "%llu %llu %llu", &x, &y, &z) != 3)
+            {
+                kernel_cache::record(false);
+                return false;
+            }
+
+            local_size = {static_cast<size_t>(x), static_cast<size_t>(y), static_cast<size_t>(z)};
+            kernel_cache::record(true);
+            return true;
+        }
+
+        static void storeTuning(uint64_t key, const std::array<size_t, 3>& local_size)
+        {
+            char line[96];
+            const int length = ::snprintf(line, sizeof(line), "%llu %llu %llu\n",
+                static_cast<unsigned long long>(local_size[0]),
+                static_cast<unsigned long long>(local_size[1]),
+                static_cast<unsigned long long>(local_size[2]));
+            kernel_cache::store(key, tuningExtension, line, length);
+        }
+
+        uint64_t work_group_tuner::select(const string& source, const string& device_name, const string& driver_version, size_t max_work_group_size, const spark_work_size_t& work_size, size_t (&local_size)[3])
+        {
+            char shape[96];
+            ::snprintf(shape, sizeof(shape), "autotune %u %llu %llu %llu",
+                work_size.dimensions,
+                static_cast<unsigned long long>(work_size.global_size[0]),
+                static_cast<unsigned long long>(work_size.global_size[1]),
+                static_cast<unsigned long long>(work_size.global_size[2]));
+            const uint64_t key = kernel_cache::make_key(source, device_name, driver_version, shape);
+
+            auto found = this->_shapes.find(key);
+            if(found == this->_shapes.end())
+            {
+                shape_state state;
+                std::array<size_t, 3> stored;
+                if(loadTuning(key, stored))
+                {
+                    state.candidates.push_back(stored);
+                    state.tuned = true;
+                }
+                else
+                {
+                    state.candidates = getCandidates(max_work_group_size, work_size);
+                }
+                found = this->_shapes.emplace(key, std::move(state)).first;
+            }
+
+            auto& state = found->second;
+            const auto& candidate = state.candidates[state.tuned ? state.best : state.next];
+            std::copy(candidate.begin(), candidate.end(), local_size);
+
+            // pad unused dimensions for the explicit shapes
+            if(local_size[0] != 0)
+            {
+                for(uint32_t k = work_size.dimensions; k < 3; k++)
+                {
+                    local_size[k] = 1;
+                }
+            }
+
+            // 0 is a valid fnv hash in theory only
+            return state.tuned ? 0 : key;
+        }
+
+        void work_group_tuner::record(uint64_t token, double seconds)
+        {
+            auto found = this->_shapes.find(token);
+            if(found == this->_shapes.end() || found->second.tuned)
+            {
+                return;
+            }
+
+            // the warm-up launch pays for first-use costs, so it isn't scored
+            auto& state = found->second;
+            if(state.samples == 1 || (state.samples > 1 && seconds < state.candidate_seconds))
+            {
+                state.candidate_seconds = seconds;
+            }
+            if(++state.samples <= samplesPerCandidate)
+            {
+                return;
+            }
+
+            if(state.next == 0 || state.candidate_seconds < state.best_seconds)
+            {
+                state.best = state.next;
+                state.best_seconds = state.candidate_seconds;
+            }
+            state.samples = 0;
+
+            if(++state.next == state.candidates.size())
+            {
+                state.tuned = true;
+                storeTuning(token, state.candidates[state.best]);
+            }
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,38 @@
+#pragma once
+
+namespace spark
+{
+    namespace lib
+    {
+        // picks a work-group size for one kernel by timing candidate shapes on its first
+        // launches with a given global size; each candidate gets a discarded warm-up launch
+        // and is scored by its fastest following sample. the winner is persisted in the kernel
+        // cache directory and reused by identical kernels on the same device in later runs
+        class work_group_tuner
+        {
+        public:
+            // local size for the next launch with work_size (all zero for the driver's choice)
+            // returns a token to pass to record when the launch should be timed, 0 otherwise
+            uint64_t select(const std::string& source, const std::string& device_name, const std::string& driver_version, size_t max_work_group_size, const spark_work_size_t& work_size, size_t (&local_size)[3]);
+
+            // reports the duration of a launch selected with token
+            void record(uint64_t token, double seconds);
+
+        private:
+            struct shape_state
+            {
+                // candidate local sizes, the first is always the driver's choice
+                std::vector<std::array<size_t, 3>> candidates;
+                size_t next = 0;
+                // launches recorded for the current candidate, the first is the warm-up
+                size_t samples = 0;
+                double candidate_seconds = 0.0;
+                size_t best = 0;
+                double best_seconds = 0.0;
+                bool tuned = false;
+            };
+
+            std::unordered_map<uint64_t, shape_state> _shapes;
+        };
+    }
+}
\ No newline at end of file
@@ -0,0 +1,237 @@
+#include "spark.hpp"
+
+#include "cache.hpp"
+#include "error.hpp"
+
+// posix
+#include <sys/stat.h>
+#include <unistd.h>
+
+using std::string;
+
+namespace spark
+{
+    namespace lib
+    {
+        namespace kernel_cache
+        {
+            // bump whenever the layout of cached binaries changes
+            static const uint32_t cacheVersion = 2;
+
+            // appended to every stored binary so a truncated or otherwise damaged file
+            // is a miss rather than something handed to the driver or dlopen
+            struct trailer
+            {
+                uint64_t magic;
+                uint64_t size;
+                uint64_t checksum;
+            };
+            static const uint64_t trailerMagic = 0x65686361636b7073ull; // "spkcache"
+
+            static std::atomic<uint64_t> g_hits(0);
+            static std::atomic<uint64_t> g_misses(0);
+
+            void record(bool hit)
+            {
+                if(hit)
+                {
+                    g_hits++;
+                }
+                else
+                {
+                    g_misses++;
+                }
+            }
+
+            // 64-bit FNV-1a
+            static uint64_t hashBytes(uint64_t hash, const void* data, size_t bytes)
+            {
+                auto ptr = static_cast<const uint8_t*>(data);
+                for(size_t k = 0; k < bytes; k++)
+                {
+                    hash ^= ptr[k];
+                    hash *= 1099511628211ull;
+                }
+                return hash;
+            }
+
+            static uint64_t hashString(uint64_t hash, const string& str)
+            {
+                // include the terminator so adjacent fields can't run together
+                return hashBytes(hash, str.c_str(), str.size() + 1);
+            }
+
+            static string getDirectory()
+            {
+                if(const char* dir = ::getenv("SPARK_CACHE_DIR"))
+                {
+                    return dir;
+                }
+                if(const char* dir = ::getenv("XDG_CACHE_HOME"))
+                {
+                    if(*dir != 0)
+                    {
+                        return string(dir) + "/spark";
+                    }
+                }
+                if(const char* dir = ::getenv("HOME"))
+                {
+                    if(*dir != 0)
+                    {
+                        return string(dir) + "/.cache/spark";
+                    }
+                }
+                return string();
+            }
+
+            // mkdir -p
+            static bool makeDirectory(const string& path)
+            {
+                for(size_t pos = path.find('/', 1); ; pos = path.find('/', pos + 1))
+                {
+                    const string current = path.substr(0, pos);
+                    if(::mkdir(current.c_str(), 0755) != 0 && errno != EEXIST)
+                    {
+                        return false;
+                    }
+                    if(pos == string::npos)
+                    {
+                        break;
+                    }
+                }
+                return true;
+            }
+
+            uint64_t make_key(const string& source, const string& device_name, const string& driver_version, const string& options)
+            {
+                uint64_t hash = 14695981039346656037ull;
+                hash = hashBytes(hash, &cacheVersion, sizeof(cacheVersion));
+                hash = hashString(hash, source);
+                hash = hashString(hash, device_name);
+                hash = hashString(hash, driver_version);
+                hash = hashString(hash, options);
+                return hash;
+            }
+
+            string get_path(uint64_t key, const char* extension)
+            {
+                const string directory = getDirectory();
+                if(directory.empty())
+                {
+                    return string();
+                }
+
+                char filename[64];
+                ::snprintf(filename, sizeof(filename), "/%016llx.%s", static_cast<unsigned long long>(key), extension);
+                return directory + filename;
+            }
+
+            bool load(uint64_t key, const char* extension, std::vector<uint8_t>& binary)
+            {
+                const string path = get_path(key, extension);
+                FILE* file = path.empty() ? nullptr : ::fopen(path.c_str(), "rb");
+                if(file == nullptr)
+                {
+                    return false;
+                }
+
+                binary.clear();
+                uint8_t buffer[4096];
+                size_t read = 0;
+                while((read = ::fread(buffer, 1, sizeof(buffer), file)) > 0)
+                {
+                    binary.insert(binary.end(), buffer, buffer + read);
+                }
+                const bool failed = ::ferror(file) != 0;
+                ::fclose(file);
+
+                bool hit = false;
+                if(!failed && binary.size() > sizeof(trailer))
+                {
+                    trailer footer;
+                    const size_t payload = binary.size() - sizeof(trailer);
+                    ::memcpy(&footer, binary.data() + payload, sizeof(trailer));
+                    hit = footer.magic == trailerMagic &&
+                          footer.size == payload &&
+                          footer.checksum == hashBytes(14695981039346656037ull, binary.data(), payload);
+                    binary.resize(payload);
+                }
+                if(!hit)
+                {
+                    binary.clear();
+                }
+                return hit;
+            }
+
+            void store(uint64_t key, const char* extension, const void* data, size_t bytes)
+            {
+                const string path = get_path(key, extension);
+                if(path.empty() || !makeDirectory(path.substr(0, path.rfind('/'))))
+                {
+                    return;
+                }
+
+                // write to a private temp file and rename over so concurrent
+                // processes and threads never observe a partial binary
+                const string tempPath = path + ".tmp." + std::to_string(::getpid()) + "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+                FILE* file = ::fopen(tempPath.c_str(), "wb");
+                if(file == nullptr)
+                {
+                    return;
+                }
+                const trailer footer = {trailerMagic, bytes, hashBytes(14695981039346656037ull, data, bytes)};
+                const bool written = ::fwrite(data, 1, bytes, file) == bytes &&
+                                     ::fwrite(&footer, sizeof(footer), 1, file) == 1;
+                const bool closed = ::fclose(file) == 0;
+
+                if(!written || !closed || ::rename(tempPath.c_str(), path.c_str()) != 0)
+                {
+                    ::unlink(tempPath.c_str());
+                }
+            }
+
+            uint64_t hits()
+            {
+                return g_hits.load();
+            }
+
+            uint64_t misses()
+            {
+                return g_misses.load();
+            }
+
+            void reset_stats()
+            {
+                g_hits.store(0);
+                g_misses.store(0);
+            }
+        }
+    }
+}
+
+RUFF_EXPORT void spark_get_kernel_cache_stats(uint64_t* hits, uint64_t* misses, spark_error_t** error)
+{
+    return TranslateExceptions(
+        error,
+        [&]
+        {
+            if(hits != nullptr)
+            {
+                *hits = spark::lib::kernel_cache::hits();
+            }
+            if(misses != nullptr)
+            {
+                *misses = spark::lib::kernel_cache::misses();
+            }
+        });
+}
+
+RUFF_EXPORT void spark_reset_kernel_cache_stats(spark_error_t** error)
+{
+    return TranslateExceptions(
+        error,
+        [&]
+        {
+            spark::lib::kernel_cache::reset_stats();
+        });
+}
\ No newline at end of file
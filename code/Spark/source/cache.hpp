@@ -0,0 +1,31 @@
+#pragma once
+
+namespace spark
+{
+    namespace lib
+    {
+        // persistent store of compiled kernel binaries, located at $SPARK_CACHE_DIR,
+        // $XDG_CACHE_HOME/spark or ~/.cache/spark (first one set wins)
+        // setting SPARK_CACHE_DIR to an empty string disables the cache
+        namespace kernel_cache
+        {
+            // key for a kernel built from source on a particular device/driver with the given options
+            uint64_t make_key(const std::string& source, const std::string& device_name, const std::string& driver_version, const std::string& options);
+
+            // path the binary for key is stored at, or an empty string if the cache is disabled
+            std::string get_path(uint64_t key, const char* extension);
+
+            // loads a previously stored binary, rejecting truncated or corrupt files
+            bool load(uint64_t key, const char* extension, std::vector<uint8_t>& binary);
+            // counts a hit or miss; callers record once whatever they loaded has been accepted
+            void record(bool hit);
+            // atomically writes binary to the cache; failures are ignored
+            // the file has a checksummed trailer after binary, which dlopen ignores
+            void store(uint64_t key, const char* extension, const void* data, size_t bytes);
+
+            uint64_t hits();
+            uint64_t misses();
+            void reset_stats();
+        }
+    }
+}
\ No newline at end of file
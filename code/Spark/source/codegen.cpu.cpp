@@ -0,0 +1,996 @@
+#include "spark.hpp"
+
+// spark internal
+#include "node.hpp"
+#include "error.hpp"
+#include "text_utilities.hpp"
+
+using std::string;
+using std::unordered_set;
+
+using namespace spark;
+using namespace spark::lib;
+using namespace spark::shared;
+
+namespace spark
+{
+    namespace lib
+    {
+        // support library compiled in front of every generated cpu kernel; provides
+        // the OpenCL C vector types, swizzles and built-in functions the generated
+        // code relies on
+        static const char* cppPrelude = R"PRELUDE(
+#include <cstddef>
+#include <cstdint>
+#include <cmath>
+#include <type_traits>
+
+namespace spark_native
+{
+    // vector types
+
+    template<typename T, int N>
+    struct vec
+    {
+        typedef T value_type;
+
+        vec() = default;
+        vec(T val) { for(int k = 0; k < N; k++) s[k] = val; }
+        template<typename... U, typename = typename std::enable_if<(sizeof...(U) == N)>::type>
+        vec(U... vals) : s{static_cast<T>(vals)...} {}
+        template<typename U>
+        explicit vec(const vec<U, N>& that) { for(int k = 0; k < N; k++) s[k] = static_cast<T>(that.s[k]); }
+
+        T s[N];
+    };
+
+    template<typename T> struct mask_type;
+    template<> struct mask_type<int8_t> { typedef int8_t type; };
+    template<> struct mask_type<uint8_t> { typedef int8_t type; };
+    template<> struct mask_type<int16_t> { typedef int16_t type; };
+    template<> struct mask_type<uint16_t> { typedef int16_t type; };
+    template<> struct mask_type<int32_t> { typedef int32_t type; };
+    template<> struct mask_type<uint32_t> { typedef int32_t type; };
+    template<> struct mask_type<int64_t> { typedef int64_t type; };
+    template<> struct mask_type<uint64_t> { typedef int64_t type; };
+    template<> struct mask_type<float> { typedef int32_t type; };
+    template<> struct mask_type<double> { typedef int64_t type; };
+
+    #define SPARK_VECTOR_BINARY(OP)\
+    template<typename T, int N> inline vec<T, N> operator OP(const vec<T, N>& a, const vec<T, N>& b) { vec<T, N> r; for(int k = 0; k < N; k++) r.s[k] = a.s[k] OP b.s[k]; return r; }\
+    template<typename T, int N> inline vec<T, N> operator OP(const vec<T, N>& a, const typename vec<T, N>::value_type& b) { vec<T, N> r; for(int k = 0; k < N; k++) r.s[k] = a.s[k] OP b; return r; }\
+    template<typename T, int N> inline vec<T, N> operator OP(const typename vec<T, N>::value_type& a, const vec<T, N>& b) { vec<T, N> r; for(int k = 0; k < N; k++) r.s[k] = a OP b.s[k]; return r; }
+
+    #define SPARK_VECTOR_COMPARE(OP)\
+    template<typename T, int N> inline vec<typename mask_type<T>::type, N> operator OP(const vec<T, N>& a, const vec<T, N>& b) { vec<typename mask_type<T>::type, N> r; for(int k = 0; k < N; k++) r.s[k] = (a.s[k] OP b.s[k]) ? -1 : 0; return r; }\
+    template<typename T, int N> inline vec<typename mask_type<T>::type, N> operator OP(const vec<T, N>& a, const typename vec<T, N>::value_type& b) { vec<typename mask_type<T>::type, N> r; for(int k = 0; k < N; k++) r.s[k] = (a.s[k] OP b) ? -1 : 0; return r; }\
+    template<typename T, int N> inline vec<typename mask_type<T>::type, N> operator OP(const typename vec<T, N>::value_type& a, const vec<T, N>& b) { vec<typename mask_type<T>::type, N> r; for(int k = 0; k < N; k++) r.s[k] = (a OP b.s[k]) ? -1 : 0; return r; }
+
+    SPARK_VECTOR_BINARY(+)
+    SPARK_VECTOR_BINARY(-)
+    SPARK_VECTOR_BINARY(*)
+    SPARK_VECTOR_BINARY(/)
+    SPARK_VECTOR_BINARY(%)
+    SPARK_VECTOR_BINARY(&)
+    SPARK_VECTOR_BINARY(|)
+    SPARK_VECTOR_BINARY(^)
+    SPARK_VECTOR_BINARY(>>)
+    SPARK_VECTOR_BINARY(<<)
+    SPARK_VECTOR_COMPARE(>)
+    SPARK_VECTOR_COMPARE(<)
+    SPARK_VECTOR_COMPARE(>=)
+    SPARK_VECTOR_COMPARE(<=)
+    SPARK_VECTOR_COMPARE(!=)
+    SPARK_VECTOR_COMPARE(==)
+
+    template<typename T, int N> inline vec<T, N> operator-(const vec<T, N>& a) { vec<T, N> r; for(int k = 0; k < N; k++) r.s[k] = -a.s[k]; return r; }
+    template<typename T, int N> inline vec<T, N> operator~(const vec<T, N>& a) { vec<T, N> r; for(int k = 0; k < N; k++) r.s[k] = ~a.s[k]; return r; }
+    template<typename T, int N> inline vec<typename mask_type<T>::type, N> operator!(const vec<T, N>& a) { vec<typename mask_type<T>::type, N> r; for(int k = 0; k < N; k++) r.s[k] = !a.s[k] ? -1 : 0; return r; }
+
+    // swizzles
+
+    template<int I, typename T, int N>
+    inline T spark_swizzle(const vec<T, N>& v) { return v.s[I]; }
+    template<int I0, int I1, int... I, typename T, int N>
+    inline vec<T, 2 + sizeof...(I)> spark_swizzle(const vec<T, N>& v) { return vec<T, 2 + sizeof...(I)>(v.s[I0], v.s[I1], v.s[I]...); }
+
+    template<typename T, int N, int... I>
+    struct swizzle_ref
+    {
+        swizzle_ref& operator=(const vec<T, sizeof...(I)>& that)
+        {
+            const int indices[] = {I...};
+            for(int k = 0; k < int(sizeof...(I)); k++) v.s[indices[k]] = that.s[k];
+            return *this;
+        }
+        vec<T, N>& v;
+    };
+
+    template<int I, typename T, int N>
+    inline T& spark_swizzle_ref(vec<T, N>& v) { return v.s[I]; }
+    template<int I0, int I1, int... I, typename T, int N>
+    inline swizzle_ref<T, N, I0, I1, I...> spark_swizzle_ref(vec<T, N>& v) { return {v}; }
+
+    // work item functions
+
+    static thread_local size_t spark_global_id[3];
+    static thread_local size_t spark_global_size[3];
+
+    inline size_t get_global_id(uint32_t dim) { return spark_global_id[dim]; }
+    inline size_t get_global_size(uint32_t dim) { return spark_global_size[dim]; }
+
+    // math functions
+
+    #define SPARK_FLOAT_FUNCTION1(NAME, EXPR)\
+    inline float NAME(float a) { typedef float T; (void)sizeof(T); return EXPR; }\
+    inline double NAME(double a) { typedef double T; (void)sizeof(T); return EXPR; }\
+    template<typename T, int N> inline vec<T, N> NAME(const vec<T, N>& a) { vec<T, N> r; for(int k = 0; k < N; k++) r.s[k] = NAME(a.s[k]); return r; }
+
+    #define SPARK_FLOAT_FUNCTION2(NAME, EXPR)\
+    inline float NAME(float a, float b) { typedef float T; (void)sizeof(T); return EXPR; }\
+    inline double NAME(double a, double b) { typedef double T; (void)sizeof(T); return EXPR; }\
+    template<typename T, int N> inline vec<T, N> NAME(const vec<T, N>& a, const vec<T, N>& b) { vec<T, N> r; for(int k = 0; k < N; k++) r.s[k] = NAME(a.s[k], b.s[k]); return r; }
+
+    #define SPARK_FLOAT_FUNCTION3(NAME, EXPR)\
+    inline float NAME(float a, float b, float c) { return EXPR; }\
+    inline double NAME(double a, double b, double c) { return EXPR; }\
+    template<typename T, int N> inline vec<T, N> NAME(const vec<T, N>& a, const vec<T, N>& b, const vec<T, N>& c) { vec<T, N> r; for(int k = 0; k < N; k++) r.s[k] = NAME(a.s[k], b.s[k], c.s[k]); return r; }
+
+    SPARK_FLOAT_FUNCTION1(acos, std::acos(a))
+    SPARK_FLOAT_FUNCTION1(acosh, std::acosh(a))
+    SPARK_FLOAT_FUNCTION1(asin, std::asin(a))
+    SPARK_FLOAT_FUNCTION1(asinh, std::asinh(a))
+    SPARK_FLOAT_FUNCTION1(atan, std::atan(a))
+    SPARK_FLOAT_FUNCTION2(atan2, std::atan2(a, b))
+    SPARK_FLOAT_FUNCTION1(atanh, std::atanh(a))
+    SPARK_FLOAT_FUNCTION1(cbrt, std::cbrt(a))
+    SPARK_FLOAT_FUNCTION1(ceil, std::ceil(a))
+    SPARK_FLOAT_FUNCTION1(cos, std::cos(a))
+    SPARK_FLOAT_FUNCTION1(exp, std::exp(a))
+    SPARK_FLOAT_FUNCTION1(exp2, std::exp2(a))
+    SPARK_FLOAT_FUNCTION1(exp10, std::pow(T(10), a))
+    SPARK_FLOAT_FUNCTION1(fabs, std::fabs(a))
+    SPARK_FLOAT_FUNCTION1(floor, std::floor(a))
+    SPARK_FLOAT_FUNCTION3(fma, std::fma(a, b, c))
+    SPARK_FLOAT_FUNCTION2(fmax, std::fmax(a, b))
+    SPARK_FLOAT_FUNCTION2(fmin, std::fmin(a, b))
+    SPARK_FLOAT_FUNCTION2(fmod, std::fmod(a, b))
+    SPARK_FLOAT_FUNCTION2(hypot, std::hypot(a, b))
+    SPARK_FLOAT_FUNCTION1(lgamma, std::lgamma(a))
+    SPARK_FLOAT_FUNCTION1(log, std::log(a))
+    SPARK_FLOAT_FUNCTION1(log2, std::log2(a))
+    SPARK_FLOAT_FUNCTION1(log10, std::log10(a))
+    SPARK_FLOAT_FUNCTION1(log1p, std::log1p(a))
+    SPARK_FLOAT_FUNCTION3(mad, a * b + c)
+    SPARK_FLOAT_FUNCTION2(pow, std::pow(a, b))
+    SPARK_FLOAT_FUNCTION2(remainder, std::remainder(a, b))
+    SPARK_FLOAT_FUNCTION1(rsqrt, T(1) / std::sqrt(a))
+    SPARK_FLOAT_FUNCTION1(sin, std::sin(a))
+    SPARK_FLOAT_FUNCTION1(sinh, std::sinh(a))
+    SPARK_FLOAT_FUNCTION1(sqrt, std::sqrt(a))
+    SPARK_FLOAT_FUNCTION1(tan, std::tan(a))
+    SPARK_FLOAT_FUNCTION1(tanh, std::tanh(a))
+    SPARK_FLOAT_FUNCTION1(tgamma, std::tgamma(a))
+    SPARK_FLOAT_FUNCTION1(trunc, std::trunc(a))
+    SPARK_FLOAT_FUNCTION1(degrees, a * T(57.295779513082320876798154814105))
+    SPARK_FLOAT_FUNCTION1(radians, a * T(0.017453292519943295769236907684886))
+    SPARK_FLOAT_FUNCTION1(sign, a > T(0) ? T(1) : (a < T(0) ? T(-1) : T(0)))
+
+    template<typename T>
+    inline T fract(T a, T* iptr) { const T fl = floor(a); *iptr = fl; return fmin(a - fl, T(0.99999994f)); }
+
+    // geometric functions
+
+    inline float dot(float a, float b) { return a * b; }
+    inline double dot(double a, double b) { return a * b; }
+    template<typename T, int N> inline T dot(const vec<T, N>& a, const vec<T, N>& b) { T r = T(0); for(int k = 0; k < N; k++) r += a.s[k] * b.s[k]; return r; }
+    template<typename T> inline vec<T, 4> cross(const vec<T, 4>& a, const vec<T, 4>& b)
+    {
+        return vec<T, 4>(a.s[1] * b.s[2] - a.s[2] * b.s[1], a.s[2] * b.s[0] - a.s[0] * b.s[2], a.s[0] * b.s[1] - a.s[1] * b.s[0], T(0));
+    }
+    template<typename T> inline auto length(const T& a) -> decltype(dot(a, a)) { return sqrt(dot(a, a)); }
+    template<typename T> inline auto distance(const T& a, const T& b) -> decltype(dot(a, b)) { return length(a - b); }
+    template<typename T> inline T normalize(const T& a) { return a / length(a); }
+    template<typename T> inline auto fast_length(const T& a) -> decltype(dot(a, a)) { return length(a); }
+    template<typename T> inline auto fast_distance(const T& a, const T& b) -> decltype(dot(a, b)) { return distance(a, b); }
+    template<typename T> inline T fast_normalize(const T& a) { return normalize(a); }
+
+    // integer functions
+
+    template<typename T> inline typename std::make_unsigned<T>::type abs(T a) { return static_cast<typename std::make_unsigned<T>::type>(a < 0 ? -a : a); }
+    template<typename T> inline typename std::make_unsigned<T>::type abs_diff(T a, T b) { return static_cast<typename std::make_unsigned<T>::type>(a > b ? a - b : b - a); }
+    template<typename T> inline T max(T a, T b) { return a > b ? a : b; }
+    template<typename T> inline T min(T a, T b) { return a < b ? a : b; }
+    template<typename T, int N> inline vec<typename std::make_unsigned<T>::type, N> abs(const vec<T, N>& a) { vec<typename std::make_unsigned<T>::type, N> r; for(int k = 0; k < N; k++) r.s[k] = abs(a.s[k]); return r; }
+    template<typename T, int N> inline vec<typename std::make_unsigned<T>::type, N> abs_diff(const vec<T, N>& a, const vec<T, N>& b) { vec<typename std::make_unsigned<T>::type, N> r; for(int k = 0; k < N; k++) r.s[k] = abs_diff(a.s[k], b.s[k]); return r; }
+    template<typename T, int N> inline vec<T, N> max(const vec<T, N>& a, const vec<T, N>& b) { vec<T, N> r; for(int k = 0; k < N; k++) r.s[k] = max(a.s[k], b.s[k]); return r; }
+    template<typename T, int N> inline vec<T, N> min(const vec<T, N>& a, const vec<T, N>& b) { vec<T, N> r; for(int k = 0; k < N; k++) r.s[k] = min(a.s[k], b.s[k]); return r; }
+
+    // common functions
+
+    template<typename T> inline T clamp(T a, T lo, T hi) { return a < lo ? lo : (a > hi ? hi : a); }
+    template<typename T, int N> inline vec<T, N> clamp(const vec<T, N>& a, const vec<T, N>& lo, const vec<T, N>& hi) { vec<T, N> r; for(int k = 0; k < N; k++) r.s[k] = clamp(a.s[k], lo.s[k], hi.s[k]); return r; }
+    template<typename T, int N> inline vec<T, N> clamp(const vec<T, N>& a, const typename vec<T, N>::value_type& lo, const typename vec<T, N>::value_type& hi) { vec<T, N> r; for(int k = 0; k < N; k++) r.s[k] = clamp(a.s[k], lo, hi); return r; }
+    template<typename T, typename A> inline T mix(const T& x, const T& y, const A& a) { return x + (y - x) * a; }
+    template<typename T> inline T step(T edge, T a) { return a < edge ? T(0) : T(1); }
+    template<typename T, int N> inline vec<T, N> step(const vec<T, N>& edge, const vec<T, N>& a) { vec<T, N> r; for(int k = 0; k < N; k++) r.s[k] = step(edge.s[k], a.s[k]); return r; }
+    template<typename T, int N> inline vec<T, N> step(const typename vec<T, N>::value_type& edge, const vec<T, N>& a) { vec<T, N> r; for(int k = 0; k < N; k++) r.s[k] = step(edge, a.s[k]); return r; }
+    template<typename T> inline T smoothstep(T edge0, T edge1, T a) { const T t = clamp((a - edge0) / (edge1 - edge0), T(0), T(1)); return t * t * (T(3) - T(2) * t); }
+    template<typename T, int N> inline vec<T, N> smoothstep(const vec<T, N>& edge0, const vec<T, N>& edge1, const vec<T, N>& a) { vec<T, N> r; for(int k = 0; k < N; k++) r.s[k] = smoothstep(edge0.s[k], edge1.s[k], a.s[k]); return r; }
+    template<typename T, int N> inline vec<T, N> smoothstep(const typename vec<T, N>::value_type& edge0, const typename vec<T, N>::value_type& edge1, const vec<T, N>& a) { vec<T, N> r; for(int k = 0; k < N; k++) r.s[k] = smoothstep(edge0, edge1, a.s[k]); return r; }
+}
+)PRELUDE";
+
+        struct cpu_data
+        {
+            int32_t indent = 0;
+            unordered_set<spark_symbolid_t> inited_variables;
+        };
+
+        using context = codegen_context<cpu_data>;
+
+        // forward declare
+        static void generateValueNode(context& ctx, spark_node_t* value, bool lvalue = false);
+        static void generateScopeBlock(context& ctx, spark_node_t* scopeBlock);
+
+        static void generateSymbolName(context& ctx, spark_symbolid_t id, Datatype dt)
+        {
+            const auto primitive = dt.GetPrimitive();
+            const auto components = dt.GetComponents();
+            const auto pointer = dt.GetPointer();
+
+            const char* primitive_str = nullptr;
+            switch(primitive)
+            {
+                case Primitive::Char:    primitive_str = "s8_"; break;
+                case Primitive::UChar:   primitive_str = "u8_"; break;
+                case Primitive::Short:   primitive_str = "s16_"; break;
+                case Primitive::UShort:  primitive_str = "u16_"; break;
+                case Primitive::Int:     primitive_str = "s32_"; break;
+                case Primitive::UInt:    primitive_str = "u32_"; break;
+                case Primitive::Long:    primitive_str = "s64_"; break;
+                case Primitive::ULong:   primitive_str = "u64_"; break;
+                case Primitive::Float:   primitive_str = "flt_"; break;
+                case Primitive::Double:  primitive_str = "dbl_"; break;
+                default:
+                    SPARK_ASSERT(false);
+            }
+
+            const char* components_str = nullptr;
+            switch(components)
+            {
+                case Components::Vector2: components_str = "vec2_"; break;
+                case Components::Vector4: components_str = "vec4_"; break;
+                default:                  components_str = ""; break;
+            }
+
+            const char* pointer_str = pointer ? "p_" : "";
+
+            emit_string(ctx, pointer_str);
+            emit_string(ctx, components_str);
+            emit_string(ctx, primitive_str);
+            emit_uint(ctx, id);
+        }
+
+        static void generateFunctionName(context& ctx, spark_symbolid_t id)
+        {
+            emit(ctx, "func_");
+            emit_uint(ctx, id);
+        }
+
+        static void generateCppType(context& ctx, Datatype dt)
+        {
+            const auto primitive = dt.GetPrimitive();
+            const auto components = dt.GetComponents();
+            const auto pointer = dt.GetPointer();
+
+            const char* primitive_str = nullptr;
+            switch(primitive)
+            {
+                case Primitive::Void:    primitive_str = "void"; break;
+                case Primitive::Char:    primitive_str = "int8_t"; break;
+                case Primitive::UChar:   primitive_str = "uint8_t"; break;
+                case Primitive::Short:   primitive_str = "int16_t"; break;
+                case Primitive::UShort:  primitive_str = "uint16_t"; break;
+                case Primitive::Int:     primitive_str = "int32_t"; break;
+                case Primitive::UInt:    primitive_str = "uint32_t"; break;
+                case Primitive::Long:    primitive_str = "int64_t"; break;
+                case Primitive::ULong:   primitive_str = "uint64_t"; break;
+                case Primitive::Float:   primitive_str = "float"; break;
+                case Primitive::Double:  primitive_str = "double"; break;
+                default:
+                    SPARK_ASSERT(false);
+            }
+
+            const char* pointer_str = pointer ? "*" : "";
+
+            switch(components)
+            {
+                case Components::Vector2:
+                    emit(ctx, "vec<%s, 2>%s", primitive_str, pointer_str);
+                    break;
+                case Components::Vector4:
+                    emit(ctx, "vec<%s, 4>%s", primitive_str, pointer_str);
+                    break;
+                default:
+                    emit_string(ctx, primitive_str);
+                    emit_string(ctx, pointer_str);
+                    break;
+            }
+        }
+
+        static Datatype getNodeDatatype(spark_node_t* node)
+        {
+            switch(node->_type)
+            {
+                case spark_nodetype::operation:
+                    return node->_operator.type;
+                case spark_nodetype::symbol:
+                    return node->_symbol.type;
+                case spark_nodetype::constant:
+                    return node->_constant.type;
+                case spark_nodetype::vector:
+                    return node->_vector.type;
+                default:
+                    return Datatype();
+            }
+        }
+
+        static void generateIndent(context& ctx)
+        {
+            for(int32_t k = 0; k < ctx.indent; k++)
+            {
+                emit(ctx, "    ");
+            }
+        }
+
+        static void generateFunctionCall(context& ctx, spark_node_t* value, const std::pair<const char*, size_t>& function)
+        {
+            // get vals
+            const auto& funcName = function.first;
+            size_t funcParams = function.second;
+
+            SPARK_ASSERT(funcParams == value->_children.size());
+
+            emit_string(ctx, funcName);
+            emit(ctx, "(");
+            generateValueNode(ctx, value->_children.front());
+            for(size_t k = 1; k < funcParams; k++)
+            {
+                emit(ctx, ", ");
+                generateValueNode(ctx, value->_children[k]);
+            }
+            emit(ctx, ")");
+        }
+
+        // swizzles are emitted as spark_swizzle<indices...>(vector), or spark_swizzle_ref when
+        // the result is assigned to
+        static void generatePropertyNode(context& ctx, spark_node_t* value, bool lvalue)
+        {
+            SPARK_ASSERT(value->_children.size() == 2);
+            SPARK_ASSERT(value->_children.back()->_type == spark_nodetype::property);
+
+            const auto property = value->_children.back()->_property.id;
+
+            int32_t indices[4];
+            int32_t indexCount = 0;
+            if(property >= Property::FirstProperty)
+            {
+                const bool vector4 = getNodeDatatype(value->_children.front()).GetComponents() == Components::Vector4;
+                switch(property)
+                {
+                    case Property::Lo:
+                        indices[indexCount++] = 0;
+                        if(vector4) { indices[indexCount++] = 1; }
+                        break;
+                    case Property::Hi:
+                        indices[indexCount++] = vector4 ? 2 : 1;
+                        if(vector4) { indices[indexCount++] = 3; }
+                        break;
+                    case Property::Even:
+                        indices[indexCount++] = 0;
+                        if(vector4) { indices[indexCount++] = 2; }
+                        break;
+                    case Property::Odd:
+                        indices[indexCount++] = 1;
+                        if(vector4) { indices[indexCount++] = 3; }
+                        break;
+                    default:
+                        SPARK_ASSERT(false);
+                }
+            }
+            else
+            {
+                // swizzle values are in base 5, most significant digit is the first component
+                int32_t reversed[4];
+                auto swizzle = static_cast<spark_property_t>(property);
+                while(swizzle > 0)
+                {
+                    SPARK_ASSERT(indexCount < 4);
+                    reversed[indexCount++] = static_cast<int32_t>(swizzle % 5) - 1;
+                    swizzle /= 5;
+                }
+                for(int32_t k = 0; k < indexCount; k++)
+                {
+                    indices[k] = reversed[indexCount - k - 1];
+                }
+            }
+
+            if(lvalue)
+            {
+                emit(ctx, "spark_swizzle_ref<");
+                emit_int(ctx, indices[0]);
+            }
+            else
+            {
+                emit(ctx, "spark_swizzle<");
+                emit_int(ctx, indices[0]);
+            }
+            for(int32_t k = 1; k < indexCount; k++)
+            {
+                emit(ctx, ", ");
+                emit_int(ctx, indices[k]);
+            }
+            emit(ctx, ">(");
+            generateValueNode(ctx, value->_children.front(), lvalue);
+            emit(ctx, ")");
+        }
+
+        static void generateOperatorNode(context& ctx, spark_node_t* value, bool lvalue)
+        {
+            SPARK_ASSERT(value->_type == spark_nodetype::operation);
+            auto op = value->_operator.id;
+            SPARK_ASSERT(op < Operator::Count);
+
+            if(op == Operator::Break)
+            {
+                SPARK_ASSERT(value->_children.size() == 0);
+                emit(ctx, "break");
+            }
+            else if(op >= Operator::Negate && op <= Operator::Dereference)
+            {
+                SPARK_ASSERT(value->_children.size() == 1);
+                const char* unary[] =
+                {
+                    "-",
+                    "&",
+                    "++",
+                    "--",
+                    "!",
+                    "~",
+                    "*",
+                };
+                // address-of and increments operate on an lvalue
+                const bool childLvalue = (op >= Operator::AddressOf && op <= Operator::PrefixDecrement);
+                emit(ctx, "(");
+                emit_string(ctx, unary[static_cast<spark_operator_t>(op - Operator::Negate)]);
+                generateValueNode(ctx, value->_children.front(), childLvalue);
+                emit(ctx, ")");
+            }
+            else if(op >= Operator::PostfixIncrement && op <= Operator::PostfixDecrement)
+            {
+                SPARK_ASSERT(value->_children.size() == 1);
+                const char* unary[] =
+                {
+                    "++",
+                    "--",
+                };
+                emit(ctx, "(");
+                generateValueNode(ctx, value->_children.front(), true);
+                emit_string(ctx, unary[static_cast<spark_operator_t>(op - Operator::PostfixIncrement)]);
+                emit(ctx, ")");
+            }
+            else if(op >= Operator::Add && op <= Operator::LeftShift)
+            {
+                SPARK_ASSERT(value->_children.size() == 2);
+                const char* binary[] =
+                {
+                    "+",
+                    "-",
+                    "*",
+                    "/",
+                    "%",
+                    ">",
+                    "<",
+                    ">=",
+                    "<=",
+                    "!=",
+                    "==",
+                    "&&",
+                    "||",
+                    "&",
+                    "|",
+                    "^",
+                    ">>",
+                    "<<",
+                };
+                emit(ctx, "(");
+                generateValueNode(ctx, value->_children.front());
+                emit(ctx, " ");
+                emit_string(ctx, binary[static_cast<spark_operator_t>(op - Operator::Add)]);
+                emit(ctx, " ");
+                generateValueNode(ctx, value->_children.back());
+                emit(ctx, ")");
+            }
+            else if(op == Operator::Assignment)
+            {
+                SPARK_ASSERT(value->_children.size() == 2);
+                if(value->_children.front()->_type == spark_nodetype::symbol)
+                {
+                    const auto id = value->_children.front()->_symbol.id;
+                    if(ctx.inited_variables.find(id) == ctx.inited_variables.end())
+                    {
+                        ctx.inited_variables.insert(id);
+                        const auto type = value->_children.front()->_symbol.type;
+                        generateCppType(ctx, type);
+                        emit(ctx, " ");
+                    }
+                }
+
+                generateValueNode(ctx, value->_children.front(), true);
+                emit(ctx, " = ");
+                generateValueNode(ctx, value->_children.back());
+            }
+            else if(op == Operator::Call)
+            {
+                SPARK_ASSERT(value->_children.size() >= 1);
+                SPARK_ASSERT(value->_children.front()->_type == spark_nodetype::function);
+                generateFunctionName(ctx, value->_children.front()->_function.id);
+                emit(ctx, "(");
+                for(size_t k = 1; k < value->_children.size(); k++)
+                {
+                    auto* currentChild = value->_children[k];
+                    if(k > 1)
+                    {
+                       emit(ctx, ", ");
+                    }
+                    generateValueNode(ctx, currentChild);
+                }
+                emit(ctx, ")");
+            }
+            else if(op == Operator::Property)
+            {
+                generatePropertyNode(ctx, value, lvalue);
+            }
+            else if(op == Operator::Return)
+            {
+                if(value->_children.size() == 0)
+                {
+                    SPARK_ASSERT(value->_operator.type.GetPrimitive() == Primitive::Void);
+                    emit(ctx, "return");
+                }
+                else
+                {
+                    SPARK_ASSERT(value->_children.size() == 1);
+                    emit(ctx, "return ");
+                    generateValueNode(ctx, value->_children.front());
+                }
+            }
+            else if(op == Operator::Cast)
+            {
+                SPARK_ASSERT(value->_children.size() == 1);
+                emit(ctx, "(");
+                generateCppType(ctx, value->_operator.type);
+                emit(ctx, ")(");
+                generateValueNode(ctx, value->_children.front());
+                emit(ctx, ")");
+            }
+            else if(op == Operator::Index)
+            {
+                SPARK_ASSERT(value->_children.size() == 0);
+                emit(ctx, "vec<int32_t, 2>((int32_t)get_global_id(0), (int32_t)get_global_id(1))");
+            }
+            else if(op == Operator::NormalizedIndex)
+            {
+                SPARK_ASSERT(value->_children.size() == 0);
+                emit(ctx, "vec<float, 2>((float)get_global_id(0)/(float)(get_global_size(0) - 1), (float)get_global_id(1)/(float)(get_global_size(1) - 1))");
+            }
+            else if(op >= Operator::ArcCos && op <= Operator::Sign)
+            {
+                // same names as the OpenCL built-ins, implemented by the prelude
+                const std::pair<const char*, size_t> functions[] =
+                {
+                    {"acos", 1},
+                    {"acosh", 1},
+                    {"asin", 1},
+                    {"asinh", 1},
+                    {"atan", 1},
+                    {"atan2", 2},
+                    {"atanh", 1},
+                    {"cbrt", 1},
+                    {"ceil", 1},
+                    {"cos", 1},
+                    {"exp", 1},
+                    {"exp2", 1},
+                    {"exp10", 1},
+                    {"fabs", 1},
+                    {"floor", 1},
+                    {"fma", 3},
+                    {"fmax", 2},
+                    {"fmin", 2},
+                    {"fmod", 2},
+                    {"fract", 2},
+                    {"hypot", 2},
+                    {"lgamma", 1},
+                    {"log", 1},
+                    {"log2", 1},
+                    {"log10", 1},
+                    {"log1p", 1},
+                    {"mad", 3},
+                    {"pow", 2},
+                    {"remainder", 2},
+                    {"rsqrt", 1},
+                    {"sin", 1},
+                    {"sinh", 1},
+                    {"sqrt", 1},
+                    {"tan", 1},
+                    {"tanh", 1},
+                    {"tgamma", 1},
+                    {"trunc", 1},
+                    {"cross", 2},
+                    {"dot", 2},
+                    {"distance", 2},
+                    {"length", 1},
+                    {"normalize", 1},
+                    {"fast_distance", 2},
+                    {"fast_length", 1},
+                    {"fast_normalize", 1},
+                    {"abs", 1},
+                    {"abs_diff", 2},
+                    {"max", 2},
+                    {"min", 2},
+                    {"clamp", 3},
+                    {"degrees", 1},
+                    {"radians", 1},
+                    {"mix", 3},
+                    {"step", 2},
+                    {"smoothstep", 3},
+                    {"sign", 1},
+                };
+                // get index
+                auto idx = (size_t)(op - Operator::ArcCos);
+                SPARK_ASSERT(idx < ruff::countof(functions));
+
+                generateFunctionCall(ctx, value, functions[idx]);
+            }
+        }
+
+        static void generateSymbolNode(context& ctx, spark_node_t* symbol)
+        {
+            generateSymbolName(ctx, symbol->_symbol.id, symbol->_symbol.type);
+        }
+
+        static void generateConstantNode(context& ctx, spark_node_t* constant)
+        {
+            SPARK_ASSERT(constant->_type == spark_nodetype::constant);
+            auto dt = constant->_constant.type;
+            SPARK_ASSERT(dt.GetComponents() == Components::Scalar);
+
+            void* raw = constant->_constant.buffer;
+            switch(constant->_constant.type.GetPrimitive())
+            {
+                case Primitive::Char:
+                    emit_int(ctx, *reinterpret_cast<int8_t*>(raw));
+                    break;
+                case Primitive::UChar:
+                    emit_uint(ctx, *reinterpret_cast<uint8_t*>(raw));
+                    emit(ctx, "u");
+                    break;
+                case Primitive::Short:
+                    emit_int(ctx, *reinterpret_cast<int16_t*>(raw));
+                    break;
+                case Primitive::UShort:
+                    emit_uint(ctx, *reinterpret_cast<uint16_t*>(raw));
+                    emit(ctx, "u");
+                    break;
+                case Primitive::Int:
+                    emit_int(ctx, *reinterpret_cast<int32_t*>(raw));
+                    break;
+                case Primitive::UInt:
+                    emit_uint(ctx, *reinterpret_cast<uint32_t*>(raw));
+                    emit(ctx, "u");
+                    break;
+                case Primitive::Long:
+                    emit_int(ctx, *reinterpret_cast<int64_t*>(raw));
+                    emit(ctx, "ll");
+                    break;
+                case Primitive::ULong:
+                    emit_uint(ctx, *reinterpret_cast<uint64_t*>(raw));
+                    emit(ctx, "ull");
+                    break;
+                case Primitive::Float:
+                    emit(ctx, "%.9ef", *reinterpret_cast<float*>(raw));
+                    break;
+                case Primitive::Double:
+                    emit(ctx, "%.17e", *reinterpret_cast<double*>(raw));
+                    break;
+                default:
+                    SPARK_ASSERT(!!"Invalid Constant Datatype");
+            }
+        }
+
+        static void generateVectorNode(context& ctx, spark_node_t* vector)
+        {
+            SPARK_ASSERT(vector->_type == spark_nodetype::vector);
+            auto type = vector->_vector.type;
+            auto components = type.GetComponents();
+            SPARK_ASSERT(components >= Components::Vector2 && components <= Components::Vector16);
+
+            size_t components_table[] = {2, 4, 8, 16};
+            SPARK_ASSERT(vector->_children.size() == components_table[static_cast<uint32_t>(components - Components::Vector2)]);
+
+            generateCppType(ctx, type);
+            emit(ctx, "(");
+            for(size_t k = 0; k < vector->_children.size(); k++)
+            {
+                if(k > 0)
+                {
+                    emit(ctx, ", ");
+                }
+                generateValueNode(ctx, vector->_children[k]);
+            }
+            emit(ctx, ")");
+        }
+
+        static void generateValueNode(context& ctx, spark_node_t* value, bool lvalue)
+        {
+            switch(value->_type)
+            {
+                case spark_nodetype::operation:
+                    generateOperatorNode(ctx, value, lvalue);
+                    break;
+                case spark_nodetype::symbol:
+                    generateSymbolNode(ctx, value);
+                    break;
+                case spark_nodetype::constant:
+                    generateConstantNode(ctx, value);
+                    break;
+                case spark_nodetype::vector:
+                    generateVectorNode(ctx, value);
+                    break;
+                default:
+                    SPARK_ASSERT(value->_type == spark_nodetype::operation ||
+                                 value->_type == spark_nodetype::symbol ||
+                                 value->_type == spark_nodetype::constant ||
+                                 value->_type == spark_nodetype::vector);
+            }
+        }
+
+        static void generateControlNode(context& ctx, spark_node_t* control)
+        {
+            SPARK_ASSERT(control->_type == spark_nodetype::control);
+
+            switch(control->_control)
+            {
+                case Control::If:
+                    SPARK_ASSERT(control->_children.size() == 2);
+                    emit(ctx, "if (");
+                    generateValueNode(ctx, control->_children.front());
+                    emit(ctx, ")\n");
+                    generateIndent(ctx);
+                    generateScopeBlock(ctx, control->_children.back());
+                    break;
+                case Control::ElseIf:
+                    SPARK_ASSERT(control->_children.size() == 2);
+                    emit(ctx, "else if (");
+                    generateValueNode(ctx, control->_children.front());
+                    emit(ctx, ")\n");
+                    generateIndent(ctx);
+                    generateScopeBlock(ctx, control->_children.back());
+                    break;
+                case Control::Else:
+                    SPARK_ASSERT(control->_children.size() == 1);
+                    emit(ctx, "else\n");
+                    generateIndent(ctx);
+                    generateScopeBlock(ctx, control->_children.back());
+                    break;
+                case Control::While:
+                {
+                    SPARK_ASSERT(control->_children.size() == 2);
+                    emit(ctx, "while (");
+                    generateValueNode(ctx, control->_children.front());
+                    emit(ctx, ")\n");
+                    generateIndent(ctx);
+                    generateScopeBlock(ctx, control->_children.back());
+                    break;
+                }
+                case Control::For:
+                {
+                    // the loop variable is declared by the init assignment
+                    SPARK_ASSERT(control->_children.size() == 4);
+                    // a factor the optimizer couldn't apply is left to the compiler
+                    if(control->_unroll > 0)
+                    {
+                        emit(ctx, "#pragma GCC unroll %u\n", static_cast<uint32_t>(control->_unroll));
+                        generateIndent(ctx);
+                    }
+                    emit(ctx, "for (");
+                    generateValueNode(ctx, control->_children[0]);
+                    emit(ctx, "; ");
+                    generateValueNode(ctx, control->_children[1]);
+                    emit(ctx, "; ");
+                    generateValueNode(ctx, control->_children[2]);
+                    emit(ctx, ")\n");
+                    generateIndent(ctx);
+                    generateScopeBlock(ctx, control->_children.back());
+                    break;
+                }
+                default:
+                    SPARK_ASSERT(false);
+            }
+        }
+
+        static void generateScopeBlock(context& ctx, spark_node_t* scopeBlock)
+        {
+            SPARK_ASSERT(scopeBlock->_type == spark_nodetype::scope_block);
+
+            emit(ctx, "{\n");
+
+            ctx.indent += 1;
+            for(auto currentNode : scopeBlock->_children)
+            {
+                generateIndent(ctx);
+
+                switch(currentNode->_type)
+                {
+                    case spark_nodetype::control:
+                    {
+                        generateControlNode(ctx, currentNode);
+                        break;
+                    }
+                    case spark_nodetype::operation:
+                    case spark_nodetype::symbol:
+                    case spark_nodetype::constant:
+                    case spark_nodetype::vector:
+                        generateValueNode(ctx, currentNode);
+                        emit(ctx, ";\n");
+                        break;
+                    case spark_nodetype::comment:
+                        emit(ctx, "/* %s */\n", currentNode->_comment);
+                        break;
+                    case spark_nodetype::scope_block:
+                        generateScopeBlock(ctx, currentNode);
+                        break;
+                    default:
+                        emit(ctx, "#unimplemented\n");
+                        break;
+                }
+            }
+            ctx.indent -= 1;
+
+            generateIndent(ctx);
+            emit(ctx, "}\n");
+        }
+
+        static void generateFunction(context& ctx, spark_node_t* node)
+        {
+            SPARK_ASSERT(node->_type == spark_nodetype::function);
+            SPARK_ASSERT(node->_children.size() == 2);
+
+            // leave empty line between functions
+            emit(ctx, "\n");
+
+            // name and return type
+            emit(ctx, "static ");
+            generateCppType(ctx, node->_function.returnType);
+            emit(ctx, " ");
+            if(node->_function.entrypoint)
+            {
+                emit(ctx, "entry_point");
+            }
+            else
+            {
+                generateFunctionName(ctx, node->_function.id);
+            }
+
+            // print parameter list
+            emit(ctx, "(");
+            auto parameterList = node->_children.front();
+            SPARK_ASSERT(parameterList->_type == spark_nodetype::control && parameterList->_control == Control::ParameterList);
+
+            const auto paramCount = parameterList->_children.size();
+            for(size_t k = 0; k < paramCount; k++)
+            {
+                if(k > 0)
+                {
+                    emit(ctx, ", ");
+                }
+                auto currentChild = parameterList->_children[k];
+                SPARK_ASSERT(currentChild->_type == spark_nodetype::symbol);
+                // add to our set of init'd variables
+                ctx.inited_variables.insert(currentChild->_symbol.id);
+
+                generateCppType(ctx, currentChild->_symbol.type);
+                emit(ctx, " ");
+                generateSymbolName(ctx, currentChild->_symbol.id, currentChild->_symbol.type);
+            }
+            emit(ctx, ")\n");
+
+            // function contents
+            auto functionBody = node->_children.back();
+            generateScopeBlock(ctx, functionBody);
+        }
+
+        // exported entry the runtime invokes per chunk of work items; unpacks the
+        // argument slots and walks the flattened [begin, end) range of global ids
+        static void generateNativeEntry(context& ctx, spark_node_t* entry)
+        {
+            auto parameterList = entry->_children.front();
+            const auto paramCount = parameterList->_children.size();
+
+            emit(ctx, "\nextern \"C\" const uint32_t spark_native_argument_count = %u;\n", (uint32_t)paramCount);
+
+            emit(ctx, "\nextern \"C\" void spark_native_entry(void* const* args, const size_t* global_size, size_t begin, size_t end)\n");
+            emit(ctx, "{\n");
+            emit(ctx, "    spark_global_size[0] = global_size[0];\n");
+            emit(ctx, "    spark_global_size[1] = global_size[1];\n");
+            emit(ctx, "    spark_global_size[2] = global_size[2];\n");
+            emit(ctx, "    size_t x = begin % global_size[0];\n");
+            emit(ctx, "    size_t y = (begin / global_size[0]) % global_size[1];\n");
+            emit(ctx, "    size_t z = begin / (global_size[0] * global_size[1]);\n");
+            emit(ctx, "    for(size_t k = begin; k < end; k++)\n");
+            emit(ctx, "    {\n");
+            emit(ctx, "        spark_global_id[0] = x;\n");
+            emit(ctx, "        spark_global_id[1] = y;\n");
+            emit(ctx, "        spark_global_id[2] = z;\n");
+            emit(ctx, "        entry_point(");
+            for(size_t k = 0; k < paramCount; k++)
+            {
+                if(k > 0)
+                {
+                    emit(ctx, ", ");
+                }
+                auto currentChild = parameterList->_children[k];
+                emit(ctx, "*reinterpret_cast<");
+                generateCppType(ctx, currentChild->_symbol.type);
+                emit(ctx, "*>(args[");
+                emit_uint(ctx, k);
+                emit(ctx, "])");
+            }
+            emit(ctx, ");\n");
+            emit(ctx, "        if(++x == global_size[0])\n");
+            emit(ctx, "        {\n");
+            emit(ctx, "            x = 0;\n");
+            emit(ctx, "            if(++y == global_size[1])\n");
+            emit(ctx, "            {\n");
+            emit(ctx, "                y = 0;\n");
+            emit(ctx, "                ++z;\n");
+            emit(ctx, "            }\n");
+            emit(ctx, "        }\n");
+            emit(ctx, "    }\n");
+            emit(ctx, "}\n");
+        }
+
+        std::string generateCppSource(spark_node_t* node)
+        {
+            SPARK_ASSERT(node->_type == spark_nodetype::control && node->_control == Control::Root);
+
+            context ctx;
+
+            emit(ctx, "namespace spark_native\n{\n");
+
+            // generate all the functions
+            spark_node_t* entry = nullptr;
+            for(auto func : node->_children)
+            {
+                generateFunction(ctx, func);
+                if(func->_function.entrypoint)
+                {
+                    entry = func;
+                }
+            }
+            SPARK_ASSERT(entry != nullptr);
+
+            generateNativeEntry(ctx, entry);
+
+            emit(ctx, "}\n");
+
+            return ctx.out.release();
+        }
+
+        const char* getCppPrelude()
+        {
+            return cppPrelude;
+        }
+    }
+}
\ No newline at end of file
@@ -4,7 +4,9 @@ namespace spark
 {
     namespace lib
     {
-        int32_t generateOpenCLSource(spark_node_t* node, char* out_buffer, int32_t buffer_size);
-        int32_t generateSourceTree(spark_node_t* node, char* out_buffer, int32_t buffer_size);
+        std::string generateOpenCLSource(spark_node_t* node);
+        std::string generateSourceTree(spark_node_t* node);
+        std::string generateCppSource(spark_node_t* node);
+        const char* getCppPrelude();
     }
 }
\ No newline at end of file
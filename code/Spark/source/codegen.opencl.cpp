@@ -4,6 +4,7 @@
 #include "node.hpp"
 #include "error.hpp"
 #include "text_utilities.hpp"
+#include "analysis.hpp"
 
 using std::string;
 using std::unordered_set;
@@ -20,6 +21,8 @@ namespace spark
         {
             int32_t indent = 0;
             unordered_set<spark_symbolid_t> inited_variables;
+            // whether the entry point takes the full global size as spark_global_size
+            bool passes_global_size = false;
         };
 
         using context = codegen_context<opencl_data>;
@@ -61,12 +64,16 @@ namespace spark
 
             const char* pointer_str = pointer ? "p_" : "";
 
-            doSnprintf(ctx, "%s%s%s%u", pointer_str, components_str, primitive_str, (uint32_t)id);
+            emit_string(ctx, pointer_str);
+            emit_string(ctx, components_str);
+            emit_string(ctx, primitive_str);
+            emit_uint(ctx, id);
         }
 
         static void generateFunctionName(context& ctx, spark_symbolid_t id)
         {
-            doSnprintf(ctx, "func_%u", (uint32_t)id);
+            emit(ctx, "func_");
+            emit_uint(ctx, id);
         }
 
         static void generateOpenCLType(context& ctx, Datatype dt)
@@ -104,14 +111,17 @@ namespace spark
             const char* address_space_str = pointer ? "__global " : "";
             const char* pointer_str = pointer ? "*" : "";
 
-            doSnprintf(ctx, "%s%s%s%s", address_space_str, primitive_str, components_str, pointer_str);
+            emit_string(ctx, address_space_str);
+            emit_string(ctx, primitive_str);
+            emit_string(ctx, components_str);
+            emit_string(ctx, pointer_str);
         }
 
         static void generateIndent(context& ctx)
         {
             for(int32_t k = 0; k < ctx.indent; k++)
             {
-                doSnprintf(ctx, "    ");
+                emit(ctx, "    ");
             }
         }
 
@@ -123,14 +133,15 @@ namespace spark
 
             SPARK_ASSERT(funcParams == value->_children.size());
 
-            doSnprintf(ctx, "%s(", funcName);
+            emit_string(ctx, funcName);
+            emit(ctx, "(");
             generateValueNode(ctx, value->_children.front());
             for(size_t k = 1; k < funcParams; k++)
             {
-                doSnprintf(ctx, ", ");
+                emit(ctx, ", ");
                 generateValueNode(ctx, value->_children[k]);
             }
-            doSnprintf(ctx, ")");
+            emit(ctx, ")");
         }
 
         static void generateOperatorNode(context& ctx, spark_node_t* value)
@@ -142,7 +153,7 @@ namespace spark
             if(op == Operator::Break)
             {
                 SPARK_ASSERT(value->_children.size() == 0);
-                doSnprintf(ctx, "break");
+                emit(ctx, "break");
             }
             else if(op >= Operator::Negate && op <= Operator::Dereference)
             {
@@ -157,9 +168,10 @@ namespace spark
                     "~",
                     "*",
                 };
-                doSnprintf(ctx, "(%s", unary[static_cast<spark_operator_t>(op - Operator::Negate)]);
+                emit(ctx, "(");
+                emit_string(ctx, unary[static_cast<spark_operator_t>(op - Operator::Negate)]);
                 generateValueNode(ctx, value->_children.front());
-                doSnprintf(ctx, ")");
+                emit(ctx, ")");
             }
             else if(op >= Operator::PostfixIncrement && op <= Operator::PostfixIncrement)
             {
@@ -169,9 +181,10 @@ namespace spark
                     "++",
                     "--",
                 };
-                doSnprintf(ctx, "(");
+                emit(ctx, "(");
                 generateValueNode(ctx, value->_children.front());
-                doSnprintf(ctx, "%s)", unary[static_cast<spark_operator_t>(op - Operator::PostfixIncrement)]);
+                emit_string(ctx, unary[static_cast<spark_operator_t>(op - Operator::PostfixIncrement)]);
+                emit(ctx, ")");
             }
             else if(op >= Operator::Add && op <= Operator::LeftShift)
             {
@@ -197,11 +210,13 @@ namespace spark
                     ">>",
                     "<<",
                 };
-                doSnprintf(ctx, "(");
+                emit(ctx, "(");
                 generateValueNode(ctx, value->_children.front());
-                doSnprintf(ctx, " %s ", binary[static_cast<spark_operator_t>(op - Operator::Add)]);
+                emit(ctx, " ");
+                emit_string(ctx, binary[static_cast<spark_operator_t>(op - Operator::Add)]);
+                emit(ctx, " ");
                 generateValueNode(ctx, value->_children.back());
-                doSnprintf(ctx, ")");
+                emit(ctx, ")");
             }
             else if(op == Operator::Assignment)
             {
@@ -214,12 +229,12 @@ namespace spark
                         ctx.inited_variables.insert(id);
                         const auto type = value->_children.front()->_symbol.type;
                         generateOpenCLType(ctx, type);
-                        doSnprintf(ctx, " ");
+                        emit(ctx, " ");
                     }
                 }
 
                 generateValueNode(ctx, value->_children.front());
-                doSnprintf(ctx, " = ");
+                emit(ctx, " = ");
                 generateValueNode(ctx, value->_children.back());
             }
             else if(op == Operator::Call)
@@ -227,17 +242,17 @@ namespace spark
                 SPARK_ASSERT(value->_children.size() >= 1);
                 SPARK_ASSERT(value->_children.front()->_type == spark_nodetype::function);
                 generateFunctionName(ctx, value->_children.front()->_function.id);
-                doSnprintf(ctx, "(");
+                emit(ctx, "(");
                 for(size_t k = 1; k < value->_children.size(); k++)
                 {
                     auto* currentChild = value->_children[k];
                     if(k > 1)
                     {
-                       doSnprintf(ctx, ", ");
+                       emit(ctx, ", ");
                     }
                     generateValueNode(ctx, currentChild);
                 }
-                doSnprintf(ctx, ")");
+                emit(ctx, ")");
             }
             else if(op == Operator::Property)
             {
@@ -247,40 +262,49 @@ namespace spark
                 SPARK_ASSERT(value->_children.back()->_type == spark_nodetype::property);
                 char property[5];
                 spark_property_to_str(static_cast<spark_property_t>(value->_children.back()->_property.id), property, ruff::countof(property));
-                doSnprintf(ctx, ".%s", property);
+                emit(ctx, ".");
+                emit_string(ctx, property);
             }
             else if(op == Operator::Return)
             {
                 if(value->_children.size() == 0)
                 {
                     SPARK_ASSERT(value->_operator.type.GetPrimitive() == Primitive::Void);
-                    doSnprintf(ctx, "return");
+                    emit(ctx, "return");
                 }
                 else
                 {
                     SPARK_ASSERT(value->_children.size() == 1);
-                    doSnprintf(ctx, "return ");
+                    emit(ctx, "return ");
                     generateValueNode(ctx, value->_children.front());
                 }
             }
             else if(op == Operator::Cast)
             {
                 SPARK_ASSERT(value->_children.size() == 1);
-                doSnprintf(ctx, "(");
+                emit(ctx, "(");
                 generateOpenCLType(ctx, value->_operator.type);
-                doSnprintf(ctx, ")");
+                emit(ctx, ")");
 
                 generateValueNode(ctx, value->_children.front());
             }
             else if(op == Operator::Index)
             {
                 SPARK_ASSERT(value->_children.size() == 0);
-                doSnprintf(ctx, "(int2)(get_global_id(0), get_global_id(1))");
+                emit(ctx, "(int2)(get_global_id(0), get_global_id(1))");
             }
             else if(op == Operator::NormalizedIndex)
             {
                 SPARK_ASSERT(value->_children.size() == 0);
-                doSnprintf(ctx, "(float2)((float)get_global_id(0)/(float)(get_global_size(0) - 1), (float)get_global_id(1)/(float)(get_global_size(1) - 1))");
+                // a split launch's partitions only see their own size through get_global_size
+                if(ctx.passes_global_size)
+                {
+                    emit(ctx, "(float2)((float)get_global_id(0)/(float)(spark_global_size.x - 1), (float)get_global_id(1)/(float)(spark_global_size.y - 1))");
+                }
+                else
+                {
+                    emit(ctx, "(float2)((float)get_global_id(0)/(float)(get_global_size(0) - 1), (float)get_global_id(1)/(float)(get_global_size(1) - 1))");
+                }
             }
             else if(op >= Operator::ArcCos && op <= Operator::Sign)
             {
@@ -366,34 +390,38 @@ namespace spark
             switch(constant->_constant.type.GetPrimitive())
             {
                 case Primitive::Char:
-                    doSnprintf(ctx, "%i", *reinterpret_cast<int8_t*>(raw));
+                    emit_int(ctx, *reinterpret_cast<int8_t*>(raw));
                     break;
                 case Primitive::UChar:
-                    doSnprintf(ctx, "%uu", *reinterpret_cast<uint8_t*>(raw));
+                    emit_uint(ctx, *reinterpret_cast<uint8_t*>(raw));
+                    emit(ctx, "u");
                     break;
                 case Primitive::Short:
-                    doSnprintf(ctx, "%i", *reinterpret_cast<int16_t*>(raw));
+                    emit_int(ctx, *reinterpret_cast<int16_t*>(raw));
                     break;
                 case Primitive::UShort:
-                    doSnprintf(ctx, "%uu", *reinterpret_cast<uint16_t*>(raw));
+                    emit_uint(ctx, *reinterpret_cast<uint16_t*>(raw));
+                    emit(ctx, "u");
                     break;
                 case Primitive::Int:
-                    doSnprintf(ctx, "%i", *reinterpret_cast<int32_t*>(raw));
+                    emit_int(ctx, *reinterpret_cast<int32_t*>(raw));
                     break;
                 case Primitive::UInt:
-                    doSnprintf(ctx, "%uu", *reinterpret_cast<uint32_t*>(raw));
+                    emit_uint(ctx, *reinterpret_cast<uint32_t*>(raw));
+                    emit(ctx, "u");
                     break;
                 case Primitive::Long:
-                    doSnprintf(ctx, "%lli", *reinterpret_cast<int64_t*>(raw));
+                    emit_int(ctx, *reinterpret_cast<int64_t*>(raw));
                     break;
                 case Primitive::ULong:
-                    doSnprintf(ctx, "%lluu", *reinterpret_cast<uint64_t*>(raw));
+                    emit_uint(ctx, *reinterpret_cast<uint64_t*>(raw));
+                    emit(ctx, "u");
                     break;
                 case Primitive::Float:
-                    doSnprintf(ctx, "%.9ef", *reinterpret_cast<float*>(raw));
+                    emit(ctx, "%.9ef", *reinterpret_cast<float*>(raw));
                     break;
                 case Primitive::Double:
-                    doSnprintf(ctx, "%.17e", *reinterpret_cast<double*>(raw));
+                    emit(ctx, "%.17e", *reinterpret_cast<double*>(raw));
                     break;
                 default:
                     SPARK_ASSERT(!!"Invalid Constant Datatype");
@@ -410,18 +438,18 @@ namespace spark
             size_t components_table[] = {2, 4, 8, 16};
             SPARK_ASSERT(vector->_children.size() == components_table[static_cast<uint32_t>(components - Components::Vector2)]);
 
-            doSnprintf(ctx, "(");
+            emit(ctx, "(");
             generateOpenCLType(ctx, type);
-            doSnprintf(ctx, ")(");
+            emit(ctx, ")(");
             for(size_t k = 0; k < vector->_children.size(); k++)
             {
                 if(k > 0)
                 {
-                    doSnprintf(ctx, ", ");
+                    emit(ctx, ", ");
                 }
                 generateValueNode(ctx, vector->_children[k]);
             }
-            doSnprintf(ctx, ")");
+            emit(ctx, ")");
         }
 
         static void generateValueNode(context& ctx, spark_node_t* value)
@@ -456,32 +484,53 @@ namespace spark
             {
                 case Control::If:
                     SPARK_ASSERT(control->_children.size() == 2);
-                    doSnprintf(ctx, "if (");
+                    emit(ctx, "if (");
                     generateValueNode(ctx, control->_children.front());
-                    doSnprintf(ctx, ")\n");
+                    emit(ctx, ")\n");
                     generateIndent(ctx);
                     generateScopeBlock(ctx, control->_children.back());
                     break;
                 case Control::ElseIf:
                     SPARK_ASSERT(control->_children.size() == 2);
-                    doSnprintf(ctx, "else if (");
+                    emit(ctx, "else if (");
                     generateValueNode(ctx, control->_children.front());
-                    doSnprintf(ctx, ")\n");
+                    emit(ctx, ")\n");
                     generateIndent(ctx);
                     generateScopeBlock(ctx, control->_children.back());
                     break;
                 case Control::Else:
                     SPARK_ASSERT(control->_children.size() == 1);
-                    doSnprintf(ctx, "else\n");
+                    emit(ctx, "else\n");
                     generateIndent(ctx);
                     generateScopeBlock(ctx, control->_children.back());
                     break;
                 case Control::While:
                 {
                     SPARK_ASSERT(control->_children.size() == 2);
-                    doSnprintf(ctx, "while (");
+                    emit(ctx, "while (");
                     generateValueNode(ctx, control->_children.front());
-                    doSnprintf(ctx, ")\n");
+                    emit(ctx, ")\n");
+                    generateIndent(ctx);
+                    generateScopeBlock(ctx, control->_children.back());
+                    break;
+                }
+                case Control::For:
+                {
+                    // the loop variable is declared by the init assignment
+                    SPARK_ASSERT(control->_children.size() == 4);
+                    // a factor the optimizer couldn't apply is left to the compiler
+                    if(control->_unroll > 0)
+                    {
+                        emit(ctx, "#pragma unroll %u\n", static_cast<uint32_t>(control->_unroll));
+                        generateIndent(ctx);
+                    }
+                    emit(ctx, "for (");
+                    generateValueNode(ctx, control->_children[0]);
+                    emit(ctx, "; ");
+                    generateValueNode(ctx, control->_children[1]);
+                    emit(ctx, "; ");
+                    generateValueNode(ctx, control->_children[2]);
+                    emit(ctx, ")\n");
                     generateIndent(ctx);
                     generateScopeBlock(ctx, control->_children.back());
                     break;
@@ -495,7 +544,7 @@ namespace spark
         {
             SPARK_ASSERT(scopeBlock->_type == spark_nodetype::scope_block);
 
-            doSnprintf(ctx, "{\n");
+            emit(ctx, "{\n");
 
             ctx.indent += 1;
             for(auto currentNode : scopeBlock->_children)
@@ -514,23 +563,23 @@ namespace spark
                     case spark_nodetype::constant:
                     case spark_nodetype::vector:
                         generateValueNode(ctx, currentNode);
-                        doSnprintf(ctx, ";\n");
+                        emit(ctx, ";\n");
                         break;
                     case spark_nodetype::comment:
-                        doSnprintf(ctx, "/* %s */\n", currentNode->_comment);
+                        emit(ctx, "/* %s */\n", currentNode->_comment);
                         break;
                     case spark_nodetype::scope_block:
                         generateScopeBlock(ctx, currentNode);
                         break;
                     default:
-                        doSnprintf(ctx, "#unimplemented\n");
+                        emit(ctx, "#unimplemented\n");
                         break;
                 }
             }
             ctx.indent -= 1;
 
             generateIndent(ctx);
-            doSnprintf(ctx, "}\n");
+            emit(ctx, "}\n");
         }
 
         static void generateFunction(context& ctx, spark_node_t* node)
@@ -539,24 +588,24 @@ namespace spark
             SPARK_ASSERT(node->_children.size() == 2);
 
             // leave empty line between functions
-            doSnprintf(ctx, "\n");
+            emit(ctx, "\n");
 
             // name and return type
             if(node->_function.entrypoint)
             {
-                doSnprintf(ctx, "__kernel ");
+                emit(ctx, "__kernel ");
                 generateOpenCLType(ctx, node->_function.returnType);
-                doSnprintf(ctx, " entry_point");
+                emit(ctx, " entry_point");
             }
             else
             {
                 generateOpenCLType(ctx, node->_function.returnType);
-                doSnprintf(ctx, " ");
+                emit(ctx, " ");
                 generateFunctionName(ctx, node->_function.id);
             }
 
             // print parameter list
-            doSnprintf(ctx, "(");
+            emit(ctx, "(");
             auto parameterList = node->_children.front();
             SPARK_ASSERT(parameterList->_type == spark_nodetype::control && parameterList->_control == Control::ParameterList);
 
@@ -565,7 +614,7 @@ namespace spark
             {
                 if(k > 0)
                 {
-                    doSnprintf(ctx, ", ");
+                    emit(ctx, ", ");
                 }
                 auto currentChild = parameterList->_children[k];
                 SPARK_ASSERT(currentChild->_type == spark_nodetype::symbol);
@@ -573,25 +622,32 @@ namespace spark
                 ctx.inited_variables.insert(currentChild->_symbol.id);
 
                 generateOpenCLType(ctx, currentChild->_symbol.type);
-                doSnprintf(ctx, " ");
+                emit(ctx, " ");
                 generateSymbolName(ctx, currentChild->_symbol.id, currentChild->_symbol.type);
             }
-            doSnprintf(ctx, ")\n");
 
-            // function contents
+            // extra last argument the runtime sets to the launch's global size
             auto functionBody = node->_children.back();
+            ctx.passes_global_size = node->_function.entrypoint && readsGlobalSize(functionBody);
+            if(ctx.passes_global_size)
+            {
+                if(paramCount > 0)
+                {
+                    emit(ctx, ", ");
+                }
+                emit(ctx, "const uint2 spark_global_size");
+            }
+            emit(ctx, ")\n");
+
+            // function contents
             generateScopeBlock(ctx, functionBody);
         }
 
-        int32_t generateOpenCLSource(spark_node_t* node, char* out_buffer, int32_t buffer_size)
+        std::string generateOpenCLSource(spark_node_t* node)
         {
             SPARK_ASSERT(node->_type == spark_nodetype::control && node->_control == Control::Root);
 
             context ctx;
-            {
-                ctx.buffer = out_buffer;
-                ctx.capacity = buffer_size;
-            }
 
             // generate all the functions
             for(auto func : node->_children)
@@ -599,8 +655,7 @@ namespace spark
                 generateFunction(ctx, func);
             }
 
-            // +1 for null terminator
-            return ctx.written + 1;
+            return ctx.out.release();
         }
     }
 }
@@ -611,6 +666,6 @@ RUFF_EXPORT int32_t spark_node_to_opencl(spark_node_t* node, char* out_buffer, i
         error,
         [&]
         {
-            return generateOpenCLSource(node, out_buffer, buffer_size);
+            return copy_to_buffer(generateOpenCLSource(node), out_buffer, buffer_size);
         });
 }
\ No newline at end of file
@@ -15,49 +15,49 @@ namespace spark
 {
     namespace lib
     {
-        int32_t controlNodeToText(spark_node_t* node, char* buffer, int32_t buffer_size, int32_t written)
+        void controlNodeToText(spark_node_t* node, string_builder& out)
         {
-            return doSnprintf(buffer, buffer_size, written,
+            out.append_format(
                 "%s\n",
                 spark_control_to_str(static_cast<spark_control_t>(node->_control)));
         }
 
-        int32_t operatorNodeToText(spark_node_t* node, char* buffer, int32_t buffer_size, int32_t written)
+        void operatorNodeToText(spark_node_t* node, string_builder& out)
         {
             const auto dt = static_cast<spark_datatype_t>(node->_operator.type);
             const auto op = static_cast<spark_operator_t>(node->_operator.id);
 
             char datatypeBuffer[32];
-            return doSnprintf(buffer, buffer_size, written,
+            out.append_format(
                 "%s : %s\n",
                 spark_operator_to_str(op),
                 spark_datatype_to_str(dt, datatypeBuffer, sizeof(datatypeBuffer)));
         }
 
-        int32_t functionNodeToText(spark_node_t* node, char* buffer, int32_t buffer_size, int32_t written)
+        void functionNodeToText(spark_node_t* node, string_builder& out)
         {
             const auto dt = static_cast<spark_datatype_t>(node->_function.returnType);
 
             char datatypeBuffer[32];
-            return doSnprintf(buffer, buffer_size, written,
+            out.append_format(
                 "0x%x : function -> %s %s\n",
                 (uint32_t)node->_function.id,
                 spark_datatype_to_str(dt, datatypeBuffer, sizeof(datatypeBuffer)),
                 node->_function.entrypoint ? "(entrypoint)" : "");
         }
 
-        int32_t symbolNodeToText(spark_node_t* node, char* buffer, int32_t buffer_size, int32_t written)
+        void symbolNodeToText(spark_node_t* node, string_builder& out)
         {
             const auto dt = static_cast<spark_datatype_t>(node->_symbol.type);
 
             char datatypeBuffer[32];
-            return doSnprintf(buffer, buffer_size, written,
+            out.append_format(
                 "0x%x : %s\n",
                 (uint32_t)node->_symbol.id,
                 spark_datatype_to_str(dt, datatypeBuffer, sizeof(datatypeBuffer)));
         }
 
-        int32_t constantNodeToText(spark_node_t* node, char* buffer, int32_t buffer_size, int32_t written)
+        void constantNodeToText(spark_node_t* node, string_builder& out)
         {
             const auto dt = node->_constant.type;
             const auto primitive = dt.GetPrimitive();
@@ -100,7 +100,7 @@ namespace spark
             {
                 if(k > 0)
                 {
-                    written = doSnprintf(buffer, buffer_size, written, ", ");
+                    out.append(", ");
                 }
 
                 union
@@ -152,17 +152,17 @@ namespace spark
                     case Primitive::Short:
                     case Primitive::Int:
                     case Primitive::Long:
-                        written = doSnprintf(buffer, buffer_size, written, "%lli", signed_integer);
+                        out.append_int(signed_integer);
                         break;
                     case Primitive::UChar:
                     case Primitive::UShort:
                     case Primitive::UInt:
                     case Primitive::ULong:
-                        written = doSnprintf(buffer, buffer_size, written, "%llu", unsigned_integer);
+                        out.append_uint(unsigned_integer);
                         break;
                     case Primitive::Float:
                     case Primitive::Double:
-                        written = doSnprintf(buffer, buffer_size, written, "%f", floating_point);
+                        out.append_format("%f", floating_point);
                         break;
                     default:
                         SPARK_ASSERT(false);
@@ -170,44 +170,38 @@ namespace spark
             }
 
             char datatypeBuffer[32];
-            written = doSnprintf(buffer, buffer_size, written,
+            out.append_format(
                 " : %s\n",
                 spark_datatype_to_str(static_cast<spark_datatype_t>(dt), datatypeBuffer, sizeof(datatypeBuffer)));
-
-            return written;
         }
 
-        int32_t propertyNodeToText(spark_node_t* node, char* buffer, int32_t buffer_size, int32_t written)
+        void propertyNodeToText(spark_node_t* node, string_builder& out)
         {
             const auto prop = static_cast<spark_property_t>(node->_property.id);
 
             char propertyBuffer[8];
-            written = doSnprintf(buffer, buffer_size, written,
+            out.append_format(
                 "Property::%s\n",
                 spark_property_to_str(prop, propertyBuffer, ruff::countof(propertyBuffer)));
-            return written;
         }
 
-        int32_t commentNodeToText(spark_node_t* node, char* buffer, int32_t buffer_size, int32_t written)
+        void commentNodeToText(spark_node_t* node, string_builder& out)
         {
-            written = doSnprintf(buffer, buffer_size, written, "NodeType::Comment : '%s'\n", node->_comment);
-            return written;
+            out.append_format("NodeType::Comment : '%s'\n", node->_comment);
         }
 
-        int32_t vectorNodeToText(spark_node_t* node, char* buffer, int32_t buffer_size, int32_t written)
+        void vectorNodeToText(spark_node_t* node, string_builder& out)
         {
             const auto dt = static_cast<spark_datatype_t>(node->_vector.type);
 
             char datatypeBuffer[32];
-            written = doSnprintf(buffer, buffer_size, written, "NodeType::Vector : '%s'\n", spark_datatype_to_str(dt, datatypeBuffer, sizeof(datatypeBuffer)));
-            return written;
+            out.append_format("NodeType::Vector : '%s'\n", spark_datatype_to_str(dt, datatypeBuffer, sizeof(datatypeBuffer)));
         }
 
         // if out_bufer is null
-        int32_t nodeToText(spark_node_t* node, char* out_buffer, int32_t buffer_size, int32_t written, uint32_t bars, int32_t indentation)
+        void nodeToText(spark_node_t* node, string_builder& out, uint32_t bars, int32_t indentation)
         {
             SPARK_ASSERT(node != nullptr);
-            SPARK_ASSERT((out_buffer == nullptr && buffer_size == 0) || (out_buffer != nullptr && buffer_size > 0));
 
             // write graph lines
             for(int32_t k = 0; k < indentation; k++)
@@ -231,7 +225,7 @@ namespace spark
                 {
                     str = "│ ";
                 }
-                written = doSnprintf(out_buffer, buffer_size, written, "%s", str);
+                out.append_string(str);
             }
 
             // write node info
@@ -239,31 +233,31 @@ namespace spark
             switch(nodeType)
             {
                 case spark_nodetype::control:
-                    written = controlNodeToText(node, out_buffer, buffer_size, written);
+                    controlNodeToText(node, out);
                     break;
                 case spark_nodetype::operation:
-                    written = operatorNodeToText(node, out_buffer, buffer_size, written);
+                    operatorNodeToText(node, out);
                     break;
                 case spark_nodetype::function:
-                    written = functionNodeToText(node, out_buffer, buffer_size, written);
+                    functionNodeToText(node, out);
                     break;
                 case spark_nodetype::symbol:
-                    written = symbolNodeToText(node, out_buffer, buffer_size, written);
+                    symbolNodeToText(node, out);
                     break;
                 case spark_nodetype::constant:
-                    written = constantNodeToText(node, out_buffer, buffer_size, written);
+                    constantNodeToText(node, out);
                     break;
                 case spark_nodetype::property:
-                    written = propertyNodeToText(node, out_buffer, buffer_size, written);
+                    propertyNodeToText(node, out);
                     break;
                 case spark_nodetype::comment:
-                    written = commentNodeToText(node, out_buffer, buffer_size, written);
+                    commentNodeToText(node, out);
                     break;
                 case spark_nodetype::vector:
-                    written = vectorNodeToText(node, out_buffer, buffer_size, written);
+                    vectorNodeToText(node, out);
                     break;
                 default:
-                    written = doSnprintf(out_buffer, buffer_size, written, "%s\n", spark_nodetype_to_str(node->_type));
+                    out.append_format("%s\n", spark_nodetype_to_str(node->_type));
                     break;
             }
 
@@ -288,17 +282,17 @@ namespace spark
                         bars;
                     const int32_t childIndentation = indentation + 1;
 
-                    written = nodeToText(child, out_buffer, buffer_size, written, childBars, childIndentation);
+                    nodeToText(child, out, childBars, childIndentation);
                 }
             }
 
-            // return characters written
-            return written;
         }
 
-        int32_t generateSourceTree(spark_node_t* node, char* out_buffer, int32_t buffer_size)
+        std::string generateSourceTree(spark_node_t* node)
         {
-            return nodeToText(node, out_buffer, buffer_size, 0, 0, 0) + 1;
+            string_builder out;
+            nodeToText(node, out, 0, 0);
+            return out.release();
         }
     }
 }
@@ -309,6 +303,6 @@ RUFF_EXPORT int32_t spark_node_to_text(spark_node_t* node, char* out_buffer, int
         error,
         [&]
         {
-            return generateSourceTree(node, out_buffer, buffer_size);
+            return copy_to_buffer(generateSourceTree(node), out_buffer, buffer_size);
         });
 }
\ No newline at end of file
@@ -0,0 +1,119 @@
+#include "spark.hpp"
+
+#include "log.hpp"
+#include "error.hpp"
+
+using spark::shared::LogLevel;
+
+namespace spark
+{
+    namespace lib
+    {
+        namespace log
+        {
+            static const char* levelNames[] =
+            {
+                "trace",
+                "debug",
+                "info",
+                "warning",
+                "error",
+                "none",
+            };
+            static_assert(ruff::countof(levelNames) == static_cast<size_t>(LogLevel::Count), "size mismatch between levelNames and LogLevel::Count");
+
+            static LogLevel getDefaultLevel()
+            {
+                if(const char* level = ::getenv("SPARK_LOG_LEVEL"))
+                {
+                    for(size_t k = 0; k < ruff::countof(levelNames); k++)
+                    {
+                        if(::strcmp(level, levelNames[k]) == 0)
+                        {
+                            return static_cast<LogLevel>(k);
+                        }
+                    }
+                }
+                return LogLevel::Warning;
+            }
+
+            static std::atomic<spark_log_level_t> g_level(static_cast<spark_log_level_t>(getDefaultLevel()));
+
+            // sink is swapped rarely and read on every emitted message
+            static std::mutex g_sinkMutex;
+            static spark_log_callback_t g_callback = nullptr;
+            static void* g_userData = nullptr;
+
+            bool enabled(LogLevel level)
+            {
+                return static_cast<spark_log_level_t>(level) >= g_level.load(std::memory_order_relaxed);
+            }
+
+            void set_level(LogLevel level)
+            {
+                g_level.store(static_cast<spark_log_level_t>(level));
+            }
+
+            void set_callback(spark_log_callback_t callback, void* user_data)
+            {
+                std::lock_guard<std::mutex> lock(g_sinkMutex);
+                g_callback = callback;
+                g_userData = user_data;
+            }
+
+            void write(LogLevel level, const char* format, ...)
+            {
+                va_list args;
+                va_start(args, format);
+                va_list argsCopy;
+                va_copy(argsCopy, args);
+                const int length = ::vsnprintf(nullptr, 0, format, args);
+                va_end(args);
+
+                std::string message(std::max(length, 0), 0);
+                ::vsnprintf(const_cast<char*>(message.data()), message.size() + 1, format, argsCopy);
+                va_end(argsCopy);
+
+                spark_log_callback_t callback;
+                void* userData;
+                {
+                    std::lock_guard<std::mutex> lock(g_sinkMutex);
+                    callback = g_callback;
+                    userData = g_userData;
+                }
+
+                // called unlocked so a callback may log or swap the sink itself
+                if(callback != nullptr)
+                {
+                    callback(static_cast<spark_log_level_t>(level), message.c_str(), userData);
+                }
+                else
+                {
+                    ::fprintf(stderr, "spark %s: %s\n", levelNames[static_cast<size_t>(level)], message.c_str());
+                }
+            }
+        }
+    }
+}
+
+RUFF_EXPORT void spark_set_log_level(spark_log_level_t level, spark_error_t** error)
+{
+    return TranslateExceptions(
+        error,
+        [&]
+        {
+            THROW_IF_FALSE(level < static_cast<spark_log_level_t>(LogLevel::Count));
+
+            spark::lib::log::set_level(static_cast<LogLevel>(level));
+        });
+}
+
+RUFF_EXPORT void spark_set_log_callback(spark_log_callback_t callback, void* user_data, spark_error_t** error)
+{
+    return TranslateExceptions(
+        error,
+        [&]
+        {
+            spark::lib::log::set_callback(callback, user_data);
+        });
+}
\ No newline at end of file
@@ -0,0 +1,37 @@
+#pragma once
+
+// formats and emits a message only when LEVEL is enabled, so disabled messages cost a load and a compare
+#define LOG_MESSAGE(LEVEL, ...)\
+    do\
+    {\
+        if(spark::lib::log::enabled(LEVEL))\
+        {\
+            spark::lib::log::write(LEVEL, __VA_ARGS__);\
+        }\
+    }\
+    while(0)
+
+#define LOG_TRACE(...) LOG_MESSAGE(spark::shared::LogLevel::Trace, __VA_ARGS__)
+#define LOG_DEBUG(...) LOG_MESSAGE(spark::shared::LogLevel::Debug, __VA_ARGS__)
+#define LOG_INFO(...) LOG_MESSAGE(spark::shared::LogLevel::Info, __VA_ARGS__)
+#define LOG_WARNING(...) LOG_MESSAGE(spark::shared::LogLevel::Warning, __VA_ARGS__)
+#define LOG_ERROR(...) LOG_MESSAGE(spark::shared::LogLevel::Error, __VA_ARGS__)
+
+namespace spark
+{
+    namespace lib
+    {
+        // messages go to the callback set with spark_set_log_callback, or stderr by default
+        // the level defaults to warning and is overridden by SPARK_LOG_LEVEL
+        // (trace, debug, info, warning, error or none)
+        namespace log
+        {
+            bool enabled(spark::shared::LogLevel level);
+            void set_level(spark::shared::LogLevel level);
+            // null restores the stderr sink
+            void set_callback(spark_log_callback_t callback, void* user_data);
+
+            void write(spark::shared::LogLevel level, const char* format, ...) __attribute__((format(printf, 2, 3)));
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,151 @@
+#include "spark.hpp"
+
+#include "memory_pool.hpp"
+
+namespace spark
+{
+    namespace lib
+    {
+        // smallest size class handed out
+        static const size_t minimumCapacity = 256;
+        // size classes between consecutive powers of two, bounds the padding to a quarter of the request
+        static const size_t classesPerDoubling = 4;
+        // default cap on memory held in the free lists, overridden with SPARK_POOL_LIMIT (bytes)
+        static const uint64_t defaultLimit = 256ull * 1024ull * 1024ull;
+
+        memory_pool::memory_pool()
+        : _limit(defaultLimit)
+        {
+            const char* limit = ::getenv("SPARK_POOL_LIMIT");
+            if(limit != nullptr && *limit != 0)
+            {
+                this->_limit = ::strtoull(limit, nullptr, 10);
+            }
+        }
+
+        memory_pool::~memory_pool()
+        {
+            for(auto& entry : this->_mems)
+            {
+                for(auto mem : entry.second)
+                {
+                    ::clReleaseMemObject(mem);
+                }
+            }
+            for(auto& entry : this->_hosts)
+            {
+                for(auto host : entry.second)
+                {
+                    delete[] host;
+                }
+            }
+        }
+
+        size_t memory_pool::size_class(size_t bytes)
+        {
+            if(bytes <= minimumCapacity)
+            {
+                return minimumCapacity;
+            }
+
+            // evenly spaced steps between the powers of two either side of bytes
+            size_t upper = minimumCapacity;
+            while(upper < bytes)
+            {
+                upper <<= 1;
+            }
+            const size_t lower = upper >> 1;
+            const size_t step = lower / classesPerDoubling;
+            return lower + (bytes - lower + step - 1) / step * step;
+        }
+
+        cl_mem memory_pool::acquire_mem(size_t capacity)
+        {
+            std::lock_guard<std::mutex> lock(this->_mutex);
+            auto& freeList = this->_mems[capacity];
+            if(freeList.empty())
+            {
+                this->_misses++;
+                return nullptr;
+            }
+
+            cl_mem mem = freeList.back();
+            freeList.pop_back();
+            this->_cached_bytes -= capacity;
+            this->_hits++;
+            return mem;
+        }
+
+        uint8_t* memory_pool::acquire_host(size_t capacity)
+        {
+            std::lock_guard<std::mutex> lock(this->_mutex);
+            auto& freeList = this->_hosts[capacity];
+            if(freeList.empty())
+            {
+                this->_misses++;
+                return nullptr;
+            }
+
+            uint8_t* host = freeList.back();
+            freeList.pop_back();
+            this->_cached_bytes -= capacity;
+            this->_hits++;
+            return host;
+        }
+
+        void memory_pool::release_mem(size_t capacity, cl_mem mem)
+        {
+            {
+                std::lock_guard<std::mutex> lock(this->_mutex);
+                if(this->try_cache(capacity))
+                {
+                    this->_mems[capacity].push_back(mem);
+                    return;
+                }
+            }
+            ::clReleaseMemObject(mem);
+        }
+
+        void memory_pool::release_host(size_t capacity, uint8_t* host)
+        {
+            {
+                std::lock_guard<std::mutex> lock(this->_mutex);
+                if(this->try_cache(capacity))
+                {
+                    this->_hosts[capacity].push_back(host);
+                    return;
+                }
+            }
+            delete[] host;
+        }
+
+        // caller holds _mutex
+        bool memory_pool::try_cache(size_t capacity)
+        {
+            if(this->_cached_bytes + capacity > this->_limit)
+            {
+                return false;
+            }
+            this->_cached_bytes += capacity;
+            return true;
+        }
+
+        uint64_t memory_pool::hits() const
+        {
+            std::lock_guard<std::mutex> lock(this->_mutex);
+            return this->_hits;
+        }
+
+        uint64_t memory_pool::misses() const
+        {
+            std::lock_guard<std::mutex> lock(this->_mutex);
+            return this->_misses;
+        }
+
+        uint64_t memory_pool::cached_bytes() const
+        {
+            std::lock_guard<std::mutex> lock(this->_mutex);
+            return this->_cached_bytes;
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,46 @@
+#pragma once
+
+namespace spark
+{
+    namespace lib
+    {
+        // per-context free lists of released buffer allocations bucketed by size class,
+        // so steady-state buffer creation never reaches the driver
+        class memory_pool
+        {
+        public:
+            memory_pool();
+            ~memory_pool();
+
+            memory_pool(const memory_pool&) = delete;
+            memory_pool& operator=(const memory_pool&) = delete;
+
+            // allocation size actually used for a request of bytes
+            static size_t size_class(size_t bytes);
+
+            // a previously released allocation of exactly capacity bytes, or null on a miss
+            cl_mem acquire_mem(size_t capacity);
+            uint8_t* acquire_host(size_t capacity);
+
+            // takes ownership; frees immediately once the pool is holding its limit
+            void release_mem(size_t capacity, cl_mem mem);
+            void release_host(size_t capacity, uint8_t* host);
+
+            uint64_t hits() const;
+            uint64_t misses() const;
+            // bytes sitting in the free lists
+            uint64_t cached_bytes() const;
+
+        private:
+            bool try_cache(size_t capacity);
+
+            mutable std::mutex _mutex;
+            std::unordered_map<size_t, std::vector<cl_mem>> _mems;
+            std::unordered_map<size_t, std::vector<uint8_t*>> _hosts;
+            uint64_t _limit;
+            uint64_t _cached_bytes = 0;
+            uint64_t _hits = 0;
+            uint64_t _misses = 0;
+        };
+    }
+}
\ No newline at end of file
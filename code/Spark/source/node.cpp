@@ -4,6 +4,7 @@
 #include "node.hpp"
 #include "error.hpp"
 #include "text_utilities.hpp"
+#include "trace.hpp"
 
 namespace spark
 {
@@ -11,15 +12,137 @@ namespace spark
     {
         thread_local spark_symbolid_t g_nextSymbol;
         thread_local std::vector<spark_node_t*> g_nodeStack;
-        thread_local std::vector<spark_node_t*> g_allocatedNodes;
+        // start of the current program's ast construction, 0 when not tracing
+        thread_local uint64_t g_programStart;
 
-        spark_node::~spark_node()
+        node_arena::~node_arena()
         {
-            if(this->_type == spark_nodetype::constant)
+            for(auto& b : _blocks)
             {
-                delete[] this->_constant.buffer;
+                delete[] b.data;
             }
         }
+
+        void* node_arena::allocate(size_t bytes, size_t alignment)
+        {
+            SPARK_ASSERT(alignment > 0 && (alignment & (alignment - 1)) == 0);
+
+            if(!_blocks.empty())
+            {
+                auto& last = _blocks.back();
+                const auto offset = (reinterpret_cast<uintptr_t>(last.data) + _used + alignment - 1) & ~(alignment - 1);
+                const auto begin = static_cast<size_t>(offset - reinterpret_cast<uintptr_t>(last.data));
+                if(begin + bytes <= last.size)
+                {
+                    _used = begin + bytes;
+                    return last.data + begin;
+                }
+            }
+
+            // oversized requests get a block of their own
+            const auto size = std::max(block_size, bytes + alignment);
+            _blocks.push_back({new uint8_t[size], size});
+            _used = 0;
+            return this->allocate(bytes, alignment);
+        }
+
+        void node_arena::reset()
+        {
+            // only the blocks beyond the first are freed, nodes are never destroyed individually
+            for(size_t k = 1; k < _blocks.size(); k++)
+            {
+                delete[] _blocks[k].data;
+            }
+            if(_blocks.size() > 1)
+            {
+                _blocks.resize(1);
+            }
+            _used = 0;
+        }
+
+        node_arena& node_arena::current()
+        {
+            thread_local node_arena arena;
+            return arena;
+        }
+
+        void node_children::push_back(spark_node* node)
+        {
+            if(_size == _capacity)
+            {
+                // the old array stays in the arena until the program ends
+                const uint32_t capacity = std::max(4u, _capacity * 2);
+                auto data = static_cast<spark_node**>(node_arena::current().allocate(capacity * sizeof(spark_node*), alignof(spark_node*)));
+                if(_size > 0)
+                {
+                    std::memcpy(data, _data, _size * sizeof(spark_node*));
+                }
+                _data = data;
+                _capacity = capacity;
+            }
+            _data[_size++] = node;
+        }
+
+        void node_children::insert(size_t index, spark_node* node)
+        {
+            SPARK_ASSERT(index <= _size);
+            this->push_back(node);
+            std::memmove(_data + index + 1, _data + index, (_size - 1 - index) * sizeof(spark_node*));
+            _data[index] = node;
+        }
+
+        void node_children::erase(size_t index)
+        {
+            SPARK_ASSERT(index < _size);
+            std::memmove(_data + index, _data + index + 1, (_size - 1 - index) * sizeof(spark_node*));
+            --_size;
+        }
+
+        static spark_node_t* allocateNode()
+        {
+            static_assert(std::is_trivially_destructible<spark_node_t>::value, "nodes are released without running destructors");
+            return new (node_arena::current().allocate(sizeof(spark_node_t), alignof(spark_node_t))) spark_node_t();
+        }
+
+        spark_node* create_operator_node(spark::shared::Datatype type, spark::shared::Operator id)
+        {
+            spark_node_t* node = allocateNode();
+            node->_type = spark_nodetype::operation;
+            node->_operator.type = type;
+            node->_operator.id = id;
+            return node;
+        }
+
+        spark_node* create_symbol_node(spark::shared::Datatype type)
+        {
+            spark_node_t* node = allocateNode();
+            node->_type = spark_nodetype::symbol;
+            node->_symbol.type = type;
+            node->_symbol.id = g_nextSymbol++;
+            return node;
+        }
+
+        spark_node* create_constant_node(spark::shared::Datatype type, const void* raw, size_t size)
+        {
+            SPARK_ASSERT(raw != nullptr);
+            SPARK_ASSERT(size > 0);
+
+            spark_node_t* node = allocateNode();
+            node->_type = spark_nodetype::constant;
+            node->_constant.type = type;
+            node->_constant.buffer = static_cast<uint8_t*>(node_arena::current().allocate(size, alignof(std::max_align_t)));
+            std::memcpy(node->_constant.buffer, raw, size);
+            node->_constant.size = size;
+            return node;
+        }
+
+        spark_node* clone_node(const spark_node* node)
+        {
+            spark_node_t* copy = allocateNode();
+            *copy = *node;
+            copy->_children = node_children();
+            return copy;
+        }
     }
 }
 
@@ -34,6 +157,7 @@ RUFF_EXPORT void spark_begin_program(spark_error_t** error)
         [&]
         {
             g_nextSymbol = 0;
+            g_programStart = trace::enabled() ? trace::now() : 0;
         });
 }
 
@@ -43,12 +167,14 @@ RUFF_EXPORT void spark_end_program(spark_error_t** error)
         error,
         [&]
         {
-            // free all of our unattached nodes
-            for(auto node : g_allocatedNodes)
+            // free every node of the program at once
+            node_arena::current().reset();
+
+            if(g_programStart != 0)
             {
-                delete node;
+                trace::record("dsl", "build_program", g_programStart, trace::now());
+                g_programStart = 0;
             }
-            g_allocatedNodes.clear();
         });
 }
 
@@ -62,11 +188,10 @@ RUFF_EXPORT spark_node_t* spark_create_control_node(spark_control_t c, spark_err
         {
             SPARK_ASSERT(c < static_cast<spark_control_t>(Control::Count));
 
-            spark_node_t* node = new spark_node_t();
+            spark_node_t* node = allocateNode();
             node->_type = spark_nodetype::control;
             node->_control = static_cast<Control>(c);
 
-            g_allocatedNodes.push_back(node);
             return node;
         });
 }
@@ -77,13 +202,7 @@ RUFF_EXPORT spark_node_t* spark_create_operator_node(spark_datatype_t dt, spark_
         error,
         [&]
         {
-            spark_node_t* node = new spark_node_t();
-            node->_type = spark_nodetype::operation;
-            node->_operator.type = static_cast<Datatype>(dt);
-            node->_operator.id = static_cast<Operator>(id);
-
-            g_allocatedNodes.push_back(node);
-            return node;
+            return create_operator_node(static_cast<Datatype>(dt), static_cast<Operator>(id));
         });
 }
 
@@ -93,13 +212,12 @@ RUFF_EXPORT spark_node_t* spark_create_function_node(spark_datatype_t returnType
         error,
         [&]
         {
-            spark_node_t* node = new spark_node_t();
+            spark_node_t* node = allocateNode();
             node->_type = spark_nodetype::function;
             node->_function.id = g_nextSymbol++;
             node->_function.returnType = returnType;
             node->_function.entrypoint = false;
 
-            g_allocatedNodes.push_back(node);
             return node;
         });
 }
@@ -110,13 +228,7 @@ RUFF_EXPORT spark_node_t* spark_create_symbol_node(spark_datatype_t dt, spark_er
         error,
         [&]
         {
-            spark_node_t* node = new spark_node_t();
-            node->_type = spark_nodetype::symbol;
-            node->_symbol.type = static_cast<Datatype>(dt);
-            node->_symbol.id = g_nextSymbol++;
-
-            g_allocatedNodes.push_back(node);
-            return node;
+            return create_symbol_node(static_cast<Datatype>(dt));
         });
 }
 
@@ -126,18 +238,7 @@ RUFF_EXPORT spark_node_t* spark_create_constant_node(spark_datatype_t dt, const
         error,
         [&]
         {
-            SPARK_ASSERT(raw != nullptr);
-            SPARK_ASSERT(sz > 0);
-
-            spark_node_t* node = new spark_node_t();
-            node->_type = spark_nodetype::constant;
-            node->_constant.type = static_cast<Datatype>(dt);
-            node->_constant.buffer = new uint8_t[sz];
-            std::memcpy(node->_constant.buffer, raw, sz);
-            node->_constant.size = sz;
-
-            g_allocatedNodes.push_back(node);
-            return node;
+            return create_constant_node(static_cast<Datatype>(dt), raw, sz);
         });
 }
 
@@ -147,11 +248,10 @@ RUFF_EXPORT spark_node_t* spark_create_property_node(spark_property_t prop, spar
         error,
         [&]
         {
-            spark_node_t* node = new spark_node_t();
+            spark_node_t* node = allocateNode();
             node->_type = spark_nodetype::property;
             node->_property.id = static_cast<Property>(prop);
 
-            g_allocatedNodes.push_back(node);
             return node;
         });
 }
@@ -162,11 +262,10 @@ RUFF_EXPORT spark_node_t* spark_create_comment_node(const char* comment, spark_e
         error,
         [&]
         {
-            spark_node_t* node = new spark_node_t();
+            spark_node_t* node = allocateNode();
             node->_type = spark_nodetype::comment;
             node->_comment = comment;
 
-            g_allocatedNodes.push_back(node);
             return node;
         });
 }
@@ -180,7 +279,7 @@ RUFF_EXPORT spark_node_t* spark_create_vector_node(spark_datatype_t type, spark_
             auto dt = static_cast<Datatype>(type);
             auto c = dt.GetComponents();
             SPARK_ASSERT(c != Components::None && c != Components::Scalar);
-            spark_node_t* node = new spark_node_t();
+            spark_node_t* node = allocateNode();
             node->_type = spark_nodetype::vector;
             node->_vector.type = type;
 
@@ -189,7 +288,6 @@ RUFF_EXPORT spark_node_t* spark_create_vector_node(spark_datatype_t type, spark_
                 node->_children.push_back(children[k]);
             }
 
-            g_allocatedNodes.push_back(node);
             return node;
         });
 }
@@ -200,10 +298,9 @@ RUFF_EXPORT spark_node_t* spark_create_scope_block_node(spark_error_t** error)
         error,
         [&]
         {
-            spark_node_t* node = new spark_node_t();
+            spark_node_t* node = allocateNode();
             node->_type = spark_nodetype::scope_block;
 
-            g_allocatedNodes.push_back(node);
             return node;
         });
 }
@@ -245,6 +342,18 @@ RUFF_EXPORT void spark_node_make_entrypoint(spark_node_t* node, spark_error_t**
         });
 }
 
+RUFF_EXPORT void spark_node_set_unroll(spark_node_t* node, uint32_t count, spark_error_t** error)
+{
+    return TranslateExceptions(
+        error,
+        [&]
+        {
+            SPARK_ASSERT(node->_type == spark_nodetype::control && node->_control == Control::For);
+            SPARK_ASSERT(count <= std::numeric_limits<uint16_t>::max());
+            node->_unroll = static_cast<uint16_t>(count);
+        });
+}
+
 // source scope
 RUFF_EXPORT void spark_push_scope_node(spark_node_t* node, spark_error_t** error)
 {
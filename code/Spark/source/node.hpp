@@ -22,13 +22,76 @@ namespace spark
 
         typedef uint32_t spark_symbolid_t;
 
+        struct spark_node;
+
+        // bump allocator owning the nodes, child arrays and constant payloads of the
+        // program being built on this thread; spark_end_program releases them all at once
+        class node_arena
+        {
+        public:
+            node_arena() = default;
+            ~node_arena();
+
+            node_arena(const node_arena&) = delete;
+            node_arena& operator=(const node_arena&) = delete;
+
+            void* allocate(size_t bytes, size_t alignment);
+            // frees every allocation, keeping the first block for the next program
+            void reset();
+
+            static node_arena& current();
+
+        private:
+            static const size_t block_size = 64 * 1024;
+
+            struct block
+            {
+                uint8_t* data;
+                size_t size;
+            };
+            std::vector<block> _blocks;
+            // bytes handed out from the last block
+            size_t _used = 0;
+        };
+
+        // child list of a node, grown inside the node arena
+        class node_children
+        {
+        public:
+            size_t size() const { return _size; }
+            bool empty() const { return _size == 0; }
+
+            spark_node** begin() { return _data; }
+            spark_node** end() { return _data + _size; }
+            spark_node* const* begin() const { return _data; }
+            spark_node* const* end() const { return _data + _size; }
+
+            spark_node*& operator[](size_t index) { return _data[index]; }
+            spark_node* operator[](size_t index) const { return _data[index]; }
+            spark_node*& front() { return _data[0]; }
+            spark_node* front() const { return _data[0]; }
+            spark_node*& back() { return _data[_size - 1]; }
+            spark_node* back() const { return _data[_size - 1]; }
+
+            void push_back(spark_node* node);
+            void insert(size_t index, spark_node* node);
+            void erase(size_t index);
+
+        private:
+            spark_node** _data = nullptr;
+            uint32_t _size = 0;
+            uint32_t _capacity = 0;
+        };
+
+        // allocated from node_arena::current() and never individually destroyed
         struct spark_node
         {
             spark_node() {};
-            ~spark_node();
-            std::vector<spark_node*> _children;
+            node_children _children;
             spark_nodetype _type;
             bool _attached = false;
+            // unroll factor requested for a for loop, 0 leaves it to the optimizer and compiler
+            uint16_t _unroll = 0;
             union
             {
                 spark::shared::Control _control;
@@ -65,6 +128,13 @@ namespace spark
                 const char* _comment;
             };
         };
+
+        // nodes created by passes rewriting a program's tree, same as the spark_create_* functions
+        spark_node* create_operator_node(spark::shared::Datatype type, spark::shared::Operator id);
+        spark_node* create_symbol_node(spark::shared::Datatype type);
+        spark_node* create_constant_node(spark::shared::Datatype type, const void* raw, size_t size);
+        // copy of node with an empty child list
+        spark_node* clone_node(const spark_node* node);
     }
 }
 
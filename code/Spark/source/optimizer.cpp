@@ -0,0 +1,1380 @@
+#include "spark.hpp"
+
+#include "node.hpp"
+#include "error.hpp"
+#include "optimizer.hpp"
+#include "trace.hpp"
+
+using spark::shared::Components;
+using spark::shared::Control;
+using spark::shared::Datatype;
+using spark::shared::Operator;
+using spark::shared::Primitive;
+
+namespace spark
+{
+    namespace lib
+    {
+        // nodes may be shared by several parents, so passes never modify a node's own
+        // fields; they only replace child pointers with equivalent values, or clone a
+        // statement before rewriting it
+
+        static bool sameType(Datatype left, Datatype right)
+        {
+            return static_cast<spark_datatype_t>(left) == static_cast<spark_datatype_t>(right);
+        }
+
+        // type of a value node, void for anything else
+        static Datatype valueType(const spark_node_t* node)
+        {
+            switch(node->_type)
+            {
+                case spark_nodetype::operation:
+                    return node->_operator.type;
+                case spark_nodetype::symbol:
+                    return node->_symbol.type;
+                case spark_nodetype::constant:
+                    return node->_constant.type;
+                case spark_nodetype::vector:
+                    return node->_vector.type;
+                default:
+                    return Datatype();
+            }
+        }
+
+        // width of an integer primitive, 0 for floating point
+        static uint32_t integerBits(Primitive primitive)
+        {
+            switch(primitive)
+            {
+                case Primitive::Char:
+                case Primitive::UChar:
+                    return 8;
+                case Primitive::Short:
+                case Primitive::UShort:
+                    return 16;
+                case Primitive::Int:
+                case Primitive::UInt:
+                    return 32;
+                case Primitive::Long:
+                case Primitive::ULong:
+                    return 64;
+                default:
+                    return 0;
+            }
+        }
+
+        static bool isSigned(Primitive primitive)
+        {
+            return primitive == Primitive::Char ||
+                   primitive == Primitive::Short ||
+                   primitive == Primitive::Int ||
+                   primitive == Primitive::Long;
+        }
+
+        // only integer scalars are folded, float arithmetic on the device may round differently
+        static bool isIntegerScalar(Datatype dt)
+        {
+            return !dt.GetPointer() && dt.GetComponents() == Components::Scalar && integerBits(dt.GetPrimitive()) > 0;
+        }
+
+        // value of an integer scalar constant, signed types are sign extended
+        static bool readInteger(const spark_node_t* node, int64_t& value)
+        {
+            if(node->_type != spark_nodetype::constant || !isIntegerScalar(node->_constant.type))
+            {
+                return false;
+            }
+
+            const void* raw = node->_constant.buffer;
+            switch(node->_constant.type.GetPrimitive())
+            {
+                case Primitive::Char:   value = *reinterpret_cast<const int8_t*>(raw); break;
+                case Primitive::UChar:  value = *reinterpret_cast<const uint8_t*>(raw); break;
+                case Primitive::Short:  value = *reinterpret_cast<const int16_t*>(raw); break;
+                case Primitive::UShort: value = *reinterpret_cast<const uint16_t*>(raw); break;
+                case Primitive::Int:    value = *reinterpret_cast<const int32_t*>(raw); break;
+                case Primitive::UInt:   value = *reinterpret_cast<const uint32_t*>(raw); break;
+                case Primitive::Long:   value = *reinterpret_cast<const int64_t*>(raw); break;
+                case Primitive::ULong:  value = static_cast<int64_t>(*reinterpret_cast<const uint64_t*>(raw)); break;
+                default:
+                    return false;
+            }
+            return true;
+        }
+
+        // integer constant of type dt holding value truncated to its width
+        static spark_node_t* makeInteger(Datatype dt, int64_t value)
+        {
+            switch(dt.GetPrimitive())
+            {
+                case Primitive::Char:   { auto v = static_cast<int8_t>(value); return create_constant_node(dt, &v, sizeof(v)); }
+                case Primitive::UChar:  { auto v = static_cast<uint8_t>(value); return create_constant_node(dt, &v, sizeof(v)); }
+                case Primitive::Short:  { auto v = static_cast<int16_t>(value); return create_constant_node(dt, &v, sizeof(v)); }
+                case Primitive::UShort: { auto v = static_cast<uint16_t>(value); return create_constant_node(dt, &v, sizeof(v)); }
+                case Primitive::Int:    { auto v = static_cast<int32_t>(value); return create_constant_node(dt, &v, sizeof(v)); }
+                case Primitive::UInt:   { auto v = static_cast<uint32_t>(value); return create_constant_node(dt, &v, sizeof(v)); }
+                case Primitive::Long:   { auto v = static_cast<int64_t>(value); return create_constant_node(dt, &v, sizeof(v)); }
+                case Primitive::ULong:  { auto v = static_cast<uint64_t>(value); return create_constant_node(dt, &v, sizeof(v)); }
+                default:
+                    SPARK_ASSERT(false);
+                    return nullptr;
+            }
+        }
+
+        // whether node is a scalar constant equal to value, float constants only count if allowFloat
+        static bool isConstant(const spark_node_t* node, int64_t value, bool allowFloat)
+        {
+            int64_t integer;
+            if(readInteger(node, integer))
+            {
+                return integer == value;
+            }
+
+            if(allowFloat &&
+               node->_type == spark_nodetype::constant &&
+               !node->_constant.type.GetPointer() &&
+               node->_constant.type.GetComponents() == Components::Scalar)
+            {
+                switch(node->_constant.type.GetPrimitive())
+                {
+                    case Primitive::Float:
+                        return *reinterpret_cast<const float*>(node->_constant.buffer) == static_cast<float>(value);
+                    case Primitive::Double:
+                        return *reinterpret_cast<const double*>(node->_constant.buffer) == static_cast<double>(value);
+                    default:
+                        break;
+                }
+            }
+            return false;
+        }
+
+        static bool isIncrementOrDecrement(Operator op)
+        {
+            return op == Operator::PrefixIncrement ||
+                   op == Operator::PrefixDecrement ||
+                   op == Operator::PostfixIncrement ||
+                   op == Operator::PostfixDecrement;
+        }
+
+        static bool isComparisonOrLogical(Operator op)
+        {
+            return (op >= Operator::GreaterThan && op <= Operator::LogicalOr) || op == Operator::LogicalNot;
+        }
+
+        // whether evaluating node stores to anything or calls a function
+        static bool hasSideEffects(const spark_node_t* node)
+        {
+            if(node->_type == spark_nodetype::operation)
+            {
+                const auto op = node->_operator.id;
+                if(op == Operator::Assignment || op == Operator::Call || isIncrementOrDecrement(op))
+                {
+                    return true;
+                }
+            }
+            return std::any_of(node->_children.begin(), node->_children.end(), hasSideEffects);
+        }
+
+        static bool sameTree(const spark_node_t* left, const spark_node_t* right)
+        {
+            if(left == right)
+            {
+                return true;
+            }
+            if(left->_type != right->_type || left->_children.size() != right->_children.size())
+            {
+                return false;
+            }
+
+            switch(left->_type)
+            {
+                case spark_nodetype::operation:
+                    if(left->_operator.id != right->_operator.id || !sameType(left->_operator.type, right->_operator.type))
+                    {
+                        return false;
+                    }
+                    break;
+                case spark_nodetype::symbol:
+                    return left->_symbol.id == right->_symbol.id;
+                case spark_nodetype::constant:
+                    return sameType(left->_constant.type, right->_constant.type) &&
+                           left->_constant.size == right->_constant.size &&
+                           std::memcmp(left->_constant.buffer, right->_constant.buffer, left->_constant.size) == 0;
+                case spark_nodetype::property:
+                    return left->_property.id == right->_property.id;
+                case spark_nodetype::vector:
+                    if(!sameType(left->_vector.type, right->_vector.type))
+                    {
+                        return false;
+                    }
+                    break;
+                default:
+                    return false;
+            }
+
+            for(size_t k = 0; k < left->_children.size(); k++)
+            {
+                if(!sameTree(left->_children[k], right->_children[k]))
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        /// Constant Folding
+
+        // result of a binary operator on integer constants of the given primitive,
+        // false if it can't be computed at compile time
+        static bool evaluateBinary(Operator op, Primitive primitive, int64_t left, int64_t right, int64_t& result)
+        {
+            const auto bits = integerBits(primitive);
+            const bool sign = isSigned(primitive);
+            // arithmetic is done unsigned so overflow wraps, like it does on the device
+            const auto l = static_cast<uint64_t>(left);
+            const auto r = static_cast<uint64_t>(right);
+            const int64_t minimum = (bits == 64) ? std::numeric_limits<int64_t>::min() : -(int64_t(1) << (bits - 1));
+
+            switch(op)
+            {
+                case Operator::Add:        result = static_cast<int64_t>(l + r); return true;
+                case Operator::Subtract:   result = static_cast<int64_t>(l - r); return true;
+                case Operator::Multiply:   result = static_cast<int64_t>(l * r); return true;
+                case Operator::BitwiseAnd: result = static_cast<int64_t>(l & r); return true;
+                case Operator::BitwiseOr:  result = static_cast<int64_t>(l | r); return true;
+                case Operator::BitwiseXor: result = static_cast<int64_t>(l ^ r); return true;
+                case Operator::Divide:
+                case Operator::Modulo:
+                    if(right == 0 || (sign && right == -1 && left == minimum))
+                    {
+                        return false;
+                    }
+                    if(sign)
+                    {
+                        result = (op == Operator::Divide) ? left / right : left % right;
+                    }
+                    else
+                    {
+                        result = static_cast<int64_t>((op == Operator::Divide) ? l / r : l % r);
+                    }
+                    return true;
+                case Operator::LeftShift:
+                case Operator::RightShift:
+                    // opencl masks oversized shifts but c++ leaves them undefined
+                    if(right < 0 || r >= bits)
+                    {
+                        return false;
+                    }
+                    if(op == Operator::LeftShift)
+                    {
+                        result = static_cast<int64_t>(l << r);
+                    }
+                    else
+                    {
+                        result = sign ? (left >> r) : static_cast<int64_t>(l >> r);
+                    }
+                    return true;
+                case Operator::GreaterThan:      result = sign ? left > right : l > r; return true;
+                case Operator::LessThan:         result = sign ? left < right : l < r; return true;
+                case Operator::GreaterEqualThan: result = sign ? left >= right : l >= r; return true;
+                case Operator::LessEqualThan:    result = sign ? left <= right : l <= r; return true;
+                case Operator::NotEqual:         result = left != right; return true;
+                case Operator::Equal:            result = left == right; return true;
+                case Operator::LogicalAnd:       result = (left != 0) && (right != 0); return true;
+                case Operator::LogicalOr:        result = (left != 0) || (right != 0); return true;
+                default:
+                    return false;
+            }
+        }
+
+        // constant or simpler equivalent of an operation whose children are already simplified
+        static spark_node_t* simplifyOperation(spark_node_t* node)
+        {
+            const auto op = node->_operator.id;
+            const auto type = node->_operator.type;
+            const auto& children = node->_children;
+
+            // comparisons produce an int whatever their operand type, everything else keeps it
+            auto foldable = [&](const spark_node_t* operand)
+            {
+                return isComparisonOrLogical(op) ? isIntegerScalar(type) : sameType(valueType(operand), type);
+            };
+
+            if(children.size() == 2)
+            {
+                int64_t left, right, value;
+                if(readInteger(children.front(), left) &&
+                   readInteger(children.back(), right) &&
+                   sameType(children.front()->_constant.type, children.back()->_constant.type) &&
+                   foldable(children.front()) &&
+                   evaluateBinary(op, children.front()->_constant.type.GetPrimitive(), left, right, value))
+                {
+                    return makeInteger(type, value);
+                }
+            }
+            else if(children.size() == 1)
+            {
+                int64_t operand;
+                if(readInteger(children.front(), operand) && foldable(children.front()))
+                {
+                    switch(op)
+                    {
+                        case Operator::Negate:
+                            return makeInteger(type, static_cast<int64_t>(0 - static_cast<uint64_t>(operand)));
+                        case Operator::BitwiseNot:
+                            return makeInteger(type, ~operand);
+                        case Operator::LogicalNot:
+                            return makeInteger(type, operand == 0);
+                        default:
+                            break;
+                    }
+                }
+
+                // casting to the type a value already has
+                if(op == Operator::Cast && sameType(valueType(children.front()), type))
+                {
+                    return children.front();
+                }
+                return node;
+            }
+            else
+            {
+                return node;
+            }
+
+            // algebraic identities, an operand only replaces the operation if it has the same type
+            auto left = children.front();
+            auto right = children.back();
+            auto keep = [&](spark_node_t* operand)
+            {
+                return sameType(valueType(operand), type) ? operand : node;
+            };
+            // x * 0 and friends drop x, which is only allowed when evaluating it does nothing else
+            auto zero = [&](spark_node_t* dropped)
+            {
+                return (isIntegerScalar(type) && !hasSideEffects(dropped)) ? makeInteger(type, 0) : node;
+            };
+
+            switch(op)
+            {
+                case Operator::Add:
+                case Operator::BitwiseOr:
+                case Operator::BitwiseXor:
+                    // x + 0.0f isn't x for x == -0.0f, so integers only
+                    if(isConstant(right, 0, false))
+                    {
+                        return keep(left);
+                    }
+                    if(isConstant(left, 0, false))
+                    {
+                        return keep(right);
+                    }
+                    break;
+                case Operator::Subtract:
+                case Operator::LeftShift:
+                case Operator::RightShift:
+                    if(isConstant(right, 0, false))
+                    {
+                        return keep(left);
+                    }
+                    break;
+                case Operator::Multiply:
+                    if(isConstant(right, 1, true))
+                    {
+                        return keep(left);
+                    }
+                    if(isConstant(left, 1, true))
+                    {
+                        return keep(right);
+                    }
+                    if(isConstant(right, 0, false))
+                    {
+                        return zero(left);
+                    }
+                    if(isConstant(left, 0, false))
+                    {
+                        return zero(right);
+                    }
+                    break;
+                case Operator::Divide:
+                    if(isConstant(right, 1, true))
+                    {
+                        return keep(left);
+                    }
+                    break;
+                case Operator::Modulo:
+                    if(isConstant(right, 1, false))
+                    {
+                        return zero(left);
+                    }
+                    break;
+                case Operator::BitwiseAnd:
+                    if(isConstant(right, 0, false))
+                    {
+                        return zero(left);
+                    }
+                    if(isConstant(left, 0, false))
+                    {
+                        return zero(right);
+                    }
+                    break;
+                default:
+                    break;
+            }
+            return node;
+        }
+
+        typedef std::unordered_map<spark_node_t*, spark_node_t*> rewrite_map;
+
+        static spark_node_t* simplifyNode(spark_node_t* node, rewrite_map& rewritten, bool& changed);
+
+        static void simplifyChildren(spark_node_t* node, rewrite_map& rewritten, bool& changed)
+        {
+            for(auto& child : node->_children)
+            {
+                auto replacement = simplifyNode(child, rewritten, changed);
+                if(replacement != child)
+                {
+                    child = replacement;
+                    changed = true;
+                }
+            }
+        }
+
+        // simplifies node's subtree bottom up, returning what should take node's place
+        static spark_node_t* simplifyNode(spark_node_t* node, rewrite_map& rewritten, bool& changed)
+        {
+            auto found = rewritten.find(node);
+            if(found != rewritten.end())
+            {
+                return found->second;
+            }
+
+            auto result = node;
+            switch(node->_type)
+            {
+                case spark_nodetype::operation:
+                    simplifyChildren(node, rewritten, changed);
+                    result = simplifyOperation(node);
+                    break;
+                case spark_nodetype::control:
+                case spark_nodetype::scope_block:
+                case spark_nodetype::vector:
+                    simplifyChildren(node, rewritten, changed);
+                    break;
+                default:
+                    // functions are only reached through calls here, their bodies are visited from the root
+                    break;
+            }
+
+            rewritten[node] = result;
+            return result;
+        }
+
+        static bool foldConstants(spark_node_t* root)
+        {
+            bool changed = false;
+            rewrite_map rewritten;
+            for(auto function : root->_children)
+            {
+                simplifyChildren(function->_children.back(), rewritten, changed);
+            }
+            return changed;
+        }
+
+        /// Symbol Usage
+
+        struct symbol_usage
+        {
+            Datatype type;
+            uint32_t reads = 0;
+            // reads inside the values stored to the symbol itself, like x = x + 1
+            uint32_t self_reads = 0;
+            uint32_t writes = 0;
+            bool parameter = false;
+            // every write is a statement assigning the bare symbol
+            bool plain_writes = true;
+            // and none of the assigned values has side effects
+            bool pure_values = true;
+            // value of the last plain write
+            spark_node_t* value = nullptr;
+        };
+
+        typedef std::unordered_map<spark_symbolid_t, symbol_usage> usage_map;
+
+        // the symbol an lvalue modifies, looking through swizzles
+        static const spark_node_t* lvalueSymbol(const spark_node_t* node)
+        {
+            while(node->_type == spark_nodetype::operation && node->_operator.id == Operator::Property)
+            {
+                node = node->_children.front();
+            }
+            return (node->_type == spark_nodetype::symbol) ? node : nullptr;
+        }
+
+        static uint32_t countReads(const spark_node_t* node, spark_symbolid_t id)
+        {
+            if(node->_type == spark_nodetype::symbol)
+            {
+                return node->_symbol.id == id ? 1 : 0;
+            }
+
+            uint32_t reads = 0;
+            if(node->_type != spark_nodetype::function)
+            {
+                for(auto child : node->_children)
+                {
+                    reads += countReads(child, id);
+                }
+            }
+            return reads;
+        }
+
+        static void countUses(spark_node_t* node, usage_map& usage, bool statement)
+        {
+            switch(node->_type)
+            {
+                case spark_nodetype::symbol:
+                    usage[node->_symbol.id].reads++;
+                    break;
+                case spark_nodetype::operation:
+                {
+                    const auto op = node->_operator.id;
+                    auto target = node->_children.empty() ? nullptr : node->_children.front();
+                    if(op == Operator::Assignment && target->_type == spark_nodetype::symbol)
+                    {
+                        auto& symbol = usage[target->_symbol.id];
+                        symbol.type = target->_symbol.type;
+                        symbol.writes++;
+                        symbol.plain_writes = symbol.plain_writes && statement;
+                        symbol.pure_values = symbol.pure_values && !hasSideEffects(node->_children.back());
+                        symbol.value = node->_children.back();
+                        symbol.self_reads += countReads(symbol.value, target->_symbol.id);
+                        countUses(node->_children.back(), usage, false);
+                        break;
+                    }
+
+                    // partial writes and anything that could write through an address
+                    if(op == Operator::Assignment || op == Operator::AddressOf || isIncrementOrDecrement(op))
+                    {
+                        if(auto symbol = lvalueSymbol(target))
+                        {
+                            auto& written = usage[symbol->_symbol.id];
+                            written.writes++;
+                            written.plain_writes = false;
+                        }
+                    }
+                    for(auto child : node->_children)
+                    {
+                        countUses(child, usage, false);
+                    }
+                    break;
+                }
+                case spark_nodetype::scope_block:
+                    for(auto child : node->_children)
+                    {
+                        countUses(child, usage, true);
+                    }
+                    break;
+                case spark_nodetype::control:
+                case spark_nodetype::vector:
+                    for(auto child : node->_children)
+                    {
+                        countUses(child, usage, false);
+                    }
+                    break;
+                default:
+                    break;
+            }
+        }
+
+        static usage_map countProgramUses(spark_node_t* root)
+        {
+            usage_map usage;
+            for(auto function : root->_children)
+            {
+                for(auto parameter : function->_children.front()->_children)
+                {
+                    auto& symbol = usage[parameter->_symbol.id];
+                    symbol.type = parameter->_symbol.type;
+                    symbol.parameter = true;
+                    // holds the caller's value
+                    symbol.writes++;
+                    symbol.plain_writes = false;
+                }
+                countUses(function->_children.back(), usage, false);
+            }
+            return usage;
+        }
+
+        /// Constant and Copy Propagation
+
+        typedef std::unordered_map<spark_symbolid_t, spark_node_t*> replacement_map;
+
+        static void replaceSymbols(spark_node_t* node, const replacement_map& replacements, std::unordered_set<spark_node_t*>& visited)
+        {
+            if(node->_type == spark_nodetype::function || !visited.insert(node).second)
+            {
+                return;
+            }
+
+            for(size_t k = 0; k < node->_children.size(); k++)
+            {
+                auto child = node->_children[k];
+                if(child->_type != spark_nodetype::symbol)
+                {
+                    replaceSymbols(child, replacements, visited);
+                    continue;
+                }
+
+                // the assigned symbol stays, dead store elimination removes the store once unread
+                const bool assigned = (k == 0 && node->_type == spark_nodetype::operation && node->_operator.id == Operator::Assignment);
+                auto found = replacements.find(child->_symbol.id);
+                if(!assigned && found != replacements.end())
+                {
+                    node->_children[k] = found->second;
+                }
+            }
+        }
+
+        // replaces reads of a variable assigned once with its value when that is a constant,
+        // or a parameter that is never modified
+        static bool propagateValues(spark_node_t* root)
+        {
+            auto usage = countProgramUses(root);
+
+            replacement_map replacements;
+            for(const auto& entry : usage)
+            {
+                const auto& symbol = entry.second;
+                if(symbol.parameter || symbol.writes != 1 || !symbol.plain_writes || symbol.reads == 0)
+                {
+                    continue;
+                }
+
+                auto value = symbol.value;
+                if(!sameType(valueType(value), symbol.type))
+                {
+                    continue;
+                }
+
+                if(value->_type == spark_nodetype::constant)
+                {
+                    replacements[entry.first] = value;
+                }
+                else if(value->_type == spark_nodetype::symbol)
+                {
+                    const auto& source = usage[value->_symbol.id];
+                    if(source.parameter && source.writes == 1)
+                    {
+                        replacements[entry.first] = value;
+                    }
+                }
+            }
+
+            if(replacements.empty())
+            {
+                return false;
+            }
+
+            std::unordered_set<spark_node_t*> visited;
+            for(auto function : root->_children)
+            {
+                replaceSymbols(function->_children.back(), replacements, visited);
+            }
+            return true;
+        }
+
+        /// Dead Store Elimination
+
+        // stores to a variable nobody else reads; all of its stores go at once, as the first
+        // remaining one would become its declaration, possibly in a narrower scope
+        static bool isDeadStore(const spark_node_t* statement, const usage_map& usage)
+        {
+            if(statement->_type != spark_nodetype::operation ||
+               statement->_operator.id != Operator::Assignment ||
+               statement->_children.front()->_type != spark_nodetype::symbol)
+            {
+                return false;
+            }
+
+            // assigning a variable to itself, left behind by folding x = x + 0
+            const auto id = statement->_children.front()->_symbol.id;
+            const auto value = statement->_children.back();
+            if(value->_type == spark_nodetype::symbol && value->_symbol.id == id)
+            {
+                return true;
+            }
+
+            const auto& symbol = usage.at(id);
+            return symbol.reads == symbol.self_reads && !symbol.parameter && symbol.plain_writes && symbol.pure_values;
+        }
+
+        static void removeDeadStores(spark_node_t* node, const usage_map& usage, bool& changed)
+        {
+            if(node->_type == spark_nodetype::scope_block)
+            {
+                for(size_t k = 0; k < node->_children.size();)
+                {
+                    if(isDeadStore(node->_children[k], usage))
+                    {
+                        node->_children.erase(k);
+                        changed = true;
+                    }
+                    else
+                    {
+                        k++;
+                    }
+                }
+            }
+
+            // only control flow contains further statements
+            for(auto child : node->_children)
+            {
+                if(child->_type == spark_nodetype::scope_block || child->_type == spark_nodetype::control)
+                {
+                    removeDeadStores(child, usage, changed);
+                }
+            }
+        }
+
+        static bool eliminateDeadStores(spark_node_t* root)
+        {
+            auto usage = countProgramUses(root);
+
+            bool changed = false;
+            for(auto function : root->_children)
+            {
+                removeDeadStores(function->_children.back(), usage, changed);
+            }
+            return changed;
+        }
+
+        /// Common Subexpression Elimination
+
+        // operators computed from their operands alone; within a single statement without
+        // other stores a load can be hoisted as well, as the only store happens last
+        static bool isHoistable(Operator op)
+        {
+            switch(op)
+            {
+                case Operator::Break:
+                case Operator::AddressOf:
+                case Operator::Assignment:
+                case Operator::Call:
+                case Operator::Return:
+                    return false;
+                default:
+                    // comparisons are left alone so temporaries never need a boolean vector type
+                    return !isIncrementOrDecrement(op) && !isComparisonOrLogical(op);
+            }
+        }
+
+        // statements whose only effect is their outermost assignment or return
+        static bool isSimpleStatement(const spark_node_t* statement)
+        {
+            if(statement->_type != spark_nodetype::operation)
+            {
+                return false;
+            }
+
+            const auto op = statement->_operator.id;
+            if(op != Operator::Assignment && op != Operator::Return)
+            {
+                return false;
+            }
+            return std::none_of(statement->_children.begin(), statement->_children.end(), hasSideEffects);
+        }
+
+        // appends every hoistable subtree of node (including node) large enough to be worth
+        // a temporary, returns whether node itself is hoistable and its size in nodes
+        static bool collectCandidates(spark_node_t* node, std::vector<spark_node_t*>& candidates, size_t& size)
+        {
+            size = 1;
+            switch(node->_type)
+            {
+                case spark_nodetype::symbol:
+                case spark_nodetype::constant:
+                case spark_nodetype::property:
+                    return true;
+                case spark_nodetype::operation:
+                case spark_nodetype::vector:
+                    break;
+                default:
+                    return false;
+            }
+
+            const bool shortCircuit = node->_type == spark_nodetype::operation &&
+                                      (node->_operator.id == Operator::LogicalAnd || node->_operator.id == Operator::LogicalOr);
+            bool hoistable = node->_type == spark_nodetype::vector || isHoistable(node->_operator.id);
+            std::vector<spark_node_t*> conditional;
+            for(size_t k = 0; k < node->_children.size(); k++)
+            {
+                // the right side of && and || may never run, so it can't be evaluated early
+                auto& target = (shortCircuit && k > 0) ? conditional : candidates;
+                size_t childSize = 0;
+                hoistable = collectCandidates(node->_children[k], target, childSize) && hoistable;
+                size += childSize;
+            }
+
+            // repeated swizzles of a value are as cheap as a temporary
+            if(hoistable && node->_type == spark_nodetype::operation && node->_operator.id != Operator::Property && size >= 3)
+            {
+                candidates.push_back(node);
+            }
+            return hoistable;
+        }
+
+        // the dereference under an assignment's target, null if it stores to a variable;
+        // the target is written rather than computed, only its address can be hoisted
+        static spark_node_t* targetDereference(spark_node_t* target)
+        {
+            while(target->_type == spark_nodetype::operation && target->_operator.id == Operator::Property)
+            {
+                target = target->_children.front();
+            }
+            return (target->_type == spark_nodetype::operation && target->_operator.id == Operator::Dereference) ? target : nullptr;
+        }
+
+        static void collectStatementCandidates(spark_node_t* statement, std::vector<spark_node_t*>& candidates)
+        {
+            for(size_t k = 0; k < statement->_children.size(); k++)
+            {
+                auto child = statement->_children[k];
+                size_t size = 0;
+                if(k == 0 && statement->_operator.id == Operator::Assignment)
+                {
+                    if(auto dereference = targetDereference(child))
+                    {
+                        collectCandidates(dereference->_children.front(), candidates, size);
+                    }
+                }
+                else
+                {
+                    collectCandidates(child, candidates, size);
+                }
+            }
+        }
+
+        static size_t treeSize(const spark_node_t* node)
+        {
+            size_t size = 1;
+            if(node->_type != spark_nodetype::function)
+            {
+                for(auto child : node->_children)
+                {
+                    size += treeSize(child);
+                }
+            }
+            return size;
+        }
+
+        // the largest candidate occurring more than once, null if there isn't one
+        static spark_node_t* findCommonSubexpression(spark_node_t* statement)
+        {
+            std::vector<spark_node_t*> candidates;
+            collectStatementCandidates(statement, candidates);
+
+            spark_node_t* best = nullptr;
+            size_t bestSize = 0;
+            for(size_t i = 0; i < candidates.size(); i++)
+            {
+                const auto size = treeSize(candidates[i]);
+                if(size <= bestSize)
+                {
+                    continue;
+                }
+                for(size_t j = i + 1; j < candidates.size(); j++)
+                {
+                    if(sameTree(candidates[i], candidates[j]))
+                    {
+                        best = candidates[i];
+                        bestSize = size;
+                        break;
+                    }
+                }
+            }
+            return best;
+        }
+
+        // deep copy of the value nodes under node, leaves are shared
+        static spark_node_t* cloneTree(spark_node_t* node)
+        {
+            if(node->_type != spark_nodetype::operation && node->_type != spark_nodetype::vector)
+            {
+                return node;
+            }
+
+            auto copy = clone_node(node);
+            for(auto child : node->_children)
+            {
+                copy->_children.push_back(cloneTree(child));
+            }
+            return copy;
+        }
+
+        static void replaceTree(spark_node_t* node, const spark_node_t* value, spark_node_t* symbol)
+        {
+            for(auto& child : node->_children)
+            {
+                if(sameTree(child, value))
+                {
+                    child = symbol;
+                }
+                else
+                {
+                    replaceTree(child, value, symbol);
+                }
+            }
+        }
+
+        static void replaceInStatement(spark_node_t* statement, const spark_node_t* value, spark_node_t* symbol)
+        {
+            for(size_t k = 0; k < statement->_children.size(); k++)
+            {
+                auto child = statement->_children[k];
+                if(k == 0 && statement->_operator.id == Operator::Assignment)
+                {
+                    if(auto dereference = targetDereference(child))
+                    {
+                        replaceTree(dereference, value, symbol);
+                    }
+                }
+                else if(sameTree(child, value))
+                {
+                    statement->_children[k] = symbol;
+                }
+                else
+                {
+                    replaceTree(child, value, symbol);
+                }
+            }
+        }
+
+        static void hoistCommonSubexpressions(spark_node_t* node, std::unordered_set<spark_node_t*>& cloned, bool& changed)
+        {
+            if(node->_type == spark_nodetype::scope_block)
+            {
+                for(size_t k = 0; k < node->_children.size();)
+                {
+                    auto statement = node->_children[k];
+                    if(!isSimpleStatement(statement) || findCommonSubexpression(statement) == nullptr)
+                    {
+                        k++;
+                        continue;
+                    }
+
+                    // parts of the statement may be shared with others, rewrite a private copy
+                    if(cloned.count(statement) == 0)
+                    {
+                        statement = cloneTree(statement);
+                        cloned.insert(statement);
+                        node->_children[k] = statement;
+                    }
+
+                    auto value = findCommonSubexpression(statement);
+                    auto temporary = create_symbol_node(value->_operator.type);
+                    replaceInStatement(statement, value, temporary);
+
+                    auto assignment = create_operator_node(value->_operator.type, Operator::Assignment);
+                    assignment->_children.push_back(temporary);
+                    assignment->_children.push_back(value);
+                    cloned.insert(assignment);
+
+                    // the temporary's definition is looked at next, then the statement again
+                    node->_children.insert(k, assignment);
+                    changed = true;
+                }
+            }
+
+            for(auto child : node->_children)
+            {
+                if(child->_type == spark_nodetype::scope_block || child->_type == spark_nodetype::control)
+                {
+                    hoistCommonSubexpressions(child, cloned, changed);
+                }
+            }
+        }
+
+        static bool eliminateCommonSubexpressions(spark_node_t* root)
+        {
+            bool changed = false;
+            std::unordered_set<spark_node_t*> cloned;
+            for(auto function : root->_children)
+            {
+                hoistCommonSubexpressions(function->_children.back(), cloned, changed);
+            }
+            return changed;
+        }
+
+        /// Loop Unrolling
+
+        // without a requested factor, loops of at most this many iterations are unrolled
+        // completely as long as the copies stay under fullUnrollSize nodes
+        static const int64_t fullUnrollIterations = 8;
+        static const size_t fullUnrollSize = 256;
+
+        // a Range loop i = start; i < stop; i = i + step with constant bounds
+        struct counted_loop
+        {
+            spark_node_t* variable;
+            int64_t start;
+            int64_t step;
+            int64_t iterations;
+        };
+
+        static bool readCountedLoop(const spark_node_t* loop, counted_loop& counted)
+        {
+            const auto init = loop->_children[0];
+            const auto condition = loop->_children[1];
+            const auto step = loop->_children[2];
+
+            if(init->_type != spark_nodetype::operation ||
+               init->_operator.id != Operator::Assignment ||
+               init->_children.front()->_type != spark_nodetype::symbol)
+            {
+                return false;
+            }
+
+            // wider counters could wrap computing the bounds
+            const auto variable = init->_children.front();
+            const auto type = variable->_symbol.type;
+            if(!isIntegerScalar(type) || integerBits(type.GetPrimitive()) > 32)
+            {
+                return false;
+            }
+
+            const auto isVariable = [variable](const spark_node_t* node)
+            {
+                return node->_type == spark_nodetype::symbol && node->_symbol.id == variable->_symbol.id;
+            };
+
+            int64_t start = 0;
+            int64_t stop = 0;
+            int64_t increment = 0;
+            if(!readInteger(init->_children.back(), start) ||
+               condition->_type != spark_nodetype::operation ||
+               condition->_operator.id != Operator::LessThan ||
+               !isVariable(condition->_children.front()) ||
+               !readInteger(condition->_children.back(), stop) ||
+               step->_type != spark_nodetype::operation ||
+               step->_operator.id != Operator::Assignment ||
+               !isVariable(step->_children.front()))
+            {
+                return false;
+            }
+
+            const auto sum = step->_children.back();
+            if(sum->_type != spark_nodetype::operation || sum->_operator.id != Operator::Add)
+            {
+                return false;
+            }
+            const bool counts = (isVariable(sum->_children.front()) && readInteger(sum->_children.back(), increment)) ||
+                                (isVariable(sum->_children.back()) && readInteger(sum->_children.front(), increment));
+            if(!counts || increment <= 0)
+            {
+                return false;
+            }
+
+            counted.variable = variable;
+            counted.start = start;
+            counted.step = increment;
+            counted.iterations = (start < stop) ? (stop - start + increment - 1) / increment : 0;
+            return true;
+        }
+
+        // whether node breaks out of the loop being unrolled or stores to its variable
+        static bool preventsUnrolling(const spark_node_t* node, spark_symbolid_t variable, bool innerLoop)
+        {
+            switch(node->_type)
+            {
+                case spark_nodetype::operation:
+                {
+                    const auto op = node->_operator.id;
+                    if(op == Operator::Break && !innerLoop)
+                    {
+                        return true;
+                    }
+                    if(op == Operator::Assignment || op == Operator::AddressOf || isIncrementOrDecrement(op))
+                    {
+                        auto symbol = lvalueSymbol(node->_children.front());
+                        if(symbol != nullptr && symbol->_symbol.id == variable)
+                        {
+                            return true;
+                        }
+                    }
+                    break;
+                }
+                case spark_nodetype::control:
+                    // breaks in a nested loop only leave that loop
+                    innerLoop = innerLoop || node->_control == Control::While || node->_control == Control::For;
+                    break;
+                case spark_nodetype::function:
+                    return false;
+                default:
+                    break;
+            }
+
+            return std::any_of(node->_children.begin(), node->_children.end(), [variable, innerLoop](const spark_node_t* child)
+            {
+                return preventsUnrolling(child, variable, innerLoop);
+            });
+        }
+
+        typedef std::unordered_map<spark_symbolid_t, uint32_t> occurrence_map;
+
+        static void countOccurrences(const spark_node_t* node, occurrence_map& occurrences)
+        {
+            if(node->_type == spark_nodetype::symbol)
+            {
+                occurrences[node->_symbol.id]++;
+            }
+            else if(node->_type != spark_nodetype::function)
+            {
+                for(auto child : node->_children)
+                {
+                    countOccurrences(child, occurrences);
+                }
+            }
+        }
+
+        // copy of a loop body for a single iteration, reading value in place of the loop
+        // variable; variables only used inside the body are renamed so each copy declares its own
+        static spark_node_t* cloneIteration(spark_node_t* node, const counted_loop& counted, spark_node_t* value,
+                                            const std::unordered_set<spark_symbolid_t>& locals,
+                                            std::unordered_map<spark_symbolid_t, spark_node_t*>& renamed)
+        {
+            switch(node->_type)
+            {
+                case spark_nodetype::symbol:
+                {
+                    const auto id = node->_symbol.id;
+                    if(id == counted.variable->_symbol.id)
+                    {
+                        return value;
+                    }
+                    if(locals.count(id) == 0)
+                    {
+                        return node;
+                    }
+
+                    auto& copy = renamed[id];
+                    if(copy == nullptr)
+                    {
+                        copy = create_symbol_node(node->_symbol.type);
+                    }
+                    return copy;
+                }
+                case spark_nodetype::operation:
+                case spark_nodetype::vector:
+                case spark_nodetype::control:
+                case spark_nodetype::scope_block:
+                {
+                    auto copy = clone_node(node);
+                    for(auto child : node->_children)
+                    {
+                        copy->_children.push_back(cloneIteration(child, counted, value, locals, renamed));
+                    }
+                    return copy;
+                }
+                default:
+                    // constants, properties, comments and called functions are shared
+                    return node;
+            }
+        }
+
+        // the block replacing loop once unrolled, null if it stays as it is; with a factor the
+        // loop runs that many copies of its body per iteration followed by any leftover
+        // iterations, otherwise short loops are replaced by a copy per iteration
+        static spark_node_t* unrollLoop(spark_node_t* root, spark_node_t* loop)
+        {
+            // a factor of 1 keeps the loop rolled
+            counted_loop counted;
+            if(loop->_unroll == 1 || !readCountedLoop(loop, counted))
+            {
+                return nullptr;
+            }
+
+            auto body = loop->_children.back();
+            if(preventsUnrolling(body, counted.variable->_symbol.id, false))
+            {
+                return nullptr;
+            }
+
+            int64_t factor = loop->_unroll;
+            if(factor == 0)
+            {
+                if(counted.iterations > fullUnrollIterations ||
+                   static_cast<size_t>(counted.iterations) * treeSize(body) > fullUnrollSize)
+                {
+                    return nullptr;
+                }
+                factor = counted.iterations;
+            }
+
+            // variables declared in the body appear nowhere else
+            occurrence_map everywhere;
+            occurrence_map inside;
+            for(auto function : root->_children)
+            {
+                for(auto child : function->_children)
+                {
+                    countOccurrences(child, everywhere);
+                }
+            }
+            countOccurrences(body, inside);
+            std::unordered_set<spark_symbolid_t> locals;
+            for(const auto& entry : inside)
+            {
+                if(entry.second == everywhere[entry.first])
+                {
+                    locals.insert(entry.first);
+                }
+            }
+
+            const auto type = counted.variable->_symbol.type;
+            const auto appendIteration = [&](spark_node_t* block, spark_node_t* value)
+            {
+                std::unordered_map<spark_symbolid_t, spark_node_t*> renamed;
+                block->_children.push_back(cloneIteration(body, counted, value, locals, renamed));
+            };
+
+            // empty blocks
+            auto result = clone_node(body);
+            const int64_t rolled = (counted.iterations > factor) ? counted.iterations / factor : 0;
+            if(rolled > 0)
+            {
+                const int64_t stride = counted.step * factor;
+
+                auto condition = clone_node(loop->_children[1]);
+                condition->_children.push_back(counted.variable);
+                condition->_children.push_back(makeInteger(type, counted.start + rolled * stride));
+
+                auto sum = create_operator_node(type, Operator::Add);
+                sum->_children.push_back(counted.variable);
+                sum->_children.push_back(makeInteger(type, stride));
+                auto step = clone_node(loop->_children[2]);
+                step->_children.push_back(counted.variable);
+                step->_children.push_back(sum);
+
+                auto unrolledBody = clone_node(body);
+                for(int64_t k = 0; k < factor; k++)
+                {
+                    auto value = counted.variable;
+                    if(k > 0)
+                    {
+                        value = create_operator_node(type, Operator::Add);
+                        value->_children.push_back(counted.variable);
+                        value->_children.push_back(makeInteger(type, k * counted.step));
+                    }
+                    appendIteration(unrolledBody, value);
+                }
+
+                // already unrolled, the compiler is asked not to do it again
+                auto unrolled = clone_node(loop);
+                unrolled->_unroll = 1;
+                unrolled->_children.push_back(loop->_children[0]);
+                unrolled->_children.push_back(condition);
+                unrolled->_children.push_back(step);
+                unrolled->_children.push_back(unrolledBody);
+                result->_children.push_back(unrolled);
+            }
+
+            for(int64_t k = rolled * factor; k < counted.iterations; k++)
+            {
+                appendIteration(result, makeInteger(type, counted.start + k * counted.step));
+            }
+            return result;
+        }
+
+        static void unrollNestedLoops(spark_node_t* root, spark_node_t* node, bool& changed)
+        {
+            for(size_t k = 0; k < node->_children.size(); k++)
+            {
+                auto child = node->_children[k];
+                if(child->_type != spark_nodetype::scope_block && child->_type != spark_nodetype::control)
+                {
+                    continue;
+                }
+
+                // inner loops first, so the outer ones see their final size
+                unrollNestedLoops(root, child, changed);
+                if(child->_type == spark_nodetype::control && child->_control == Control::For)
+                {
+                    if(auto replacement = unrollLoop(root, child))
+                    {
+                        node->_children[k] = replacement;
+                        changed = true;
+                    }
+                }
+            }
+        }
+
+        static bool unrollLoops(spark_node_t* root)
+        {
+            bool changed = false;
+            for(auto function : root->_children)
+            {
+                unrollNestedLoops(root, function->_children.back(), changed);
+            }
+            return changed;
+        }
+
+        /// Pass Manager
+
+        struct optimizer_pass
+        {
+            const char* name;
+            // returns whether the tree changed
+            bool (*run)(spark_node_t* root);
+        };
+
+        static const optimizer_pass passes[] =
+        {
+            {"fold_constants", foldConstants},
+            {"propagate_values", propagateValues},
+            {"unroll_loops", unrollLoops},
+            {"eliminate_dead_stores", eliminateDeadStores},
+            {"eliminate_common_subexpressions", eliminateCommonSubexpressions},
+        };
+
+        // SPARK_OPTIMIZE=0 turns the optimizer off
+        static bool optimizerEnabled()
+        {
+            static const bool enabled = []
+            {
+                const char* optimize = ::getenv("SPARK_OPTIMIZE");
+                return optimize == nullptr || ::strcmp(optimize, "0") != 0;
+            }();
+            return enabled;
+        }
+
+        void optimizeProgram(spark_node_t* root)
+        {
+            SPARK_ASSERT(root->_type == spark_nodetype::control && root->_control == Control::Root);
+
+            if(!optimizerEnabled())
+            {
+                return;
+            }
+
+            // each pass exposes work for the others, repeat until nothing changes
+            const uint32_t maxRounds = 8;
+            for(uint32_t round = 0; round < maxRounds; round++)
+            {
+                bool changed = false;
+                for(const auto& pass : passes)
+                {
+                    trace::scope span("optimizer", pass.name);
+                    changed = pass.run(root) || changed;
+                }
+
+                if(!changed)
+                {
+                    break;
+                }
+            }
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,13 @@
+#pragma once
+
+namespace spark
+{
+    namespace lib
+    {
+        // rewrites a program's tree in place before code generation: constant folding,
+        // algebraic simplification, constant and copy propagation, dead store elimination,
+        // common subexpression elimination and unrolling of loops with constant bounds;
+        // SPARK_OPTIMIZE=0 leaves the tree as written
+        void optimizeProgram(spark_node_t* root);
+    }
+}
\ No newline at end of file
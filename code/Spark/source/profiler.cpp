@@ -0,0 +1,203 @@
+#include "spark.hpp"
+
+#include "profiler.hpp"
+#include "error.hpp"
+
+namespace spark
+{
+    namespace lib
+    {
+        // recent durations kept per name for percentile estimates
+        static const size_t maxSamples = 4096;
+        // pending events at which completed ones are folded in without waiting
+        static const size_t maxPending = 1024;
+
+        profiler::~profiler()
+        {
+            for(auto& pending : this->_pending)
+            {
+                ::clReleaseEvent(pending.second);
+            }
+        }
+
+        uint64_t profiler::now()
+        {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+        void profiler::record(const char* name, cl_event event)
+        {
+            THROW_IF_OPENCL_FAILED(::clRetainEvent(event));
+
+            bool full = false;
+            {
+                std::lock_guard<std::mutex> lock(this->_mutex);
+                this->_pending.emplace_back(name, event);
+                full = this->_pending.size() >= this->_collect_at;
+            }
+            if(full)
+            {
+                // the launch path never waits, commands still running stay pending
+                this->collect(false);
+            }
+        }
+
+        void profiler::record(const char* name, const timing& times)
+        {
+            std::lock_guard<std::mutex> lock(this->_mutex);
+            this->add(name, times);
+        }
+
+        void profiler::collect(bool wait)
+        {
+            std::vector<std::pair<std::string, cl_event>> pending;
+            {
+                std::lock_guard<std::mutex> lock(this->_mutex);
+                pending.swap(this->_pending);
+            }
+
+            std::vector<std::pair<std::string, timing>> timings;
+            std::vector<std::pair<std::string, cl_event>> running;
+            cl_int result = CL_SUCCESS;
+            for(auto& entry : pending)
+            {
+                cl_event event = entry.second;
+                timing times = {};
+                if(result == CL_SUCCESS)
+                {
+                    if(wait)
+                    {
+                        result = ::clWaitForEvents(1, &event);
+                    }
+                    else
+                    {
+                        cl_int status = CL_COMPLETE;
+                        result = ::clGetEventInfo(event, CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(status), &status, nullptr);
+                        if(result == CL_SUCCESS && status > CL_COMPLETE)
+                        {
+                            running.push_back(entry);
+                            continue;
+                        }
+                        // failed commands have no timestamps
+                        if(status < CL_COMPLETE)
+                        {
+                            ::clReleaseEvent(event);
+                            continue;
+                        }
+                    }
+                }
+                if(result == CL_SUCCESS)
+                {
+                    result = ::clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_QUEUED, sizeof(times.queued), &times.queued, nullptr);
+                }
+                if(result == CL_SUCCESS)
+                {
+                    result = ::clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_SUBMIT, sizeof(times.submit), &times.submit, nullptr);
+                }
+                if(result == CL_SUCCESS)
+                {
+                    result = ::clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(times.start), &times.start, nullptr);
+                }
+                if(result == CL_SUCCESS)
+                {
+                    result = ::clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(times.end), &times.end, nullptr);
+                }
+                if(result == CL_SUCCESS)
+                {
+                    timings.emplace_back(entry.first, times);
+                }
+                ::clReleaseEvent(event);
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(this->_mutex);
+                for(const auto& entry : timings)
+                {
+                    this->add(entry.first, entry.second);
+                }
+
+                // still running commands go ahead of anything recorded meanwhile; the next
+                // scan waits until the backlog has doubled so scans stay amortized
+                running.insert(running.end(), this->_pending.begin(), this->_pending.end());
+                this->_pending.swap(running);
+                this->_collect_at = std::max(maxPending, this->_pending.size() * 2);
+            }
+            THROW_IF_OPENCL_FAILED(result);
+        }
+
+        // caller holds _mutex
+        void profiler::add(const std::string& name, const timing& times)
+        {
+            const uint64_t duration = times.end - times.start;
+            auto& aggregate = this->_aggregates[name];
+            if(aggregate.count == 0 || duration < aggregate.min)
+            {
+                aggregate.min = duration;
+            }
+            aggregate.max = std::max(aggregate.max, duration);
+            aggregate.count++;
+            aggregate.total += duration;
+            aggregate.total_queued += times.start - times.queued;
+
+            if(aggregate.samples.size() < maxSamples)
+            {
+                aggregate.samples.push_back(duration);
+            }
+            else
+            {
+                aggregate.samples[aggregate.next_sample] = duration;
+                aggregate.next_sample = (aggregate.next_sample + 1) % maxSamples;
+            }
+        }
+
+        std::vector<spark_profile_stats_t> profiler::get_stats()
+        {
+            this->collect(true);
+
+            std::lock_guard<std::mutex> lock(this->_mutex);
+            std::vector<spark_profile_stats_t> result;
+            for(const auto& entry : this->_aggregates)
+            {
+                const auto& aggregate = entry.second;
+
+                spark_profile_stats_t stats = {};
+                ::snprintf(stats.name, sizeof(stats.name), "%s", entry.first.c_str());
+                stats.count = aggregate.count;
+                stats.total_ns = aggregate.total;
+                stats.min_ns = aggregate.min;
+                stats.max_ns = aggregate.max;
+                stats.total_queued_ns = aggregate.total_queued;
+
+                auto samples = aggregate.samples;
+                if(!samples.empty())
+                {
+                    auto percentile = [&](size_t p)
+                    {
+                        auto nth = samples.begin() + (samples.size() - 1) * p / 100;
+                        std::nth_element(samples.begin(), nth, samples.end());
+                        return *nth;
+                    };
+                    stats.p50_ns = percentile(50);
+                    stats.p99_ns = percentile(99);
+                }
+                result.push_back(stats);
+            }
+
+            // hottest first
+            std::sort(result.begin(), result.end(),
+                [](const spark_profile_stats_t& left, const spark_profile_stats_t& right)
+                {
+                    return left.total_ns > right.total_ns;
+                });
+            return result;
+        }
+
+        void profiler::reset()
+        {
+            this->collect(true);
+
+            std::lock_guard<std::mutex> lock(this->_mutex);
+            this->_aggregates.clear();
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,62 @@
+#pragma once
+
+namespace spark
+{
+    namespace lib
+    {
+        // collects queued/submit/start/end timestamps of device commands and aggregates
+        // them per name; opencl timestamps are read lazily from retained events
+        class profiler
+        {
+        public:
+            profiler() = default;
+            ~profiler();
+
+            profiler(const profiler&) = delete;
+            profiler& operator=(const profiler&) = delete;
+
+            struct timing
+            {
+                uint64_t queued;
+                uint64_t submit;
+                uint64_t start;
+                uint64_t end;
+            };
+
+            // event must come from a profiling enabled queue, a reference is retained
+            void record(const char* name, cl_event event);
+            // host executed commands (cpu backend)
+            void record(const char* name, const timing& times);
+
+            // folds recorded events into the aggregates, waiting for them all or
+            // only taking those already complete
+            void collect(bool wait);
+            std::vector<spark_profile_stats_t> get_stats();
+            void reset();
+
+            // monotonic nanoseconds for host timings
+            static uint64_t now();
+
+        private:
+            struct aggregate
+            {
+                uint64_t count = 0;
+                uint64_t total = 0;
+                uint64_t min = 0;
+                uint64_t max = 0;
+                uint64_t total_queued = 0;
+                // ring of recent durations for percentiles
+                std::vector<uint64_t> samples;
+                size_t next_sample = 0;
+            };
+
+            void add(const std::string& name, const timing& times);
+
+            std::mutex _mutex;
+            std::vector<std::pair<std::string, cl_event>> _pending;
+            // _pending size that triggers the next non-blocking collect
+            size_t _collect_at = 1024;
+            std::unordered_map<std::string, aggregate> _aggregates;
+        };
+    }
+}
\ No newline at end of file
@@ -10,7 +10,7 @@ namespace spark
         public:
             unique_any() {}
             unique_any(element_type val) : _val(val), _empty(false) {}
-            unique_any(unique_any&& that) : _val(that.val), _empty(that.empty)
+            unique_any(unique_any&& that) : _val(that._val), _empty(that._empty)
             {
                 that._val = {};
                 that._empty = true;
@@ -5,224 +5,1944 @@
 #include "resource.hpp"
 #include "node.hpp"
 #include "codegen.hpp"
+#include "analysis.hpp"
+#include "optimizer.hpp"
+#include "cache.hpp"
+#include "memory_pool.hpp"
+#include "autotune.hpp"
+#include "profiler.hpp"
+#include "trace.hpp"
+#include "log.hpp"
+
+// posix
+#include <unistd.h>
 
 using std::string;
 using std::unique_ptr;
 using std::make_unique;
 
-// lets us use OpenCL release functions with unique_any type
-#pragma GCC diagnostic ignored "-Wignored-attributes"
+using spark::shared::Backend;
+using spark::shared::DeviceType;
+using spark::shared::BufferFlags;
+using spark::shared::MapAccess;
+using spark::shared::Partition;
 
 namespace spark
 {
     namespace lib
     {
-        using unique_cl_context = unique_any<cl_context, decltype(&::clReleaseContext), &::clReleaseContext>;
-        using unique_command_queue = unique_any<cl_command_queue, decltype(&::clReleaseCommandQueue), &::clReleaseCommandQueue>;
-        using unique_cl_program = unique_any<cl_program, decltype(&::clReleaseProgram), &::clReleaseProgram>;
-        using unique_cl_kernel = unique_any<cl_kernel, decltype(&::clReleaseKernel), &::clReleaseKernel>;
-        using unique_cl_mem = unique_any<cl_mem, decltype(&::clReleaseMemObject), &::clReleaseMemObject>;
+        thread_local spark_context* spark_context::current = nullptr;
 
-        /// Spark Context
+        static cl_device_type toOpenCLDeviceType(DeviceType type)
+        {
+            switch(type)
+            {
+                case DeviceType::Default:     return CL_DEVICE_TYPE_DEFAULT;
+                case DeviceType::Cpu:         return CL_DEVICE_TYPE_CPU;
+                case DeviceType::Gpu:         return CL_DEVICE_TYPE_GPU;
+                case DeviceType::Accelerator: return CL_DEVICE_TYPE_ACCELERATOR;
+                case DeviceType::All:         return CL_DEVICE_TYPE_ALL;
+                default:
+                    THROW_IF_FALSE(type < DeviceType::Count);
+            }
+            return CL_DEVICE_TYPE_ALL;
+        }
 
-        struct spark_context
+        static DeviceType fromOpenCLDeviceType(cl_device_type type)
         {
-            spark_context();
+            if(type & CL_DEVICE_TYPE_GPU) return DeviceType::Gpu;
+            if(type & CL_DEVICE_TYPE_CPU) return DeviceType::Cpu;
+            if(type & CL_DEVICE_TYPE_ACCELERATOR) return DeviceType::Accelerator;
+            return DeviceType::Default;
+        }
 
-            unique_cl_context context;
-            cl_device_id device_id;
-            unique_command_queue command_queue;
+        static std::vector<cl_platform_id> getPlatforms()
+        {
+            cl_uint platformCount = 0;
+            // the ICD loader reports a machine without platforms as an error, treat it as empty
+            ::clGetPlatformIDs(0, nullptr, &platformCount);
+            if(platformCount == 0)
+            {
+                return {};
+            }
 
-            static thread_local spark_context* current;
-        };
-        thread_local spark_context* spark_context::current = nullptr;
+            std::vector<cl_platform_id> platforms(platformCount);
+            THROW_IF_OPENCL_FAILED(::clGetPlatformIDs(platformCount, platforms.data(), nullptr));
+            return platforms;
+        }
 
-        struct spark_buffer
+        static std::vector<cl_device_id> getDevices(cl_platform_id platform, DeviceType type)
         {
-            spark_buffer(size_t size, const void* data);
-            void write(size_t offset, size_t bytes, const void* data);
-            void read(size_t offset, size_t bytes, void* dest) const;
-            void zero(size_t offset, size_t bytes);
+            cl_uint deviceCount = 0;
+            cl_int err = ::clGetDeviceIDs(platform, toOpenCLDeviceType(type), 0, nullptr, &deviceCount);
+            if(err == CL_DEVICE_NOT_FOUND || deviceCount == 0)
+            {
+                return {};
+            }
+            THROW_IF_OPENCL_FAILED(err);
 
-            unique_cl_mem _mem;
-        };
+            std::vector<cl_device_id> devices(deviceCount);
+            THROW_IF_OPENCL_FAILED(::clGetDeviceIDs(platform, toOpenCLDeviceType(type), deviceCount, devices.data(), nullptr));
+            return devices;
+        }
+
+        static void getDeviceInfo(cl_device_id device, uint32_t platformIndex, uint32_t deviceIndex, spark_device_info_t* info)
+        {
+            ::memset(info, 0, sizeof(*info));
+
+            THROW_IF_OPENCL_FAILED(::clGetDeviceInfo(device, CL_DEVICE_NAME, sizeof(info->name), info->name, nullptr));
+            THROW_IF_OPENCL_FAILED(::clGetDeviceInfo(device, CL_DEVICE_VENDOR, sizeof(info->vendor), info->vendor, nullptr));
+            THROW_IF_OPENCL_FAILED(::clGetDeviceInfo(device, CL_DEVICE_VERSION, sizeof(info->version), info->version, nullptr));
+
+            cl_device_type type;
+            cl_uint computeUnits;
+            size_t maxWorkGroupSize;
+            cl_ulong localMemSize;
+            cl_ulong globalMemSize;
+            THROW_IF_OPENCL_FAILED(::clGetDeviceInfo(device, CL_DEVICE_TYPE, sizeof(type), &type, nullptr));
+            THROW_IF_OPENCL_FAILED(::clGetDeviceInfo(device, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(computeUnits), &computeUnits, nullptr));
+            THROW_IF_OPENCL_FAILED(::clGetDeviceInfo(device, CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(maxWorkGroupSize), &maxWorkGroupSize, nullptr));
+            THROW_IF_OPENCL_FAILED(::clGetDeviceInfo(device, CL_DEVICE_LOCAL_MEM_SIZE, sizeof(localMemSize), &localMemSize, nullptr));
+            THROW_IF_OPENCL_FAILED(::clGetDeviceInfo(device, CL_DEVICE_GLOBAL_MEM_SIZE, sizeof(globalMemSize), &globalMemSize, nullptr));
+
+            info->platform_index = platformIndex;
+            info->device_index = deviceIndex;
+            info->type = static_cast<spark_device_type_t>(fromOpenCLDeviceType(type));
+            info->compute_units = computeUnits;
+            info->max_work_group_size = maxWorkGroupSize;
+            info->local_mem_size = localMemSize;
+            info->global_mem_size = globalMemSize;
+        }
+
+        static void getHostInfo(size_t threadCount, spark_device_info_t* info)
+        {
+            ::memset(info, 0, sizeof(*info));
+
+            ::snprintf(info->name, sizeof(info->name), "host");
+            ::snprintf(info->vendor, sizeof(info->vendor), "spark");
+            ::snprintf(info->version, sizeof(info->version), "native");
+            info->type = static_cast<spark_device_type_t>(DeviceType::Cpu);
+            info->compute_units = static_cast<uint32_t>(threadCount);
+            info->max_work_group_size = 1;
+            info->global_mem_size = static_cast<uint64_t>(::sysconf(_SC_PHYS_PAGES)) * static_cast<uint64_t>(::sysconf(_SC_PAGE_SIZE));
+        }
+
+        // device_index is the device's position among all devices on the platform, whatever
+        // type filter it was enumerated with; the device must also be of the requested type
+        static cl_device_id selectDevice(DeviceType type, uint32_t platformIndex, uint32_t deviceIndex)
+        {
+            // indices come from the caller's environment, so these are errors rather than asserts
+            auto platforms = getPlatforms();
+            if(platformIndex >= platforms.size())
+            {
+                throw_error("platform index out of range", __FILE__, __LINE__);
+            }
+
+            auto devices = getDevices(platforms[platformIndex], DeviceType::All);
+            if(deviceIndex >= devices.size())
+            {
+                throw_error("device index out of range", __FILE__, __LINE__);
+            }
+
+            auto matching = getDevices(platforms[platformIndex], type);
+            if(std::find(matching.begin(), matching.end(), devices[deviceIndex]) == matching.end())
+            {
+                throw_error("device is not of the requested type", __FILE__, __LINE__);
+            }
+            return devices[deviceIndex];
+        }
+
+        // SPARK_SUBDEVICES=n divides a lone device into n equal sub-devices for multi-device
+        // contexts, so split launches can be exercised on one device; empty if not requested
+        // or the device can't be partitioned
+        static std::vector<cl_device_id> partitionDevice(cl_device_id device)
+        {
+            const char* requested = ::getenv("SPARK_SUBDEVICES");
+            const cl_uint count = requested != nullptr ? static_cast<cl_uint>(::strtoul(requested, nullptr, 10)) : 0;
+            cl_uint computeUnits = 0;
+            if(count < 2 ||
+               ::clGetDeviceInfo(device, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(computeUnits), &computeUnits, nullptr) != CL_SUCCESS ||
+               computeUnits < count)
+            {
+                return {};
+            }
+
+            const cl_device_partition_property properties[] = {CL_DEVICE_PARTITION_EQUALLY, static_cast<cl_device_partition_property>(computeUnits / count), 0};
+            cl_uint created = 0;
+            if(::clCreateSubDevices(device, properties, 0, nullptr, &created) != CL_SUCCESS || created < 2)
+            {
+                return {};
+            }
+            std::vector<cl_device_id> subDevices(created);
+            if(::clCreateSubDevices(device, properties, created, subDevices.data(), nullptr) != CL_SUCCESS)
+            {
+                return {};
+            }
+            return subDevices;
+        }
 
-        struct spark_kernel
+        /// Spark Context
+
+        // SPARK_PROFILE=1 turns profiling on for every new context
+        static bool profilingRequested()
         {
-            spark_kernel(string&& source);
+            const char* profile = ::getenv("SPARK_PROFILE");
+            return profile != nullptr && *profile != 0 && ::strcmp(profile, "0") != 0;
+        }
 
-            void set_arg(uint32_t index, const spark_buffer* buffer);
-            void set_arg(uint32_t index, size_t size, const void* data);
+        // times a command executed on the host, for the cpu backend
+        struct host_profile_scope
+        {
+            host_profile_scope(spark_context* context, const char* name)
+            : _profiler(context->command_profiler.get())
+            , _name(name)
+            , _start(_profiler ? profiler::now() : 0)
+            { }
 
-            void run(const size_t(&work_dimensions)[3]);
+            ~host_profile_scope()
+            {
+                if(this->_profiler)
+                {
+                    this->_profiler->record(this->_name, {this->_start, this->_start, this->_start, profiler::now()});
+                }
+            }
 
-            string _source;
-            unique_cl_program _program;
-            unique_cl_kernel _kernel;
+            profiler* _profiler;
+            const char* _name;
+            uint64_t _start;
         };
 
-        spark_context::spark_context()
+        // hands a device command's event to the profiler, if profiling
+        static cl_event profileEvent(spark_context* context, const char* name, cl_event event)
+        {
+            if(context->command_profiler)
+            {
+                context->command_profiler->record(name, event);
+            }
+            return event;
+        }
+
+        static cl_command_queue createCommandQueue(cl_context context, cl_device_id device, bool out_of_order, bool profiling)
+        {
+            cl_command_queue_properties properties = 0;
+            if(out_of_order)
+            {
+                properties |= CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE;
+            }
+            if(profiling)
+            {
+                properties |= CL_QUEUE_PROFILING_ENABLE;
+            }
+
+            cl_int createCommandQueueError = CL_SUCCESS;
+            cl_command_queue clCommandQueue = ::clCreateCommandQueue(context, device, properties, &createCommandQueueError);
+            THROW_IF_OPENCL_FAILED(createCommandQueueError);
+            return clCommandQueue;
+        }
+
+        spark_context::spark_context(Backend backend, const std::vector<cl_device_id>& devices, const std::vector<cl_device_id>& split_devices)
+        : backend(backend)
         {
-            // get our platform id
-            cl_platform_id platformId;
-            THROW_IF_OPENCL_FAILED(::clGetPlatformIDs(1, &platformId, nullptr));
+            // SPARK_BUILD_THREADS=0 builds kernels synchronously in their constructor
+            size_t buildThreads = std::thread::hardware_concurrency();
+            if(const char* threads = ::getenv("SPARK_BUILD_THREADS"))
+            {
+                buildThreads = ::strtoul(threads, nullptr, 10);
+            }
+            if(buildThreads > 0)
+            {
+                this->build_pool = make_unique<task_pool>(buildThreads);
+            }
+
+            if(backend == Backend::Cpu)
+            {
+                size_t threadCount = std::thread::hardware_concurrency();
+                if(const char* threads = ::getenv("SPARK_CPU_THREADS"))
+                {
+                    threadCount = ::strtoul(threads, nullptr, 10);
+                }
+                this->worker_pool = make_unique<thread_pool>(std::max<size_t>(threadCount, 1));
+                getHostInfo(this->worker_pool->thread_count(), &this->device_info);
+                // work runs synchronously on the calling thread, queues only exist as indices
+                this->queues.emplace_back();
+                this->set_profiling(profilingRequested());
+                LOG_INFO("created cpu context with %u threads", this->device_info.compute_units);
+                return;
+            }
 
-            // get device id
-            THROW_IF_OPENCL_FAILED(::clGetDeviceIDs(platformId, CL_DEVICE_TYPE_GPU, 1, &this->device_id, nullptr));
+            // default to the first gpu found on any platform
+            cl_device_id device = devices.empty() ? nullptr : devices.front();
+            if(device == nullptr)
+            {
+                for(auto platform : getPlatforms())
+                {
+                    auto devices = getDevices(platform, DeviceType::Gpu);
+                    if(!devices.empty())
+                    {
+                        device = devices.front();
+                        break;
+                    }
+                }
+                THROW_IF_NULL(device);
+            }
+            this->device_id = device;
+
+            // remember where the device came from so info queries report real indices
+            auto platforms = getPlatforms();
+            cl_platform_id devicePlatform;
+            THROW_IF_OPENCL_FAILED(::clGetDeviceInfo(device, CL_DEVICE_PLATFORM, sizeof(devicePlatform), &devicePlatform, nullptr));
+            const auto platformIndex = static_cast<uint32_t>(std::find(platforms.begin(), platforms.end(), devicePlatform) - platforms.begin());
+            auto siblings = getDevices(devicePlatform, DeviceType::All);
+            const auto deviceIndex = static_cast<uint32_t>(std::find(siblings.begin(), siblings.end(), device) - siblings.begin());
+            getDeviceInfo(device, platformIndex, deviceIndex, &this->device_info);
+
+            char driverVersion[256] = {0};
+            THROW_IF_OPENCL_FAILED(::clGetDeviceInfo(device, CL_DRIVER_VERSION, sizeof(driverVersion), driverVersion, nullptr));
+            this->driver_version = driverVersion;
+
+            // launches are divided between every given device unless told otherwise
+            const auto& splitDevices = (split_devices.empty() && devices.size() > 1) ? devices : split_devices;
 
             // get opencl context
+            std::vector<cl_device_id> contextDevices = {this->device_id};
+            for(auto splitDevice : splitDevices)
+            {
+                if(splitDevice != this->device_id)
+                {
+                    contextDevices.push_back(splitDevice);
+                }
+            }
+            for(auto other : devices)
+            {
+                if(std::find(contextDevices.begin(), contextDevices.end(), other) == contextDevices.end())
+                {
+                    contextDevices.push_back(other);
+                }
+            }
             cl_int createContextError = CL_SUCCESS;
-            cl_context clContext = ::clCreateContext(nullptr, 1, &this->device_id, nullptr, nullptr, &createContextError);
+            cl_context clContext = ::clCreateContext(nullptr, static_cast<cl_uint>(contextDevices.size()), contextDevices.data(), nullptr, nullptr, &createContextError);
             THROW_IF_OPENCL_FAILED(createContextError);
             this->context.reset(clContext);
 
-            // create command queue
-            cl_int createCommandQueueError = CL_SUCCESS;
-            cl_command_queue clCommandQueue = ::clCreateCommandQueue(this->context.get(), this->device_id, 0, &createCommandQueueError);
-            THROW_IF_OPENCL_FAILED(createCommandQueueError);
-            this->command_queue.reset(clCommandQueue);
+            // create default command queue
+            this->queues.emplace_back();
+            this->queues.front().queue.reset(createCommandQueue(this->context.get(), this->device_id, false, false));
+
+            if(splitDevices.size() > 1)
+            {
+                for(auto splitDevice : splitDevices)
+                {
+                    this->split_devices.emplace_back();
+                    auto& state = this->split_devices.back();
+                    state.id = splitDevice;
+                    state.queue.reset(createCommandQueue(this->context.get(), splitDevice, false, true));
+                    cl_uint computeUnits = 0;
+                    THROW_IF_OPENCL_FAILED(::clGetDeviceInfo(splitDevice, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(computeUnits), &computeUnits, nullptr));
+                    state.compute_units = computeUnits;
+                }
+                // partitions run on their own queues, so buffers need to know what's still using them
+                this->track_dependencies = true;
+                LOG_INFO("splitting launches across %u devices", static_cast<uint32_t>(splitDevices.size()));
+            }
+
+            if(profilingRequested())
+            {
+                this->set_profiling(true);
+            }
+
+            LOG_INFO("created opencl context on %s (%s, %s, driver %s)", this->device_info.name, this->device_info.vendor, this->device_info.version, this->driver_version.c_str());
+        }
+
+        void spark_context::set_profiling(bool enabled)
+        {
+            if(enabled == (this->command_profiler != nullptr))
+            {
+                return;
+            }
+
+            if(this->backend == Backend::OpenCL)
+            {
+                // profiling is a queue property, so swap in new queues once the old ones drain
+                std::lock_guard<std::mutex> lock(this->queue_mutex);
+                for(auto& state : this->queues)
+                {
+                    THROW_IF_OPENCL_FAILED(::clFinish(state.queue.get()));
+                    state.queue.reset(createCommandQueue(this->context.get(), this->device_id, state.out_of_order, enabled));
+                }
+            }
+
+            if(enabled)
+            {
+                this->command_profiler = make_unique<profiler>();
+            }
+            else
+            {
+                this->command_profiler.reset();
+            }
+        }
+
+        uint32_t spark_context::create_queue(bool out_of_order)
+        {
+            std::lock_guard<std::mutex> lock(this->queue_mutex);
+            const auto index = static_cast<uint32_t>(this->queues.size());
+
+            if(this->backend == Backend::Cpu)
+            {
+                this->queues.emplace_back();
+                return index;
+            }
+
+            if(out_of_order)
+            {
+                cl_command_queue_properties supported = 0;
+                THROW_IF_OPENCL_FAILED(::clGetDeviceInfo(this->device_id, CL_DEVICE_QUEUE_PROPERTIES, sizeof(supported), &supported, nullptr));
+                if((supported & CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE) == 0)
+                {
+                    LOG_WARNING("%s doesn't support out-of-order queues, queue %u will execute in order", this->device_info.name, index);
+                    out_of_order = false;
+                }
+            }
+
+            // commands enqueued so far weren't tracked, so let them finish before anything can overlap them
+            if(!this->track_dependencies)
+            {
+                for(auto& state : this->queues)
+                {
+                    THROW_IF_OPENCL_FAILED(::clFinish(state.queue.get()));
+                }
+                this->track_dependencies = true;
+            }
+
+            this->queues.emplace_back();
+            auto& state = this->queues.back();
+            state.out_of_order = out_of_order;
+            try
+            {
+                state.queue.reset(createCommandQueue(this->context.get(), this->device_id, out_of_order, this->command_profiler != nullptr));
+            }
+            catch(...)
+            {
+                this->queues.pop_back();
+                throw;
+            }
+            LOG_DEBUG("created %s command queue %u", out_of_order ? "out-of-order" : "in-order", index);
+            return index;
+        }
+
+        void spark_context::set_current_queue(uint32_t queue)
+        {
+            std::lock_guard<std::mutex> lock(this->queue_mutex);
+            THROW_IF_FALSE(queue < this->queues.size());
+            this->current_queue = queue;
+        }
+
+        cl_command_queue spark_context::get_queue() const
+        {
+            std::lock_guard<std::mutex> lock(this->queue_mutex);
+            return this->queues[this->current_queue].queue.get();
+        }
+
+        bool spark_context::is_out_of_order() const
+        {
+            std::lock_guard<std::mutex> lock(this->queue_mutex);
+            return this->queues[this->current_queue].out_of_order;
         }
 
         /// Spark Kernel
 
+        // kernels are named after a hash of their source
+        static string kernelName(const string& source)
+        {
+            char name[32];
+            ::snprintf(name, sizeof(name), "kernel_%016llx", static_cast<unsigned long long>(std::hash<string>()(source)));
+            return name;
+        }
+
+        // writes generated source to $SPARK_DUMP_SOURCE_DIR/<kernel name>.<extension> when set
+        static void dumpSource(const string& name, const string& source, const char* extension)
+        {
+            const char* directory = ::getenv("SPARK_DUMP_SOURCE_DIR");
+            if(directory == nullptr || *directory == 0)
+            {
+                return;
+            }
+
+            const string path = string(directory) + "/" + name + "." + extension;
+            FILE* file = ::fopen(path.c_str(), "w");
+            if(file == nullptr)
+            {
+                LOG_WARNING("unable to dump kernel source to %s: %s", path.c_str(), ::strerror(errno));
+                return;
+            }
+            ::fwrite(source.data(), 1, source.size(), file);
+            ::fclose(file);
+        }
+
+        // options passed to clBuildProgram, also part of the binary cache key
+        static const char* buildOptions = "";
+
         spark_kernel::spark_kernel(string&& source)
         : _source(source)
         {
+            this->_name = kernelName(this->_source);
+
             auto currentContext = spark_context::current;
             THROW_IF_NULL(currentContext);
+            this->_context = currentContext;
+
+            // kernels with identical source share one program (or native module) per context,
+            // and only the first of them builds it
+            bool buildNow = false;
+            {
+                std::lock_guard<std::mutex> lock(currentContext->program_mutex);
+                const bool built = (currentContext->backend == Backend::Cpu)
+                    ? currentContext->native_modules.count(this->_source) > 0
+                    : currentContext->programs.count(this->_source) > 0;
+                auto pending = currentContext->pending_builds.find(this->_source);
+
+                if(built)
+                {
+                    currentContext->program_cache_hits++;
+                }
+                else if(pending != currentContext->pending_builds.end())
+                {
+                    currentContext->program_cache_hits++;
+                    this->_build = pending->second;
+                }
+                else
+                {
+                    currentContext->program_cache_misses++;
+                    if(currentContext->build_pool)
+                    {
+                        const string buildSource = this->_source;
+                        this->_build = currentContext->build_pool->submit([currentContext, buildSource]() { build(currentContext, buildSource); });
+                        currentContext->pending_builds[this->_source] = this->_build;
+                    }
+                    else
+                    {
+                        buildNow = true;
+                    }
+                }
+            }
+
+            // without a build pool everything happens here, so build errors surface from the constructor
+            if(!currentContext->build_pool)
+            {
+                if(buildNow)
+                {
+                    build(currentContext, this->_source);
+                }
+                wait_for_build();
+            }
+        }
+
+        void spark_kernel::build(spark_context* currentContext, const string& source)
+        {
+            try
+            {
+                if(currentContext->backend == Backend::Cpu)
+                {
+                    auto module = std::make_shared<native_module>(source);
+
+                    std::lock_guard<std::mutex> lock(currentContext->program_mutex);
+                    currentContext->native_modules[source] = module;
+                    currentContext->pending_builds.erase(source);
+                    return;
+                }
+
+                unique_cl_program program;
+                buildProgram(currentContext, source, program);
+
+                std::lock_guard<std::mutex> lock(currentContext->program_mutex);
+                auto& cached = currentContext->programs[source];
+                if(!cached)
+                {
+                    cached.reset(program.release());
+                }
+                currentContext->pending_builds.erase(source);
+            }
+            catch(...)
+            {
+                // the next kernel with this source tries again
+                std::lock_guard<std::mutex> lock(currentContext->program_mutex);
+                currentContext->pending_builds.erase(source);
+                throw;
+            }
+        }
+
+        void spark_kernel::wait_for_build()
+        {
+            if(this->_built)
+            {
+                return;
+            }
+
+            // rethrows the build's error on every call until the kernel is destroyed
+            if(this->_build.valid())
+            {
+                trace::scope span("wait", "wait_for_build");
+                this->_build.get();
+            }
+
+            auto currentContext = this->_context;
+            std::lock_guard<std::mutex> lock(currentContext->program_mutex);
+            if(currentContext->backend == Backend::Cpu)
+            {
+                auto found = currentContext->native_modules.find(this->_source);
+                THROW_IF_FALSE(found != currentContext->native_modules.end());
+                this->_native = make_unique<native_kernel>(found->second);
+            }
+            else
+            {
+                auto found = currentContext->programs.find(this->_source);
+                THROW_IF_FALSE(found != currentContext->programs.end());
+                THROW_IF_OPENCL_FAILED(::clRetainProgram(found->second.get()));
+                this->_program.reset(found->second.get());
+
+                // create kernel with 'main' entrypoint
+                cl_int createKernelError = CL_SUCCESS;
+                cl_kernel clKernel = ::clCreateKernel(this->_program.get(), "entry_point", &createKernelError);
+                THROW_IF_OPENCL_FAILED(createKernelError);
+                this->_kernel.reset(clKernel);
+            }
+            this->_built = true;
+        }
+
+        void spark_kernel::buildProgram(spark_context* currentContext, const string& source, unique_cl_program& program)
+        {
+            trace::scope span("build", "build_program");
+
+            // binaries are cached per device, so multi-device contexts always build from source
+            if(!currentContext->split_devices.empty())
+            {
+                buildFromSource(currentContext, source, program);
+                return;
+            }
 
+            // reuse a previously built binary for this source/device/driver if there is one
+            const auto cacheKey = kernel_cache::make_key(source, currentContext->device_info.name, currentContext->driver_version, buildOptions);
+            std::vector<uint8_t> binary;
+            if(kernel_cache::load(cacheKey, "clbin", binary))
+            {
+                const unsigned char* binaryData = binary.data();
+                const size_t binarySize = binary.size();
+                cl_int binaryStatus = CL_SUCCESS;
+                cl_int createProgramWithBinaryError = CL_SUCCESS;
+                cl_program clProgram = ::clCreateProgramWithBinary(currentContext->context.get(), 1, &currentContext->device_id, &binarySize, &binaryData, &binaryStatus, &createProgramWithBinaryError);
+                if(clProgram != nullptr)
+                {
+                    program.reset(clProgram);
+                }
+
+                // a stale or rejected binary falls back to building from source
+                if(createProgramWithBinaryError != CL_SUCCESS ||
+                   binaryStatus != CL_SUCCESS ||
+                   ::clBuildProgram(program.get(), 1, &currentContext->device_id, buildOptions, nullptr, nullptr) != CL_SUCCESS)
+                {
+                    LOG_WARNING("cached binary %016llx rejected by the driver, rebuilding from source", static_cast<unsigned long long>(cacheKey));
+                    program.reset();
+                }
+            }
+            // only a binary the driver accepted counts as a hit
+            kernel_cache::record(program.get() != nullptr);
+
+            if(!program)
+            {
+                buildFromSource(currentContext, source, program);
+
+                // save the device binary for the next run
+                size_t binarySize = 0;
+                THROW_IF_OPENCL_FAILED(::clGetProgramInfo(program.get(), CL_PROGRAM_BINARY_SIZES, sizeof(binarySize), &binarySize, nullptr));
+                if(binarySize > 0)
+                {
+                    binary.resize(binarySize);
+                    unsigned char* binaryData = binary.data();
+                    THROW_IF_OPENCL_FAILED(::clGetProgramInfo(program.get(), CL_PROGRAM_BINARIES, sizeof(binaryData), &binaryData, nullptr));
+                    kernel_cache::store(cacheKey, "clbin", binary.data(), binary.size());
+                }
+            }
+        }
+
+        void spark_kernel::buildFromSource(spark_context* currentContext, const string& source, unique_cl_program& program)
+        {
             // create program source
-            const char* sourceBuffer = this->_source.data();
-            const size_t sourceLength = this->_source.size();
+            const char* sourceBuffer = source.data();
+            const size_t sourceLength = source.size();
             cl_int createProgramWithSourceError = CL_SUCCESS;
             cl_program clProgram = ::clCreateProgramWithSource(currentContext->context.get(), 1, &sourceBuffer, &sourceLength, &createProgramWithSourceError);
             THROW_IF_OPENCL_FAILED(createProgramWithSourceError);
-            this->_program.reset(clProgram);
+            program.reset(clProgram);
 
-            // build program
-            cl_int buildProgramError = ::clBuildProgram(this->_program.get(), 1, &currentContext->device_id, nullptr, nullptr, nullptr);
+            // build program for every device of the context, launches that aren't split
+            // run on the primary device which may not be one of the split devices
+            std::vector<cl_device_id> devices = {currentContext->device_id};
+            for(const auto& splitDevice : currentContext->split_devices)
+            {
+                if(splitDevice.id != currentContext->device_id)
+                {
+                    devices.push_back(splitDevice.id);
+                }
+            }
+            trace::scope span("build", "clBuildProgram");
+            cl_int buildProgramError = ::clBuildProgram(program.get(), static_cast<cl_uint>(devices.size()), devices.data(), buildOptions, nullptr, nullptr);
             if(buildProgramError == CL_BUILD_PROGRAM_FAILURE)
             {
                 // get error log message
                 size_t logSize;
-                THROW_IF_OPENCL_FAILED(::clGetProgramBuildInfo(this->_program.get(), currentContext->device_id, CL_PROGRAM_BUILD_LOG, 0, nullptr, &logSize));
+                THROW_IF_OPENCL_FAILED(::clGetProgramBuildInfo(program.get(), currentContext->device_id, CL_PROGRAM_BUILD_LOG, 0, nullptr, &logSize));
 
                 // logSize includes null terminator
                 string logMessage(logSize - 1, 0);
-                THROW_IF_OPENCL_FAILED(::clGetProgramBuildInfo(this->_program.get(), currentContext->device_id, CL_PROGRAM_BUILD_LOG, logSize, const_cast<char*>(logMessage.data()), nullptr));
+                THROW_IF_OPENCL_FAILED(::clGetProgramBuildInfo(program.get(), currentContext->device_id, CL_PROGRAM_BUILD_LOG, logSize, const_cast<char*>(logMessage.data()), nullptr));
 
                 throw_error(logMessage.c_str(), __FILE__, __LINE__);
             }
             THROW_IF_OPENCL_FAILED(buildProgramError);
-
-            // create kernel with 'main' entrypoint
-            cl_int createKernelError = CL_SUCCESS;
-            cl_kernel clKernel = ::clCreateKernel(this->_program.get(), "entry_point", &createKernelError);
-            THROW_IF_OPENCL_FAILED(createKernelError);
-            this->_kernel.reset(clKernel);
         }
 
         void spark_kernel::set_arg(uint32_t index, const spark_buffer* buffer)
         {
-            auto mem = buffer->_mem.get();
-            THROW_IF_OPENCL_FAILED(::clSetKernelArg(this->_kernel.get(), index, sizeof(mem), &mem));
+            wait_for_build();
+            this->_arg_owner = 0;
+
+            // handles can be reused by a later allocation, so buffers are also compared by generation
+            if(this->_native)
+            {
+                const uint8_t* host = buffer->_host;
+                bind_arg(index, buffer, sizeof(host), &host);
+            }
+            else
+            {
+                auto mem = buffer->_mem.get();
+                bind_arg(index, buffer, sizeof(mem), &mem);
+            }
         }
 
         void spark_kernel::set_arg(uint32_t index, size_t size, const void* data)
         {
-            THROW_IF_OPENCL_FAILED(::clSetKernelArg(this->_kernel.get(), index, size, data));
+            wait_for_build();
+            this->_arg_owner = 0;
+            bind_arg(index, nullptr, size, data);
         }
 
-        void spark_kernel::run(const size_t(&work_dimensions)[3])
+        void spark_kernel::bind_arg(uint32_t index, const spark_buffer* buffer, size_t size, const void* data)
         {
-            auto currentContext = spark_context::current;
-            THROW_IF_NULL(currentContext);
+            if(index >= this->_args.size())
+            {
+                this->_args.resize(index + 1);
+            }
+            auto& arg = this->_args[index];
+            arg.buffer = buffer;
 
-            cl_event event;
-            THROW_IF_OPENCL_FAILED(::clEnqueueNDRangeKernel(currentContext->command_queue.get(), this->_kernel.get(), 3, nullptr, work_dimensions, nullptr, 0, nullptr, &event));
+            const uint64_t generation = (buffer != nullptr) ? buffer->_generation : 0;
+            if(arg.generation == generation && arg.size == size && ::memcmp(arg.data, data, size) == 0)
+            {
+                this->_arg_skips++;
+                return;
+            }
 
-            THROW_IF_OPENCL_FAILED(::clWaitForEvents(1, &event));
+            if(this->_native)
+            {
+                this->_native->set_arg(index, size, data);
+            }
+            else
+            {
+                THROW_IF_OPENCL_FAILED(::clSetKernelArg(this->_kernel.get(), index, size, data));
+            }
+            this->_arg_updates++;
+
+            // values too large for the shadow copy are always rebound
+            arg.generation = generation;
+            arg.size = 0;
+            if(size <= sizeof(arg.data))
+            {
+                ::memcpy(arg.data, data, size);
+                arg.size = static_cast<uint32_t>(size);
+            }
         }
 
-        // Spark Buffer
+        // blocks until event completes and releases it; null events are already complete
+        static void waitForEvent(cl_event event)
+        {
+            if(event != nullptr)
+            {
+                trace::scope span("wait", "wait_for_event");
+                unique_cl_event completion(event);
+                THROW_IF_OPENCL_FAILED(::clWaitForEvents(1, &event));
+            }
+        }
 
-        spark_buffer::spark_buffer(size_t size, const void* data)
+        static const cl_event* waitListData(const std::vector<cl_event>& waitList)
         {
-            auto currentContext = spark_context::current;
-            THROW_IF_NULL(currentContext);
+            return waitList.empty() ? nullptr : waitList.data();
+        }
 
-            cl_int createBufferError = CL_SUCCESS;
-            cl_mem_flags memFlags = (data == nullptr) ? CL_MEM_READ_WRITE : (CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR);
-            cl_mem clMem = ::clCreateBuffer(currentContext->context.get(), memFlags, size, const_cast<void*>(data), &createBufferError);
-            THROW_IF_OPENCL_FAILED(createBufferError);
-            // attach cl_mem
-            this->_mem.reset(clMem);
-            // zero fill
-            if(data == nullptr)
+        // waitList plus the commands still using buffer when the context tracks dependencies
+        static const std::vector<cl_event>& bufferWaitList(const spark_context* context, const spark_buffer& buffer, bool writes, const std::vector<cl_event>& waitList, std::vector<cl_event>& storage)
+        {
+            if(!context->track_dependencies)
             {
-                zero(0, size);
+                return waitList;
             }
+            storage = waitList;
+            buffer.add_dependencies(storage, writes);
+            return storage;
         }
 
-        void spark_buffer::write(size_t offset, size_t bytes, const void* data)
+        spark_work_size_t normalize_work_size(const spark_work_size_t& work_size)
         {
-            auto currentContext = spark_context::current;
-            THROW_IF_NULL(currentContext);
+            THROW_IF_FALSE(work_size.dimensions >= 1 && work_size.dimensions <= 3);
 
-            // copy data
-            if(data != nullptr)
+            spark_work_size_t result = {work_size.dimensions, {1, 1, 1}, {0, 0, 0}};
+            const bool hasLocalSize = work_size.local_size[0] != 0;
+            for(uint32_t k = 0; k < work_size.dimensions; k++)
             {
-                THROW_IF_OPENCL_FAILED(::clEnqueueWriteBuffer(currentContext->command_queue.get(), this->_mem.get(), CL_TRUE, offset, bytes, data, 0, nullptr, nullptr));
+                THROW_IF_FALSE(work_size.global_size[k] > 0);
+                result.global_size[k] = work_size.global_size[k];
+
+                if(hasLocalSize)
+                {
+                    // opencl 1.2 requires the global size to be a multiple of the local size
+                    if(work_size.local_size[k] == 0 || work_size.global_size[k] % work_size.local_size[k] != 0)
+                    {
+                        throw_error("local size does not divide the global size", __FILE__, __LINE__);
+                    }
+                    result.local_size[k] = work_size.local_size[k];
+                }
             }
-            // zero out buffer
-            else
+            if(hasLocalSize)
             {
-                zero(offset, bytes);
+                for(uint32_t k = work_size.dimensions; k < 3; k++)
+                {
+                    result.local_size[k] = 1;
+                }
             }
+            return result;
         }
 
-        void spark_buffer::read(size_t offset, size_t bytes, void* dest) const
+        cl_event spark_kernel::enqueue(const spark_work_size_t& work_size, const std::vector<cl_event>& waitList)
         {
             auto currentContext = spark_context::current;
             THROW_IF_NULL(currentContext);
+            wait_for_build();
+            trace::scope span("kernel", this->_name.c_str());
 
-            THROW_IF_OPENCL_FAILED(::clEnqueueReadBuffer(currentContext->command_queue.get(), const_cast<cl_mem>(this->_mem.get()), CL_TRUE, offset, bytes, dest, 0, nullptr, nullptr));
-        }
+            // cpu backend executes synchronously so everything it waits on has already finished
+            if(this->_native)
+            {
+                THROW_IF_NULL(currentContext->worker_pool);
+                host_profile_scope profile(currentContext, this->_name.c_str());
+                this->_native->run(*currentContext->worker_pool, work_size);
+                return nullptr;
+            }
 
-        void spark_buffer::zero(size_t offset, size_t bytes)
-        {
-            auto currentContext = spark_context::current;
-            THROW_IF_NULL(currentContext);
+            const size_t* localSize = nullptr;
+            if(work_size.local_size[0] != 0)
+            {
+                const size_t groupSize = work_size.local_size[0] * work_size.local_size[1] * work_size.local_size[2];
+                if(groupSize > this->get_max_work_group_size(currentContext))
+                {
+                    throw_error("local size exceeds the kernel's CL_KERNEL_WORK_GROUP_SIZE", __FILE__, __LINE__);
+                }
 
-            uint8_t zero = 0;
-            cl_event event;
-            THROW_IF_OPENCL_FAILED(::clEnqueueFillBuffer(currentContext->command_queue.get(), this->_mem.get(), &zero, sizeof(zero), offset, bytes, 0, nullptr, &event));
-            THROW_IF_OPENCL_FAILED(::clWaitForEvents(1, &event));
-        }
-    }
+                localSize = work_size.local_size;
+            }
+
+            // entry points using NormalizedIndex are passed the whole launch's size, split or not
+            if(this->_global_size_arg != no_argument)
+            {
+                const cl_uint globalSize[2] = {static_cast<cl_uint>(work_size.global_size[0]), static_cast<cl_uint>(work_size.global_size[1])};
+                THROW_IF_OPENCL_FAILED(::clSetKernelArg(this->_kernel.get(), this->_global_size_arg, sizeof(globalSize), globalSize));
+            }
+
+            // multi-device contexts divide the launch instead of tuning it
+            const bool split = !currentContext->split_devices.empty() && this->can_split();
+
+            // let the tuner pick the shape when the caller didn't
+            size_t tunedLocalSize[3];
+            uint64_t tuningToken = 0;
+            if(localSize == nullptr && this->_tuner && !split)
+            {
+                tuningToken = this->_tuner->select(this->_source, currentContext->device_info.name, currentContext->driver_version, this->get_max_work_group_size(currentContext), work_size, tunedLocalSize);
+                if(tunedLocalSize[0] != 0)
+                {
+                    localSize = tunedLocalSize;
+                }
+            }
+
+            // buffers the kernel writes wait for their readers too, the rest only for their last writer
+            std::vector<cl_event> dependencies;
+            const bool tracking = currentContext->track_dependencies;
+            std::unique_lock<std::mutex> dependencyLock(currentContext->dependency_mutex, std::defer_lock);
+            if(tracking)
+            {
+                dependencyLock.lock();
+                dependencies = waitList;
+                for(size_t k = 0; k < this->_args.size(); k++)
+                {
+                    if(this->_args[k].buffer != nullptr)
+                    {
+                        this->_args[k].buffer->add_dependencies(dependencies, this->writes_arg(k));
+                    }
+                }
+            }
+            const auto& events = tracking ? dependencies : waitList;
+
+            auto trackBuffers = [&](cl_event event)
+            {
+                for(size_t k = 0; tracking && k < this->_args.size(); k++)
+                {
+                    if(this->_args[k].buffer != nullptr)
+                    {
+                        this->_args[k].buffer->track(event, this->writes_arg(k));
+                    }
+                }
+                return event;
+            };
+
+            // partitions are profiled individually, the marker joining them isn't
+            if(split)
+            {
+                return trackBuffers(enqueue_split(currentContext, work_size, localSize, events));
+            }
+
+            cl_command_queue queue = currentContext->get_queue();
+            if(tuningToken == 0)
+            {
+                cl_event event;
+                THROW_IF_OPENCL_FAILED(::clEnqueueNDRangeKernel(queue, this->_kernel.get(), work_size.dimensions, nullptr, work_size.global_size, localSize, static_cast<cl_uint>(events.size()), waitListData(events), &event));
+                return profileEvent(currentContext, this->_name.c_str(), trackBuffers(event));
+            }
+
+            // candidate launches are timed in isolation, so they block until complete
+            if(!events.empty())
+            {
+                THROW_IF_OPENCL_FAILED(::clWaitForEvents(static_cast<cl_uint>(events.size()), events.data()));
+            }
+            THROW_IF_OPENCL_FAILED(::clFinish(queue));
+
+            const auto start = std::chrono::steady_clock::now();
+            cl_event event;
+            THROW_IF_OPENCL_FAILED(::clEnqueueNDRangeKernel(queue, this->_kernel.get(), work_size.dimensions, nullptr, work_size.global_size, localSize, 0, nullptr, &event));
+            unique_cl_event completion(event);
+            THROW_IF_OPENCL_FAILED(::clWaitForEvents(1, &event));
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+            // profiled queues give the device's own execution time, without launch overhead
+            if(currentContext->command_profiler)
+            {
+                cl_ulong executionStart = 0;
+                cl_ulong executionEnd = 0;
+                THROW_IF_OPENCL_FAILED(::clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(executionStart), &executionStart, nullptr));
+                THROW_IF_OPENCL_FAILED(::clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(executionEnd), &executionEnd, nullptr));
+                elapsed = std::chrono::nanoseconds(executionEnd - executionStart);
+            }
+
+            this->_tuner->record(tuningToken, elapsed.count());
+            return profileEvent(currentContext, this->_name.c_str(), trackBuffers(completion.release()));
+        }
+
+        // divides extent into one count per weight, proportional to the weights and in
+        // multiples of granularity; extent must itself be a multiple of granularity
+        static std::vector<size_t> splitRange(size_t extent, size_t granularity, const std::vector<double>& weights)
+        {
+            const size_t units = extent / granularity;
+            double totalWeight = 0.0;
+            for(auto weight : weights)
+            {
+                totalWeight += weight;
+            }
+
+            std::vector<size_t> counts(weights.size(), 0);
+            size_t assigned = 0;
+            for(size_t k = 0; k < weights.size(); k++)
+            {
+                counts[k] = static_cast<size_t>(units * (weights[k] / totalWeight));
+                assigned += counts[k];
+            }
+
+            // rounding leftovers go to the fastest device
+            const auto fastest = std::max_element(weights.begin(), weights.end()) - weights.begin();
+            counts[fastest] += units - assigned;
+
+            for(auto& count : counts)
+            {
+                count *= granularity;
+            }
+            return counts;
+        }
+
+        cl_event spark_kernel::enqueue_split(spark_context* currentContext, const spark_work_size_t& work_size, const size_t* localSize, const std::vector<cl_event>& waitList)
+        {
+            const size_t deviceCount = currentContext->split_devices.size();
+            if(this->_split_throughput.empty())
+            {
+                for(const auto& splitDevice : currentContext->split_devices)
+                {
+                    this->_split_throughput.push_back(std::max<double>(splitDevice.compute_units, 1.0));
+                }
+                this->_split_items.resize(deviceCount, 0);
+            }
+
+            // fold the previous launch's finished partitions into each device's throughput
+            std::vector<double> measured(this->_split_events.size(), 0.0);
+            for(size_t k = 0; k < this->_split_events.size(); k++)
+            {
+                cl_event event = this->_split_events[k].get();
+                cl_int status = CL_QUEUED;
+                cl_ulong start = 0;
+                cl_ulong end = 0;
+                if(event == nullptr ||
+                   ::clGetEventInfo(event, CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(status), &status, nullptr) != CL_SUCCESS ||
+                   status != CL_COMPLETE ||
+                   ::clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(start), &start, nullptr) != CL_SUCCESS ||
+                   ::clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(end), &end, nullptr) != CL_SUCCESS ||
+                   end <= start)
+                {
+                    continue;
+                }
+
+                measured[k] = static_cast<double>(this->_split_items[k]) / static_cast<double>(end - start);
+            }
+            this->_split_events.clear();
+
+            // compute unit estimates are only replaced once every device has a measurement,
+            // after that each measurement is smoothed into its device's throughput
+            const bool allMeasured = !measured.empty() && std::find(measured.begin(), measured.end(), 0.0) == measured.end();
+            for(size_t k = 0; k < measured.size(); k++)
+            {
+                if(!this->_split_measured)
+                {
+                    if(allMeasured)
+                    {
+                        this->_split_throughput[k] = measured[k];
+                    }
+                }
+                else if(measured[k] > 0.0)
+                {
+                    this->_split_throughput[k] = 0.5 * (this->_split_throughput[k] + measured[k]);
+                }
+            }
+            this->_split_measured |= allMeasured;
+
+            const uint32_t outer = work_size.dimensions - 1;
+            const size_t granularity = localSize != nullptr ? localSize[outer] : 1;
+            const auto counts = splitRange(work_size.global_size[outer], granularity, this->_split_throughput);
+
+            size_t itemsPerSlice = 1;
+            for(uint32_t k = 0; k < outer; k++)
+            {
+                itemsPerSlice *= work_size.global_size[k];
+            }
+
+            // buffers the kernel writes, all declared partitioned; each index of the outer
+            // dimension owns one slice of them
+            struct partitioned_buffer
+            {
+                uint32_t index;
+                cl_mem mem;
+                size_t size;
+                size_t slice;
+            };
+            std::vector<partitioned_buffer> partitioned;
+            for(uint32_t k = 0; k < this->_args.size(); k++)
+            {
+                const spark_buffer* buffer = this->_args[k].buffer;
+                if(buffer == nullptr || !this->writes_arg(k))
+                {
+                    continue;
+                }
+                if(buffer->_size % work_size.global_size[outer] != 0)
+                {
+                    throw_error("partitioned buffer size is not a multiple of the launch's outer dimension", __FILE__, __LINE__);
+                }
+                partitioned.push_back({k, buffer->_mem.get(), buffer->_size, buffer->_size / work_size.global_size[outer]});
+            }
+
+            std::vector<size_t> offsets(deviceCount, 0);
+            for(size_t k = 1; k < deviceCount; k++)
+            {
+                offsets[k] = offsets[k - 1] + counts[k - 1];
+            }
+
+            // the devices after the first write to replicas, which get their device's slices
+            // copied in first so whatever the kernel doesn't overwrite survives the gather
+            cl_command_queue queue = currentContext->get_queue();
+            std::vector<unique_cl_event> transfers;
+            std::vector<cl_event> partitionWaitList = waitList;
+            for(size_t k = 1; k < deviceCount; k++)
+            {
+                for(const auto& buffer : partitioned)
+                {
+                    auto& replicas = this->_split_replicas[buffer.index];
+                    replicas.resize(deviceCount);
+                    auto& replica = replicas[k];
+                    if(replica.size != buffer.size)
+                    {
+                        cl_int createBufferError = CL_SUCCESS;
+                        cl_mem clMem = ::clCreateBuffer(currentContext->context.get(), CL_MEM_READ_WRITE, buffer.size, nullptr, &createBufferError);
+                        THROW_IF_OPENCL_FAILED(createBufferError);
+                        replica.mem.reset(clMem);
+                        replica.size = buffer.size;
+                    }
+                    if(counts[k] == 0)
+                    {
+                        continue;
+                    }
+
+                    cl_event event;
+                    THROW_IF_OPENCL_FAILED(::clEnqueueCopyBuffer(queue, buffer.mem, replica.mem.get(), offsets[k] * buffer.slice, offsets[k] * buffer.slice, counts[k] * buffer.slice, static_cast<cl_uint>(waitList.size()), waitListData(waitList), &event));
+                    transfers.emplace_back(event);
+                    partitionWaitList.push_back(event);
+                }
+            }
+
+            // points the partitioned arguments at device's copies, device 0 uses the buffers themselves
+            auto bindPartitioned = [&](size_t device)
+            {
+                cl_int result = CL_SUCCESS;
+                for(const auto& buffer : partitioned)
+                {
+                    cl_mem mem = (device == 0) ? buffer.mem : this->_split_replicas[buffer.index][device].mem.get();
+                    const cl_int bindResult = ::clSetKernelArg(this->_kernel.get(), buffer.index, sizeof(mem), &mem);
+                    result = (result == CL_SUCCESS) ? bindResult : result;
+                }
+                return result;
+            };
+
+            size_t offset[3] = {0, 0, 0};
+            size_t globalSize[3] = {work_size.global_size[0], work_size.global_size[1], work_size.global_size[2]};
+            std::vector<cl_event> partitions;
+            try
+            {
+                for(size_t k = 0; k < deviceCount; k++)
+                {
+                    this->_split_events.emplace_back();
+                    this->_split_items[k] = counts[k] * itemsPerSlice;
+                    if(counts[k] == 0)
+                    {
+                        continue;
+                    }
+
+                    // arguments are captured at enqueue, so rebinding for the next device is safe
+                    THROW_IF_OPENCL_FAILED(bindPartitioned(k));
+                    offset[outer] = offsets[k];
+                    globalSize[outer] = counts[k];
+                    cl_event event;
+                    THROW_IF_OPENCL_FAILED(::clEnqueueNDRangeKernel(currentContext->split_devices[k].queue.get(), this->_kernel.get(), work_size.dimensions, offset, globalSize, localSize, static_cast<cl_uint>(partitionWaitList.size()), waitListData(partitionWaitList), &event));
+                    this->_split_events.back().reset(event);
+
+                    // reported per device so an unbalanced split shows up in the stats
+                    if(currentContext->command_profiler)
+                    {
+                        char name[160];
+                        ::snprintf(name, sizeof(name), "%s@%u", this->_name.c_str(), static_cast<uint32_t>(k));
+                        profileEvent(currentContext, name, event);
+                    }
+                    partitions.push_back(event);
+                }
+            }
+            catch(...)
+            {
+                // the shadowed bindings still name the buffers themselves
+                bindPartitioned(0);
+                throw;
+            }
+            THROW_IF_OPENCL_FAILED(bindPartitioned(0));
+
+            // slices are gathered once every partition is done, so no copy overlaps a device
+            // still writing the buffer
+            std::vector<cl_event> joined = partitions;
+            for(size_t k = 1; k < deviceCount; k++)
+            {
+                for(const auto& buffer : partitioned)
+                {
+                    if(counts[k] == 0)
+                    {
+                        continue;
+                    }
+
+                    cl_event event;
+                    THROW_IF_OPENCL_FAILED(::clEnqueueCopyBuffer(queue, this->_split_replicas[buffer.index][k].mem.get(), buffer.mem, offsets[k] * buffer.slice, offsets[k] * buffer.slice, counts[k] * buffer.slice, static_cast<cl_uint>(partitions.size()), waitListData(partitions), &event));
+                    transfers.emplace_back(event);
+                    joined.push_back(event);
+                }
+            }
+
+            cl_event marker;
+            THROW_IF_OPENCL_FAILED(::clEnqueueMarkerWithWaitList(queue, static_cast<cl_uint>(joined.size()), joined.data(), &marker));
+            return marker;
+        }
+
+        bool spark_kernel::can_split() const
+        {
+            if(!this->_splittable)
+            {
+                return false;
+            }
+
+            // every buffer the kernel may write has to be divided between the devices
+            for(size_t k = 0; k < this->_args.size(); k++)
+            {
+                if(this->_args[k].buffer != nullptr && this->writes_arg(k) &&
+                   (k >= this->_partitions.size() || this->_partitions[k] != Partition::Partitioned))
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        bool spark_kernel::writes_arg(size_t index) const
+        {
+            // without analysis results every buffer is assumed to be written
+            return index >= this->_written_args.size() || this->_written_args[index];
+        }
+
+        size_t spark_kernel::get_max_work_group_size(spark_context* currentContext)
+        {
+            wait_for_build();
+            if(this->_max_work_group_size == 0)
+            {
+                THROW_IF_OPENCL_FAILED(::clGetKernelWorkGroupInfo(this->_kernel.get(), currentContext->device_id, CL_KERNEL_WORK_GROUP_SIZE, sizeof(this->_max_work_group_size), &this->_max_work_group_size, nullptr));
+            }
+            return this->_max_work_group_size;
+        }
+
+        void spark_kernel::run(const spark_work_size_t& work_size)
+        {
+            waitForEvent(enqueue(work_size, {}));
+        }
+
+        // Spark Buffer
+
+        // 0 is left for primitive arguments
+        static std::atomic<uint64_t> nextBufferGeneration(1);
+
+        spark_buffer::spark_buffer(size_t size, const void* data, spark_buffer_flags_t flags)
+        : _size(size)
+        , _generation(nextBufferGeneration++)
+        {
+            auto currentContext = spark_context::current;
+            THROW_IF_NULL(currentContext);
+
+            const bool pinned = (flags & static_cast<spark_buffer_flags_t>(BufferFlags::Pinned)) != 0;
+            const bool uninitialized = (flags & static_cast<spark_buffer_flags_t>(BufferFlags::Uninitialized)) != 0;
+
+            if(currentContext->backend == Backend::Cpu)
+            {
+                this->_pool = currentContext->buffer_pool;
+                this->_capacity = memory_pool::size_class(size);
+                this->_host = this->_pool->acquire_host(this->_capacity);
+                if(this->_host == nullptr)
+                {
+                    this->_host = new uint8_t[this->_capacity];
+                }
+            }
+            else if(pinned)
+            {
+                // host backed allocations are tied to their creation flags, so never pooled
+                cl_int createBufferError = CL_SUCCESS;
+                cl_mem clMem = ::clCreateBuffer(currentContext->context.get(), CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, size, nullptr, &createBufferError);
+                THROW_IF_OPENCL_FAILED(createBufferError);
+                this->_mem.reset(clMem);
+            }
+            else
+            {
+                this->_pool = currentContext->buffer_pool;
+                this->_capacity = memory_pool::size_class(size);
+                cl_mem clMem = this->_pool->acquire_mem(this->_capacity);
+                if(clMem == nullptr)
+                {
+                    cl_int createBufferError = CL_SUCCESS;
+                    clMem = ::clCreateBuffer(currentContext->context.get(), CL_MEM_READ_WRITE, this->_capacity, nullptr, &createBufferError);
+                    THROW_IF_OPENCL_FAILED(createBufferError);
+                }
+                this->_mem.reset(clMem);
+            }
+
+            // recycled memory holds whatever its previous owner left behind
+            if(data != nullptr)
+            {
+                write(0, size, data);
+            }
+            else if(!uninitialized)
+            {
+                // later commands see the fill through the in-order queue or dependency tracking, without us blocking on it
+                unique_cl_event fill;
+                if(cl_event event = zero_async(0, size, {}))
+                {
+                    fill.reset(event);
+                }
+            }
+        }
+
+        spark_buffer::spark_buffer(size_t size, void* hostPtr)
+        : _size(size)
+        , _generation(nextBufferGeneration++)
+        {
+            auto currentContext = spark_context::current;
+            THROW_IF_NULL(currentContext);
+            THROW_IF_NULL(hostPtr);
+
+            // kernels write straight into the caller's memory
+            if(currentContext->backend == Backend::Cpu)
+            {
+                this->_host = static_cast<uint8_t*>(hostPtr);
+                return;
+            }
+
+            cl_int createBufferError = CL_SUCCESS;
+            cl_mem clMem = ::clCreateBuffer(currentContext->context.get(), CL_MEM_READ_WRITE | CL_MEM_USE_HOST_PTR, size, hostPtr, &createBufferError);
+            THROW_IF_OPENCL_FAILED(createBufferError);
+            this->_mem.reset(clMem);
+        }
+
+        spark_buffer::~spark_buffer()
+        {
+            // recycled memory mustn't be handed out while another queue may still be using it
+            if(this->_pool != nullptr && (this->_last_write != nullptr || !this->_reads.empty()))
+            {
+                std::vector<cl_event> pending;
+                add_dependencies(pending, true);
+                ::clWaitForEvents(static_cast<cl_uint>(pending.size()), pending.data());
+            }
+            release_dependencies();
+
+            if(this->_pool == nullptr)
+            {
+                return;
+            }
+
+            if(this->_mem)
+            {
+                this->_pool->release_mem(this->_capacity, this->_mem.release());
+            }
+            else if(this->_host != nullptr)
+            {
+                this->_pool->release_host(this->_capacity, this->_host);
+            }
+        }
+
+        void spark_buffer::add_dependencies(std::vector<cl_event>& waitList, bool writes) const
+        {
+            auto addEvent = [&](cl_event event)
+            {
+                if(std::find(waitList.begin(), waitList.end(), event) == waitList.end())
+                {
+                    waitList.push_back(event);
+                }
+            };
+
+            if(this->_last_write != nullptr)
+            {
+                addEvent(this->_last_write);
+            }
+            if(writes)
+            {
+                for(auto event : this->_reads)
+                {
+                    addEvent(event);
+                }
+            }
+        }
+
+        void spark_buffer::track(cl_event event, bool writes) const
+        {
+            if(event == nullptr)
+            {
+                return;
+            }
+            THROW_IF_OPENCL_FAILED(::clRetainEvent(event));
+
+            if(writes)
+            {
+                // the new write already waited on everything before it
+                release_dependencies();
+                this->_last_write = event;
+                return;
+            }
+
+            // drop reads that have finished so buffers only ever read don't collect events
+            if(this->_reads.size() >= 16)
+            {
+                auto finished = [](cl_event read)
+                {
+                    cl_int status = CL_QUEUED;
+                    if(::clGetEventInfo(read, CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(status), &status, nullptr) == CL_SUCCESS && status == CL_COMPLETE)
+                    {
+                        ::clReleaseEvent(read);
+                        return true;
+                    }
+                    return false;
+                };
+                this->_reads.erase(std::remove_if(this->_reads.begin(), this->_reads.end(), finished), this->_reads.end());
+            }
+            this->_reads.push_back(event);
+        }
+
+        void spark_buffer::release_dependencies() const
+        {
+            if(this->_last_write != nullptr)
+            {
+                ::clReleaseEvent(this->_last_write);
+                this->_last_write = nullptr;
+            }
+            for(auto event : this->_reads)
+            {
+                ::clReleaseEvent(event);
+            }
+            this->_reads.clear();
+        }
+
+        cl_event spark_buffer::write_async(size_t offset, size_t bytes, const void* data, const std::vector<cl_event>& waitList)
+        {
+            auto currentContext = spark_context::current;
+            THROW_IF_NULL(currentContext);
+            THROW_IF_FALSE(offset + bytes <= this->_size);
+            trace::scope span("transfer", "write_buffer");
+
+            // zero out buffer
+            if(data == nullptr)
+            {
+                return zero_async(offset, bytes, waitList);
+            }
+
+            // copy data
+            if(this->_host)
+            {
+                host_profile_scope profile(currentContext, "write_buffer");
+                ::memcpy(this->_host + offset, data, bytes);
+                return nullptr;
+            }
+
+            std::unique_lock<std::mutex> dependencyLock(currentContext->dependency_mutex, std::defer_lock);
+            if(currentContext->track_dependencies)
+            {
+                dependencyLock.lock();
+            }
+            std::vector<cl_event> dependencies;
+            const auto& events = bufferWaitList(currentContext, *this, true, waitList, dependencies);
+            cl_event event;
+            THROW_IF_OPENCL_FAILED(::clEnqueueWriteBuffer(currentContext->get_queue(), this->_mem.get(), CL_FALSE, offset, bytes, data, static_cast<cl_uint>(events.size()), waitListData(events), &event));
+            if(currentContext->track_dependencies)
+            {
+                track(event, true);
+            }
+            return profileEvent(currentContext, "write_buffer", event);
+        }
+
+        cl_event spark_buffer::read_async(size_t offset, size_t bytes, void* dest, const std::vector<cl_event>& waitList) const
+        {
+            auto currentContext = spark_context::current;
+            THROW_IF_NULL(currentContext);
+            THROW_IF_FALSE(offset + bytes <= this->_size);
+            trace::scope span("transfer", "read_buffer");
+
+            if(this->_host)
+            {
+                host_profile_scope profile(currentContext, "read_buffer");
+                ::memcpy(dest, this->_host + offset, bytes);
+                return nullptr;
+            }
+
+            std::unique_lock<std::mutex> dependencyLock(currentContext->dependency_mutex, std::defer_lock);
+            if(currentContext->track_dependencies)
+            {
+                dependencyLock.lock();
+            }
+            std::vector<cl_event> dependencies;
+            const auto& events = bufferWaitList(currentContext, *this, false, waitList, dependencies);
+            cl_event event;
+            THROW_IF_OPENCL_FAILED(::clEnqueueReadBuffer(currentContext->get_queue(), const_cast<cl_mem>(this->_mem.get()), CL_FALSE, offset, bytes, dest, static_cast<cl_uint>(events.size()), waitListData(events), &event));
+            if(currentContext->track_dependencies)
+            {
+                track(event, false);
+            }
+            return profileEvent(currentContext, "read_buffer", event);
+        }
+
+        cl_event spark_buffer::zero_async(size_t offset, size_t bytes, const std::vector<cl_event>& waitList)
+        {
+            auto currentContext = spark_context::current;
+            THROW_IF_NULL(currentContext);
+            THROW_IF_FALSE(offset + bytes <= this->_size);
+            trace::scope span("transfer", "fill_buffer");
+
+            if(this->_host)
+            {
+                host_profile_scope profile(currentContext, "fill_buffer");
+                ::memset(this->_host + offset, 0, bytes);
+                return nullptr;
+            }
+
+            // word sized pattern when the region allows it, drivers fill those faster
+            const uint32_t zero = 0;
+            const size_t patternSize = ((offset | bytes) % sizeof(zero) == 0) ? sizeof(zero) : 1;
+            std::unique_lock<std::mutex> dependencyLock(currentContext->dependency_mutex, std::defer_lock);
+            if(currentContext->track_dependencies)
+            {
+                dependencyLock.lock();
+            }
+            std::vector<cl_event> dependencies;
+            const auto& events = bufferWaitList(currentContext, *this, true, waitList, dependencies);
+            cl_event event;
+            THROW_IF_OPENCL_FAILED(::clEnqueueFillBuffer(currentContext->get_queue(), this->_mem.get(), &zero, patternSize, offset, bytes, static_cast<cl_uint>(events.size()), waitListData(events), &event));
+            if(currentContext->track_dependencies)
+            {
+                track(event, true);
+            }
+            return profileEvent(currentContext, "fill_buffer", event);
+        }
+
+        void* spark_buffer::map(size_t offset, size_t bytes, MapAccess access)
+        {
+            auto currentContext = spark_context::current;
+            THROW_IF_NULL(currentContext);
+            THROW_IF_FALSE(offset + bytes <= this->_size);
+
+            if(this->_host)
+            {
+                return this->_host + offset;
+            }
+
+            cl_map_flags mapFlags = 0;
+            switch(access)
+            {
+                case MapAccess::Read:      mapFlags = CL_MAP_READ; break;
+                // previous contents are discarded so the driver can skip the download
+                case MapAccess::Write:     mapFlags = CL_MAP_WRITE_INVALIDATE_REGION; break;
+                case MapAccess::ReadWrite: mapFlags = CL_MAP_READ | CL_MAP_WRITE; break;
+                default:
+                    THROW_IF_FALSE(access < MapAccess::Count);
+            }
+
+            std::vector<cl_event> dependencies;
+            std::vector<unique_cl_event> references;
+            if(currentContext->track_dependencies)
+            {
+                // the blocking map runs unlocked, so the wait list holds its own references
+                // in case a concurrent write releases the buffer's
+                std::lock_guard<std::mutex> lock(currentContext->dependency_mutex);
+                add_dependencies(dependencies, access != MapAccess::Read);
+                for(auto event : dependencies)
+                {
+                    THROW_IF_OPENCL_FAILED(::clRetainEvent(event));
+                    references.emplace_back(event);
+                }
+            }
+            cl_int mapBufferError = CL_SUCCESS;
+            void* ptr = ::clEnqueueMapBuffer(currentContext->get_queue(), this->_mem.get(), CL_TRUE, mapFlags, offset, bytes, static_cast<cl_uint>(dependencies.size()), waitListData(dependencies), nullptr, &mapBufferError);
+            THROW_IF_OPENCL_FAILED(mapBufferError);
+            return ptr;
+        }
+
+        void spark_buffer::unmap(void* ptr)
+        {
+            auto currentContext = spark_context::current;
+            THROW_IF_NULL(currentContext);
+
+            if(this->_host)
+            {
+                return;
+            }
+
+            // in-order queue, later commands see the unmapped contents
+            if(!currentContext->track_dependencies)
+            {
+                THROW_IF_OPENCL_FAILED(::clEnqueueUnmapMemObject(currentContext->get_queue(), this->_mem.get(), ptr, 0, nullptr, nullptr));
+                return;
+            }
+
+            // the mapping may have been written, so commands on other queues wait for the unmap
+            cl_event event;
+            THROW_IF_OPENCL_FAILED(::clEnqueueUnmapMemObject(currentContext->get_queue(), this->_mem.get(), ptr, 0, nullptr, &event));
+            unique_cl_event unmapped(event);
+            std::lock_guard<std::mutex> lock(currentContext->dependency_mutex);
+            track(event, true);
+        }
+
+        void spark_buffer::write(size_t offset, size_t bytes, const void* data)
+        {
+            waitForEvent(write_async(offset, bytes, data, {}));
+        }
+
+        void spark_buffer::read(size_t offset, size_t bytes, void* dest) const
+        {
+            waitForEvent(read_async(offset, bytes, dest, {}));
+        }
+
+        void spark_buffer::zero(size_t offset, size_t bytes)
+        {
+            waitForEvent(zero_async(offset, bytes, {}));
+        }
+
+        // Spark Command List
+
+        void spark_command_list::add_kernel(spark_kernel* kernel, const spark_work_size_t& work_size)
+        {
+            // unique across all lists so a kernel shared between lists rebinds correctly
+            static std::atomic<uint64_t> nextCommandId(1);
+
+            command cmd;
+            cmd.id = nextCommandId++;
+            cmd.kernel = kernel;
+            cmd.work_size = work_size;
+            this->_commands.push_back(std::move(cmd));
+        }
+
+        void spark_command_list::set_arg(uint32_t index, const spark_buffer* buffer)
+        {
+            THROW_IF_FALSE(!this->_commands.empty());
+            this->_commands.back().args.push_back({index, buffer, {}});
+        }
+
+        void spark_command_list::set_arg(uint32_t index, size_t size, const void* data)
+        {
+            THROW_IF_FALSE(!this->_commands.empty());
+            auto bytes = static_cast<const uint8_t*>(data);
+            this->_commands.back().args.push_back({index, nullptr, std::vector<uint8_t>(bytes, bytes + size)});
+        }
+
+        cl_event spark_command_list::enqueue(const std::vector<cl_event>& waitList)
+        {
+            auto currentContext = spark_context::current;
+            THROW_IF_NULL(currentContext);
+            const bool outOfOrder = currentContext->backend == Backend::OpenCL && currentContext->is_out_of_order();
+
+            // launches on an out-of-order queue can finish in any order, so keep every event for a final marker
+            std::vector<cl_event> launches;
+            auto releaseLaunches = [&]()
+            {
+                for(auto event : launches)
+                {
+                    ::clReleaseEvent(event);
+                }
+            };
+
+            unique_cl_event lastEvent;
+            for(size_t k = 0; k < this->_commands.size(); k++)
+            {
+                auto& cmd = this->_commands[k];
+                auto kernel = cmd.kernel;
+
+                // arguments are still bound from the last time this command ran
+                if(kernel->_arg_owner != cmd.id)
+                {
+                    for(const auto& arg : cmd.args)
+                    {
+                        if(arg.buffer != nullptr)
+                        {
+                            kernel->set_arg(arg.index, arg.buffer);
+                        }
+                        else
+                        {
+                            kernel->set_arg(arg.index, arg.data.size(), arg.data.data());
+                        }
+                    }
+                    kernel->_arg_owner = cmd.id;
+                }
+
+                // on an in-order queue only the first launch needs the caller's dependencies
+                cl_event event = nullptr;
+                try
+                {
+                    event = kernel->enqueue(cmd.work_size, (k == 0 || outOfOrder) ? waitList : std::vector<cl_event>());
+                }
+                catch(...)
+                {
+                    releaseLaunches();
+                    throw;
+                }
+
+                if(event == nullptr)
+                {
+                    continue;
+                }
+                if(outOfOrder)
+                {
+                    launches.push_back(event);
+                }
+                else
+                {
+                    lastEvent.reset(event);
+                }
+            }
+
+            if(!launches.empty())
+            {
+                cl_event marker;
+                const cl_int markerError = ::clEnqueueMarkerWithWaitList(currentContext->get_queue(), static_cast<cl_uint>(launches.size()), launches.data(), &marker);
+                releaseLaunches();
+                THROW_IF_OPENCL_FAILED(markerError);
+                return marker;
+            }
+            return lastEvent.release();
+        }
+
+        // Spark Event
+
+        std::vector<cl_event> spark_event::get_wait_list(const spark_event* const* events, uint32_t count)
+        {
+            THROW_IF_FALSE(events != nullptr || count == 0);
+
+            std::vector<cl_event> waitList;
+            for(uint32_t k = 0; k < count; k++)
+            {
+                THROW_IF_NULL(events[k]);
+                // empty events were complete when created
+                if(events[k]->_event)
+                {
+                    waitList.push_back(const_cast<spark_event*>(events[k])->_event.get());
+                }
+            }
+            return waitList;
+        }
+    }
+}
+
+RUFF_EXPORT spark_context_t* spark_create_context_for_backend(spark_backend_t backend, spark_error_t** error)
+{
+    return TranslateExceptions(
+        error,
+        [&]
+        {
+            THROW_IF_FALSE(backend < static_cast<spark_backend_t>(Backend::Count));
+
+            auto context = new spark::lib::spark_context(static_cast<Backend>(backend), {});
+            spark::lib::spark_context::current = context;
+
+            return spark::lib::spark_context::current;
+        });
+}
+
+RUFF_EXPORT spark_context_t* spark_create_context(spark_error_t** error)
+{
+    // SPARK_BACKEND=cpu lets existing programs run without an OpenCL device
+    auto backend = Backend::OpenCL;
+    const char* backendName = ::getenv("SPARK_BACKEND");
+    if(backendName != nullptr && ::strcmp(backendName, "cpu") == 0)
+    {
+        backend = Backend::Cpu;
+    }
+
+    return spark_create_context_for_backend(static_cast<spark_backend_t>(backend), error);
+}
+
+RUFF_EXPORT size_t spark_enumerate_devices(spark_device_type_t device_type, spark_device_info_t* infos, size_t info_count, spark_error_t** error)
+{
+    return TranslateExceptions(
+        error,
+        [&]
+        {
+            THROW_IF_FALSE(device_type < static_cast<spark_device_type_t>(DeviceType::Count));
+            THROW_IF_FALSE(infos != nullptr || info_count == 0);
+
+            // returns the total number of matching devices, filling in at most info_count of them
+            // indices are positions among all of a platform's devices, so they don't depend on the filter
+            size_t deviceCount = 0;
+            auto platforms = spark::lib::getPlatforms();
+            for(uint32_t platformIndex = 0; platformIndex < platforms.size(); platformIndex++)
+            {
+                auto devices = spark::lib::getDevices(platforms[platformIndex], DeviceType::All);
+                auto matching = spark::lib::getDevices(platforms[platformIndex], static_cast<DeviceType>(device_type));
+                for(uint32_t deviceIndex = 0; deviceIndex < devices.size(); deviceIndex++)
+                {
+                    if(std::find(matching.begin(), matching.end(), devices[deviceIndex]) == matching.end())
+                    {
+                        continue;
+                    }
+                    if(deviceCount < info_count)
+                    {
+                        spark::lib::getDeviceInfo(devices[deviceIndex], platformIndex, deviceIndex, infos + deviceCount);
+                    }
+                    deviceCount++;
+                }
+            }
+            return deviceCount;
+        });
+}
+
+RUFF_EXPORT spark_context_t* spark_create_context_ex(spark_device_type_t device_type, uint32_t platform_index, uint32_t device_index, spark_error_t** error)
+{
+    return TranslateExceptions(
+        error,
+        [&]
+        {
+            THROW_IF_FALSE(device_type < static_cast<spark_device_type_t>(DeviceType::Count));
+
+            auto device = spark::lib::selectDevice(static_cast<DeviceType>(device_type), platform_index, device_index);
+            auto context = new spark::lib::spark_context(Backend::OpenCL, {device});
+            spark::lib::spark_context::current = context;
+
+            return spark::lib::spark_context::current;
+        });
+}
+
+RUFF_EXPORT spark_context_t* spark_create_context_multi_device(spark_device_type_t device_type, uint32_t platform_index, spark_error_t** error)
+{
+    return TranslateExceptions(
+        error,
+        [&]
+        {
+            THROW_IF_FALSE(device_type < static_cast<spark_device_type_t>(DeviceType::Count));
+
+            auto platforms = spark::lib::getPlatforms();
+            THROW_IF_FALSE(platform_index < platforms.size());
+            auto devices = spark::lib::getDevices(platforms[platform_index], static_cast<DeviceType>(device_type));
+            THROW_IF_FALSE(!devices.empty());
+
+            // sub-devices only take split launches, everything else runs on the whole device
+            const auto subDevices = (devices.size() == 1) ? spark::lib::partitionDevice(devices.front()) : std::vector<cl_device_id>();
+            auto context = new spark::lib::spark_context(Backend::OpenCL, devices, subDevices);
+            spark::lib::spark_context::current = context;
+
+            // the context holds its own references
+            for(auto subDevice : subDevices)
+            {
+                ::clReleaseDevice(subDevice);
+            }
+
+            return spark::lib::spark_context::current;
+        });
+}
+
+RUFF_EXPORT uint32_t spark_get_split_device_count(spark_context_t* context, spark_error_t** error)
+{
+    return TranslateExceptions(
+        error,
+        [&]
+        {
+            THROW_IF_NULL(context);
+
+            return static_cast<uint32_t>(context->split_devices.size());
+        });
+}
+
+RUFF_EXPORT void spark_get_context_device_info(spark_context_t* context, spark_device_info_t* info, spark_error_t** error)
+{
+    return TranslateExceptions(
+        error,
+        [&]
+        {
+            THROW_IF_NULL(context);
+            THROW_IF_NULL(info);
+
+            *info = context->device_info;
+        });
+}
+
+RUFF_EXPORT void spark_get_program_cache_stats(spark_context_t* context, uint64_t* hits, uint64_t* misses, spark_error_t** error)
+{
+    return TranslateExceptions(
+        error,
+        [&]
+        {
+            THROW_IF_NULL(context);
+
+            std::lock_guard<std::mutex> lock(context->program_mutex);
+            if(hits != nullptr)
+            {
+                *hits = context->program_cache_hits;
+            }
+            if(misses != nullptr)
+            {
+                *misses = context->program_cache_misses;
+            }
+        });
+}
+
+RUFF_EXPORT void spark_get_buffer_pool_stats(spark_context_t* context, uint64_t* hits, uint64_t* misses, uint64_t* cached_bytes, spark_error_t** error)
+{
+    return TranslateExceptions(
+        error,
+        [&]
+        {
+            THROW_IF_NULL(context);
+
+            if(hits != nullptr)
+            {
+                *hits = context->buffer_pool->hits();
+            }
+            if(misses != nullptr)
+            {
+                *misses = context->buffer_pool->misses();
+            }
+            if(cached_bytes != nullptr)
+            {
+                *cached_bytes = context->buffer_pool->cached_bytes();
+            }
+        });
+}
+
+RUFF_EXPORT void spark_set_profiling(spark_context_t* context, bool enabled, spark_error_t** error)
+{
+    return TranslateExceptions(
+        error,
+        [&]
+        {
+            THROW_IF_NULL(context);
+
+            context->set_profiling(enabled);
+        });
+}
+
+RUFF_EXPORT size_t spark_get_profile_stats(spark_context_t* context, spark_profile_stats_t* stats, size_t stats_count, spark_error_t** error)
+{
+    return TranslateExceptions(
+        error,
+        [&]
+        {
+            THROW_IF_NULL(context);
+            THROW_IF_FALSE(stats != nullptr || stats_count == 0);
+
+            // returns the total number of names, filling in at most stats_count of them (hottest first)
+            if(!context->command_profiler)
+            {
+                return size_t(0);
+            }
+            auto allStats = context->command_profiler->get_stats();
+            std::copy_n(allStats.begin(), std::min(allStats.size(), stats_count), stats);
+            return allStats.size();
+        });
 }
 
-RUFF_EXPORT spark_context_t* spark_create_context(spark_error_t** error)
+RUFF_EXPORT void spark_reset_profile_stats(spark_context_t* context, spark_error_t** error)
 {
     return TranslateExceptions(
         error,
         [&]
         {
-            auto context = new spark::lib::spark_context();
-            spark::lib::spark_context::current = context;
+            THROW_IF_NULL(context);
 
-            char buffer[1024];
+            if(context->command_profiler)
+            {
+                context->command_profiler->reset();
+            }
+        });
+}
 
-            THROW_IF_OPENCL_FAILED(clGetDeviceInfo(context->device_id, CL_DEVICE_NAME, sizeof(buffer), buffer, nullptr));
-            printf("DeviceName: %s\n", buffer);
+RUFF_EXPORT uint32_t spark_create_queue(spark_context_t* context, bool out_of_order, spark_error_t** error)
+{
+    return TranslateExceptions(
+        error,
+        [&]
+        {
+            THROW_IF_NULL(context);
 
-            THROW_IF_OPENCL_FAILED(clGetDeviceInfo(context->device_id, CL_DEVICE_VENDOR, sizeof(buffer), buffer, nullptr));
-            printf("DeviceVendor: %s\n", buffer);
+            return context->create_queue(out_of_order);
+        });
+}
 
-            THROW_IF_OPENCL_FAILED(clGetDeviceInfo(context->device_id, CL_DEVICE_VERSION, sizeof(buffer), buffer, nullptr));
-            printf("OpenCL Version: %s\n", buffer);
+RUFF_EXPORT void spark_set_current_queue(spark_context_t* context, uint32_t queue, spark_error_t** error)
+{
+    return TranslateExceptions(
+        error,
+        [&]
+        {
+            THROW_IF_NULL(context);
 
-            return spark::lib::spark_context::current;
+            context->set_current_queue(queue);
         });
 }
 
@@ -239,6 +1959,16 @@ RUFF_EXPORT void spark_set_current_context(spark_context_t* context, spark_error
         });
 }
 
+RUFF_EXPORT spark_context_t* spark_get_current_context(spark_error_t** error)
+{
+    return TranslateExceptions(
+        error,
+        [&]
+        {
+            return spark::lib::spark_context::current;
+        });
+}
+
 RUFF_EXPORT void spark_destroy_context(spark_context_t* context, spark_error_t** error)
 {
     return TranslateExceptions(
@@ -252,6 +1982,11 @@ RUFF_EXPORT void spark_destroy_context(spark_context_t* context, spark_error_t**
                 spark::lib::spark_context::current = nullptr;
             }
             delete context;
+
+            if(spark::lib::trace::enabled())
+            {
+                spark::lib::trace::write_default();
+            }
             return;
         });
 }
@@ -266,23 +2001,48 @@ RUFF_EXPORT spark_kernel_t* spark_create_kernel(spark_node_t* kernel_root, spark
             THROW_IF_FALSE(kernel_root->_type == spark::lib::spark_nodetype::control);
             THROW_IF_FALSE(kernel_root->_control == spark::shared::Control::Root);
 
-#if 0
-            auto len = generateSourceTree(kernel_root, nullptr, 0);
-            string sourceTree(len - 1, 0);
-            generateSourceTree(kernel_root, const_cast<char*>(sourceTree.data()), len);
+            {
+                spark::lib::trace::scope span("codegen", "optimize");
+                spark::lib::optimizeProgram(kernel_root);
+            }
+
+            if(spark::lib::log::enabled(spark::shared::LogLevel::Trace))
+            {
+                auto sourceTree = spark::lib::generateSourceTree(kernel_root);
+
+                spark::lib::log::write(spark::shared::LogLevel::Trace, "kernel ast:\n%s", sourceTree.c_str());
+            }
+
+            auto currentContext = spark::lib::spark_context::current;
+            THROW_IF_NULL(currentContext);
 
-            printf("%s\n", sourceTree.c_str());
-#endif
-            // generates opencl source from AST
-            auto len = generateOpenCLSource(kernel_root, nullptr, 0);
-            string openclSource(len - 1, 0);
-            generateOpenCLSource(kernel_root, const_cast<char*>(openclSource.data()), len);
+            // generates opencl or c++ source from AST
+            auto generateSource = (currentContext->backend == Backend::Cpu) ? spark::lib::generateCppSource : spark::lib::generateOpenCLSource;
+            string kernelSource;
+            {
+                spark::lib::trace::scope span("codegen", "generate_source");
+                kernelSource = generateSource(kernel_root);
+            }
 
-            printf("%s\n", openclSource.c_str());
+            // logged and dumped before the build, which may throw on a compile error
+            const char* extension = (currentContext->backend == Backend::Cpu) ? "cpp" : "cl";
+            const string name = spark::lib::kernelName(kernelSource);
+            LOG_DEBUG("%s source:\n%s", name.c_str(), kernelSource.c_str());
+            spark::lib::dumpSource(name, kernelSource, extension);
 
             // build/link kernel
-            auto kernel = new spark::lib::spark_kernel(std::move(openclSource));
-            return kernel;
+            std::unique_ptr<spark::lib::spark_kernel> kernel(new spark::lib::spark_kernel(std::move(kernelSource)));
+            kernel->_written_args = spark::lib::findWrittenArguments(kernel_root);
+            auto entryPoint = spark::lib::findEntryPoint(kernel_root);
+            if(currentContext->backend == Backend::OpenCL && entryPoint != nullptr && spark::lib::readsGlobalSize(entryPoint->_children.back()))
+            {
+                kernel->_global_size_arg = static_cast<uint32_t>(entryPoint->_children.front()->_children.size());
+            }
+            kernel->_splittable = std::none_of(kernel_root->_children.begin(), kernel_root->_children.end(), [&](const spark_node_t* func)
+            {
+                return func != entryPoint && spark::lib::readsGlobalSize(func);
+            });
+            return kernel.release();
         });
 }
 
@@ -327,19 +2087,190 @@ RUFF_EXPORT void spark_set_kernel_arg_primitive(spark_kernel_t* kernel, uint32_t
         });
 }
 
-RUFF_EXPORT void spark_run_kernel(spark_kernel_t* kernel, size_t dim1, size_t dim2, size_t dim3, spark_error_t** error)
+RUFF_EXPORT void spark_get_kernel_arg_stats(spark_kernel_t* kernel, uint64_t* updates, uint64_t* skips, spark_error_t** error)
+{
+    return TranslateExceptions(
+        error,
+        [&]
+        {
+            THROW_IF_NULL(kernel);
+
+            if(updates != nullptr)
+            {
+                *updates = kernel->_arg_updates;
+            }
+            if(skips != nullptr)
+            {
+                *skips = kernel->_arg_skips;
+            }
+        });
+}
+
+RUFF_EXPORT void spark_set_kernel_name(spark_kernel_t* kernel, const char* name, spark_error_t** error)
+{
+    return TranslateExceptions(
+        error,
+        [&]
+        {
+            THROW_IF_NULL(kernel);
+            THROW_IF_NULL(name);
+
+            kernel->_name = name;
+        });
+}
+
+RUFF_EXPORT void spark_set_kernel_autotune(spark_kernel_t* kernel, bool enabled, spark_error_t** error)
+{
+    return TranslateExceptions(
+        error,
+        [&]
+        {
+            THROW_IF_NULL(kernel);
+
+            if(!enabled)
+            {
+                kernel->_tuner.reset();
+            }
+            else if(!kernel->_tuner)
+            {
+                kernel->_tuner = make_unique<spark::lib::work_group_tuner>();
+            }
+        });
+}
+
+RUFF_EXPORT void spark_set_kernel_arg_partition(spark_kernel_t* kernel, uint32_t index, spark_partition_t partition, spark_error_t** error)
+{
+    return TranslateExceptions(
+        error,
+        [&]
+        {
+            THROW_IF_NULL(kernel);
+            THROW_IF_FALSE(partition < static_cast<spark_partition_t>(Partition::Count));
+
+            if(index >= kernel->_partitions.size())
+            {
+                kernel->_partitions.resize(index + 1, Partition::Replicated);
+            }
+            kernel->_partitions[index] = static_cast<Partition>(partition);
+        });
+}
+
+RUFF_EXPORT void spark_run_kernel(spark_kernel_t* kernel, const spark_work_size_t* work_size, spark_error_t** error)
+{
+    return TranslateExceptions(
+        error,
+        [&]
+        {
+            THROW_IF_NULL(kernel);
+            THROW_IF_NULL(work_size);
+
+            kernel->run(spark::lib::normalize_work_size(*work_size));
+        });
+}
+
+RUFF_EXPORT spark_event_t* spark_run_kernel_async(spark_kernel_t* kernel, const spark_work_size_t* work_size, const spark_event_t* const* wait_list, uint32_t wait_count, spark_error_t** error)
+{
+    return TranslateExceptions(
+        error,
+        [&]
+        {
+            THROW_IF_NULL(kernel);
+            THROW_IF_NULL(work_size);
+
+            auto waitList = spark::lib::spark_event::get_wait_list(wait_list, wait_count);
+            return new spark::lib::spark_event(kernel->enqueue(spark::lib::normalize_work_size(*work_size), waitList));
+        });
+}
+
+RUFF_EXPORT spark_command_list_t* spark_create_command_list(spark_error_t** error)
+{
+    return TranslateExceptions(
+        error,
+        [&]
+        {
+            return new spark::lib::spark_command_list();
+        });
+}
+
+RUFF_EXPORT void spark_command_list_add_kernel(spark_command_list_t* list, spark_kernel_t* kernel, const spark_work_size_t* work_size, spark_error_t** error)
 {
     return TranslateExceptions(
         error,
         [&]
         {
+            THROW_IF_NULL(list);
             THROW_IF_NULL(kernel);
-            THROW_IF_FALSE(dim1 > 0);
-            THROW_IF_FALSE(dim2 > 0);
-            THROW_IF_FALSE(dim3 > 0);
+            THROW_IF_NULL(work_size);
+
+            list->add_kernel(kernel, spark::lib::normalize_work_size(*work_size));
+        });
+}
+
+RUFF_EXPORT void spark_command_list_set_kernel_arg_buffer(spark_command_list_t* list, uint32_t index, spark_buffer_t* buffer, spark_error_t** error)
+{
+    return TranslateExceptions(
+        error,
+        [&]
+        {
+            THROW_IF_NULL(list);
+            THROW_IF_NULL(buffer);
+
+            list->set_arg(index, buffer);
+        });
+}
+
+RUFF_EXPORT void spark_command_list_set_kernel_arg_primitive(spark_command_list_t* list, uint32_t index, size_t size, const void* data, spark_error_t** error)
+{
+    return TranslateExceptions(
+        error,
+        [&]
+        {
+            THROW_IF_NULL(list);
+            THROW_IF_FALSE(size > 0);
+            THROW_IF_NULL(data);
+
+            list->set_arg(index, size, data);
+        });
+}
+
+RUFF_EXPORT void spark_run_command_list(spark_command_list_t* list, spark_error_t** error)
+{
+    return TranslateExceptions(
+        error,
+        [&]
+        {
+            THROW_IF_NULL(list);
+
+            cl_event event = list->enqueue({});
+            if(event != nullptr)
+            {
+                spark::lib::unique_cl_event completion(event);
+                THROW_IF_OPENCL_FAILED(::clWaitForEvents(1, &event));
+            }
+        });
+}
+
+RUFF_EXPORT spark_event_t* spark_run_command_list_async(spark_command_list_t* list, const spark_event_t* const* wait_list, uint32_t wait_count, spark_error_t** error)
+{
+    return TranslateExceptions(
+        error,
+        [&]
+        {
+            THROW_IF_NULL(list);
 
-            size_t work_dimensions[3] = {dim1, dim2, dim3};
-            kernel->run(work_dimensions);
+            auto waitList = spark::lib::spark_event::get_wait_list(wait_list, wait_count);
+            return new spark::lib::spark_event(list->enqueue(waitList));
+        });
+}
+
+RUFF_EXPORT void spark_destroy_command_list(spark_command_list_t* list, spark_error_t** error)
+{
+    return TranslateExceptions(
+        error,
+        [&]
+        {
+            delete list;
+            return;
         });
 }
 
@@ -355,6 +2286,26 @@ RUFF_EXPORT void spark_destroy_kernel(spark_kernel_t* kernel, spark_error_t** er
 }
 
 RUFF_EXPORT spark_buffer_t* spark_create_buffer(size_t bytes, const void* data, spark_error_t** error)
+{
+    return TranslateExceptions(
+        error,
+        [&]
+        {
+            return new spark::lib::spark_buffer(bytes, data, static_cast<spark_buffer_flags_t>(BufferFlags::None));
+        });
+}
+
+RUFF_EXPORT spark_buffer_t* spark_create_buffer_ex(size_t bytes, const void* data, spark_buffer_flags_t flags, spark_error_t** error)
+{
+    return TranslateExceptions(
+        error,
+        [&]
+        {
+            return new spark::lib::spark_buffer(bytes, data, flags);
+        });
+}
+
+RUFF_EXPORT spark_buffer_t* spark_create_buffer_from_host_ptr(size_t bytes, void* data, spark_error_t** error)
 {
     return TranslateExceptions(
         error,
@@ -389,6 +2340,59 @@ RUFF_EXPORT void spark_read_buffer(spark_buffer_t* buffer, size_t offset, size_t
     });
 }
 
+RUFF_EXPORT spark_event_t* spark_write_buffer_async(spark_buffer_t* buffer, size_t offset, size_t bytes, const void* data, const spark_event_t* const* wait_list, uint32_t wait_count, spark_error_t** error)
+{
+    return TranslateExceptions(
+        error,
+        [&]
+        {
+            THROW_IF_NULL(buffer);
+
+            auto waitList = spark::lib::spark_event::get_wait_list(wait_list, wait_count);
+            return new spark::lib::spark_event(buffer->write_async(offset, bytes, data, waitList));
+        });
+}
+
+RUFF_EXPORT spark_event_t* spark_read_buffer_async(spark_buffer_t* buffer, size_t offset, size_t bytes, void* dest, const spark_event_t* const* wait_list, uint32_t wait_count, spark_error_t** error)
+{
+    return TranslateExceptions(
+        error,
+        [&]
+        {
+            THROW_IF_NULL(buffer);
+            THROW_IF_NULL(dest);
+
+            auto waitList = spark::lib::spark_event::get_wait_list(wait_list, wait_count);
+            return new spark::lib::spark_event(buffer->read_async(offset, bytes, dest, waitList));
+        });
+}
+
+RUFF_EXPORT void* spark_map_buffer(spark_buffer_t* buffer, size_t offset, size_t bytes, spark_map_access_t access, spark_error_t** error)
+{
+    return TranslateExceptions(
+        error,
+        [&]
+        {
+            THROW_IF_NULL(buffer);
+            THROW_IF_FALSE(access < static_cast<spark_map_access_t>(MapAccess::Count));
+
+            return buffer->map(offset, bytes, static_cast<MapAccess>(access));
+        });
+}
+
+RUFF_EXPORT void spark_unmap_buffer(spark_buffer_t* buffer, void* ptr, spark_error_t** error)
+{
+    return TranslateExceptions(
+        error,
+        [&]
+        {
+            THROW_IF_NULL(buffer);
+            THROW_IF_NULL(ptr);
+
+            buffer->unmap(ptr);
+        });
+}
+
 RUFF_EXPORT void spark_destroy_buffer(spark_buffer_t* buffer, spark_error_t** error)
 {
     return TranslateExceptions(
@@ -398,4 +2402,30 @@ RUFF_EXPORT void spark_destroy_buffer(spark_buffer_t* buffer, spark_error_t** er
             delete buffer;
             return;
         });
+}
+
+RUFF_EXPORT void spark_wait_for_events(const spark_event_t* const* events, uint32_t count, spark_error_t** error)
+{
+    return TranslateExceptions(
+        error,
+        [&]
+        {
+            auto waitList = spark::lib::spark_event::get_wait_list(events, count);
+            if(!waitList.empty())
+            {
+                spark::lib::trace::scope span("wait", "wait_for_events");
+                THROW_IF_OPENCL_FAILED(::clWaitForEvents(static_cast<cl_uint>(waitList.size()), waitList.data()));
+            }
+        });
+}
+
+RUFF_EXPORT void spark_destroy_event(spark_event_t* event, spark_error_t** error)
+{
+    return TranslateExceptions(
+        error,
+        [&]
+        {
+            delete event;
+            return;
+        });
 }
\ No newline at end of file
@@ -0,0 +1,244 @@
+#include "spark.hpp"
+
+#include "runtime.hpp"
+#include "error.hpp"
+#include "node.hpp"
+#include "codegen.hpp"
+#include "cache.hpp"
+#include "trace.hpp"
+#include "log.hpp"
+
+// posix
+#include <dlfcn.h>
+#include <unistd.h>
+
+using std::string;
+
+namespace spark
+{
+    namespace lib
+    {
+        static string getEnvironment(const char* name, const char* defaultValue)
+        {
+            const char* value = ::getenv(name);
+            return (value != nullptr && *value != 0) ? value : defaultValue;
+        }
+
+        static void writeFile(const string& path, const char* data, size_t bytes)
+        {
+            FILE* file = ::fopen(path.c_str(), "wb");
+            THROW_IF_NULL(file);
+            const size_t written = ::fwrite(data, 1, bytes, file);
+            ::fclose(file);
+            THROW_IF_FALSE(written == bytes);
+        }
+
+        static bool readFile(const string& path, std::vector<uint8_t>& contents)
+        {
+            FILE* file = ::fopen(path.c_str(), "rb");
+            if(file == nullptr)
+            {
+                return false;
+            }
+            uint8_t buffer[4096];
+            size_t read = 0;
+            while((read = ::fread(buffer, 1, sizeof(buffer), file)) > 0)
+            {
+                contents.insert(contents.end(), buffer, buffer + read);
+            }
+            ::fclose(file);
+            return true;
+        }
+
+        // `compiler --version` output, queried once per compiler; the command alone
+        // stays the same when the toolchain behind it is upgraded
+        static string getCompilerVersion(const string& compiler)
+        {
+            static std::mutex mutex;
+            static std::unordered_map<string, string> versions;
+            std::lock_guard<std::mutex> lock(mutex);
+
+            auto found = versions.find(compiler);
+            if(found != versions.end())
+            {
+                return found->second;
+            }
+
+            string version;
+            if(FILE* pipe = ::popen((compiler + " --version 2>/dev/null").c_str(), "r"))
+            {
+                char buffer[256];
+                size_t read = 0;
+                while((read = ::fread(buffer, 1, sizeof(buffer), pipe)) > 0)
+                {
+                    version.append(buffer, read);
+                }
+                ::pclose(pipe);
+            }
+            versions.emplace(compiler, version);
+            return version;
+        }
+
+        // model and feature lines of the first cpu in /proc/cpuinfo, since -march=native
+        // modules only run on the kind of cpu they were built on
+        static const string& getHostIdentity()
+        {
+            static const string identity = []()
+            {
+                static const char* keys[] = {"vendor_id", "model name", "flags", "CPU implementer", "CPU part", "Features"};
+                string result;
+                std::vector<uint8_t> contents;
+                if(readFile("/proc/cpuinfo", contents))
+                {
+                    const string info(contents.begin(), contents.end());
+                    for(const char* key : keys)
+                    {
+                        // first occurrence is the first cpu
+                        const size_t pos = info.find(string("\n") + key);
+                        if(pos != string::npos)
+                        {
+                            result += info.substr(pos + 1, info.find('\n', pos + 1) - pos);
+                        }
+                    }
+                }
+                return result;
+            }();
+            return identity;
+        }
+
+        // builds prelude + source into a shared object with the host compiler, stores it in the
+        // kernel cache and returns the loaded module
+        static void* compileModule(const string& source, const string& compiler, const string& flags, uint64_t cacheKey)
+        {
+            trace::scope span("build", "compile_native");
+
+            // scratch directory for the translation unit and the compiled module
+            char directory[] = "/tmp/spark-XXXXXX";
+            THROW_IF_NULL(::mkdtemp(directory));
+
+            const string sourcePath = string(directory) + "/kernel.cpp";
+            const string modulePath = string(directory) + "/kernel.so";
+            const string logPath = string(directory) + "/build.log";
+
+            // loaded module stays mapped after its backing files are gone
+            auto cleanup = [&]
+            {
+                ::unlink(sourcePath.c_str());
+                ::unlink(modulePath.c_str());
+                ::unlink(logPath.c_str());
+                ::rmdir(directory);
+            };
+
+            const string translationUnit = string(getCppPrelude()) + source;
+            writeFile(sourcePath, translationUnit.data(), translationUnit.size());
+
+            const string command = compiler + " " + flags + " -fPIC -shared -o " + modulePath + " " + sourcePath + " > " + logPath + " 2>&1";
+            LOG_DEBUG("compiling native kernel: %s", command.c_str());
+            const int buildResult = ::system(command.c_str());
+
+            if(buildResult != 0)
+            {
+                std::vector<uint8_t> log;
+                readFile(logPath, log);
+                cleanup();
+
+                string logMessage = "native kernel build failed: " + command + "\n";
+                logMessage.append(log.begin(), log.end());
+                throw_error(logMessage.c_str(), __FILE__, __LINE__);
+            }
+
+            std::vector<uint8_t> module;
+            if(readFile(modulePath, module))
+            {
+                kernel_cache::store(cacheKey, "so", module.data(), module.size());
+            }
+
+            void* handle = ::dlopen(modulePath.c_str(), RTLD_NOW | RTLD_LOCAL);
+            cleanup();
+
+            if(handle == nullptr)
+            {
+                throw_error(::dlerror(), __FILE__, __LINE__);
+            }
+            return handle;
+        }
+
+        /// Native Module
+
+        native_module::native_module(const string& source)
+        {
+            const string compiler = getEnvironment("SPARK_CPU_CXX", "c++");
+            const string flags = getEnvironment("SPARK_CPU_CXXFLAGS", "-std=c++14 -O3 -march=native -fno-math-errno");
+
+            // prelude changes with the library so it is part of the key, as are the
+            // compiler's version and the cpu the module is built for
+            const auto cacheKey = kernel_cache::make_key(string(getCppPrelude()) + source, "host\n" + getHostIdentity(), compiler + "\n" + getCompilerVersion(compiler), flags);
+            // load validates the stored module before dlopen maps it
+            std::vector<uint8_t> cached;
+            if(kernel_cache::load(cacheKey, "so", cached))
+            {
+                this->_handle = ::dlopen(kernel_cache::get_path(cacheKey, "so").c_str(), RTLD_NOW | RTLD_LOCAL);
+            }
+            // only a module dlopen accepted counts as a hit
+            kernel_cache::record(this->_handle != nullptr);
+
+            if(this->_handle == nullptr)
+            {
+                this->_handle = compileModule(source, compiler, flags, cacheKey);
+            }
+
+            this->_entry_point = reinterpret_cast<entry_point_t>(::dlsym(this->_handle, "spark_native_entry"));
+            THROW_IF_NULL(this->_entry_point);
+
+            auto argumentCount = reinterpret_cast<const uint32_t*>(::dlsym(this->_handle, "spark_native_argument_count"));
+            THROW_IF_NULL(argumentCount);
+            this->_argument_count = *argumentCount;
+        }
+
+        native_module::~native_module()
+        {
+            if(this->_handle != nullptr)
+            {
+                ::dlclose(this->_handle);
+            }
+        }
+
+        /// Native Kernel
+
+        native_kernel::native_kernel(std::shared_ptr<native_module> module)
+        : _module(std::move(module))
+        , _args(_module->_argument_count)
+        {
+            for(auto& slot : this->_args)
+            {
+                this->_arg_pointers.push_back(slot.data);
+            }
+        }
+
+        void native_kernel::set_arg(uint32_t index, size_t size, const void* data)
+        {
+            THROW_IF_FALSE(index < this->_args.size());
+            THROW_IF_FALSE(size <= sizeof(arg_slot));
+
+            ::memcpy(this->_args[index].data, data, size);
+        }
+
+        void native_kernel::run(thread_pool& pool, const spark_work_size_t& work_size)
+        {
+            // local size has no meaning for the native entry point, which walks the flattened range
+            const size_t* globalSize = work_size.global_size;
+            const size_t count = globalSize[0] * globalSize[1] * globalSize[2];
+
+            // enough chunks per thread that threads finishing early can pick up the slack
+            const size_t grain = std::max<size_t>(count / (pool.thread_count() * 16), 1);
+
+            auto entryPoint = this->_module->_entry_point;
+            void* const* args = this->_arg_pointers.data();
+            pool.parallel_for(count, grain,
+                [=](size_t begin, size_t end)
+                {
+                    entryPoint(args, globalSize, begin, end);
+                });
+        }
+    }
+}
\ No newline at end of file
@@ -1,15 +1,337 @@
 #pragma once
 
+#include "resource.hpp"
+#include "thread_pool.hpp"
+#include "task_pool.hpp"
+#include "memory_pool.hpp"
+#include "autotune.hpp"
+#include "profiler.hpp"
+
+// lets us use OpenCL release functions with unique_any type
+#pragma GCC diagnostic ignored "-Wignored-attributes"
+
 namespace spark
 {
     namespace lib
     {
-        struct spark_context;
-        struct spark_kernel;
-        struct spark_buffer;
+        using unique_cl_context = unique_any<cl_context, decltype(&::clReleaseContext), &::clReleaseContext>;
+        using unique_command_queue = unique_any<cl_command_queue, decltype(&::clReleaseCommandQueue), &::clReleaseCommandQueue>;
+        using unique_cl_program = unique_any<cl_program, decltype(&::clReleaseProgram), &::clReleaseProgram>;
+        using unique_cl_kernel = unique_any<cl_kernel, decltype(&::clReleaseKernel), &::clReleaseKernel>;
+        using unique_cl_mem = unique_any<cl_mem, decltype(&::clReleaseMemObject), &::clReleaseMemObject>;
+        using unique_cl_event = unique_any<cl_event, decltype(&::clReleaseEvent), &::clReleaseEvent>;
+
+        struct native_module;
+
+        // validates a launch's ndrange, padding unused dimensions with 1
+        spark_work_size_t normalize_work_size(const spark_work_size_t& work_size);
+
+        /// Spark Context
+
+        struct spark_context
+        {
+            // the first device is the primary one, any others share the context and take a
+            // part of each kernel launch; no devices selects the first gpu found
+            // split_devices, when given, take the parts instead, while launches that aren't
+            // split run whole on the primary device (a device and its sub-devices)
+            spark_context(spark::shared::Backend backend, const std::vector<cl_device_id>& devices, const std::vector<cl_device_id>& split_devices = {});
+
+            // recreates the command queues with or without CL_QUEUE_PROFILING_ENABLE,
+            // waiting for outstanding work first
+            void set_profiling(bool enabled);
+
+            // adds a command queue and returns its index, falling back to in-order
+            // execution if the device doesn't support out-of-order queues
+            uint32_t create_queue(bool out_of_order);
+            void set_current_queue(uint32_t queue);
+            // the queue new commands are enqueued to
+            cl_command_queue get_queue() const;
+            bool is_out_of_order() const;
+
+            spark::shared::Backend backend;
+            spark_device_info_t device_info;
+            std::string driver_version;
+
+            // opencl backend
+            unique_cl_context context;
+            cl_device_id device_id = nullptr;
+
+            struct command_queue
+            {
+                unique_command_queue queue;
+                bool out_of_order = false;
+            };
+            // index 0 is the default in-order queue, a deque so queues never move once created;
+            // guarded by queue_mutex as commands may be enqueued from several threads
+            mutable std::mutex queue_mutex;
+            std::deque<command_queue> queues;
+            uint32_t current_queue = 0;
+            // set once commands may run concurrently (several queues or an out-of-order one),
+            // buffers then remember the events still using them so launches can wait on those
+            std::atomic<bool> track_dependencies{false};
+            // held from reading a command's buffer dependencies until its event is tracked, so
+            // commands enqueued concurrently on the same buffer wait for each other; taken before queue_mutex
+            std::mutex dependency_mutex;
+
+            // every device of a multi-device context; launches are divided between them along
+            // their outermost dimension, empty when the context has a single device
+            struct split_device
+            {
+                cl_device_id id = nullptr;
+                // always profiled, partition durations rebalance the split
+                unique_command_queue queue;
+                uint32_t compute_units = 0;
+            };
+            std::deque<split_device> split_devices;
+
+            // cpu backend
+            std::unique_ptr<thread_pool> worker_pool;
+
+            // timings of every launch and transfer, null unless profiling
+            std::unique_ptr<profiler> command_profiler;
+
+            // recycled buffer allocations, shared with live buffers so it can outlive the context
+            std::shared_ptr<memory_pool> buffer_pool = std::make_shared<memory_pool>();
+
+            // programs built on this context keyed by generated source; kernels
+            // with identical source share a program and only get their own kernel object
+            // guarded by program_mutex as kernels may be created from several threads
+            std::mutex program_mutex;
+            std::unordered_map<std::string, unique_cl_program> programs;
+            std::unordered_map<std::string, std::shared_ptr<native_module>> native_modules;
+            uint64_t program_cache_hits = 0;
+            uint64_t program_cache_misses = 0;
+            // sources currently being built in the background
+            std::unordered_map<std::string, std::shared_future<void>> pending_builds;
+
+            // compiles kernels in the background, null if builds are synchronous;
+            // declared last so queued builds finish before anything they use goes away
+            std::unique_ptr<task_pool> build_pool;
+
+            static thread_local spark_context* current;
+        };
+
+        /// Spark Buffer
+
+        struct spark_buffer
+        {
+            spark_buffer(size_t size, const void* data, spark_buffer_flags_t flags);
+            // wraps caller memory (CL_MEM_USE_HOST_PTR), which must outlive the buffer
+            spark_buffer(size_t size, void* hostPtr);
+            ~spark_buffer();
+            void write(size_t offset, size_t bytes, const void* data);
+            void read(size_t offset, size_t bytes, void* dest) const;
+            void zero(size_t offset, size_t bytes);
+
+            // enqueue without blocking, returning the command's event (null if already complete)
+            cl_event write_async(size_t offset, size_t bytes, const void* data, const std::vector<cl_event>& waitList);
+            cl_event read_async(size_t offset, size_t bytes, void* dest, const std::vector<cl_event>& waitList) const;
+            cl_event zero_async(size_t offset, size_t bytes, const std::vector<cl_event>& waitList);
+
+            // blocking map of a region into host memory, stays valid until unmap
+            void* map(size_t offset, size_t bytes, spark::shared::MapAccess access);
+            void unmap(void* ptr);
+
+            // appends the events a new command using the buffer must wait for when
+            // the context tracks dependencies, a writer waits for readers as well
+            void add_dependencies(std::vector<cl_event>& waitList, bool writes) const;
+            // remembers event as the latest command reading or writing the buffer
+            void track(cl_event event, bool writes) const;
+            void release_dependencies() const;
+
+            size_t _size;
+            // unique per buffer, a new buffer may get a destroyed one's handle back
+            const uint64_t _generation;
+            unique_cl_mem _mem;
+            // host memory backing the buffer on the cpu backend, either
+            // pooled or caller memory wrapped by the host pointer constructor
+            uint8_t* _host = nullptr;
+            // pool the allocation returns to, null if it isn't pooled
+            std::shared_ptr<memory_pool> _pool;
+            size_t _capacity = 0;
+            // retained events of the last write and every read since it, guarded
+            // by the context's dependency_mutex
+            mutable cl_event _last_write = nullptr;
+            mutable std::vector<cl_event> _reads;
+        };
+
+        /// Spark Event
+
+        struct spark_event
+        {
+            spark_event(cl_event event)
+            {
+                if(event != nullptr)
+                {
+                    _event.reset(event);
+                }
+            }
+
+            // events with an empty _event were complete on creation (cpu backend)
+            static std::vector<cl_event> get_wait_list(const spark_event* const* events, uint32_t count);
+
+            unique_cl_event _event;
+        };
+
+        /// Native Module
+
+        // kernel source compiled to a shared object by the host c++ compiler
+        struct native_module
+        {
+            native_module(const std::string& source);
+            ~native_module();
+
+            typedef void (*entry_point_t)(void* const* args, const size_t* global_size, size_t begin, size_t end);
+
+            void* _handle = nullptr;
+            entry_point_t _entry_point = nullptr;
+            uint32_t _argument_count = 0;
+        };
+
+        /// Native Kernel
+
+        // argument state for a native module, executed across the context's worker pool
+        struct native_kernel
+        {
+            native_kernel(std::shared_ptr<native_module> module);
+
+            void set_arg(uint32_t index, size_t size, const void* data);
+            void run(thread_pool& pool, const spark_work_size_t& work_size);
+
+            // large enough for any spark primitive (double4 is the largest)
+            struct alignas(32) arg_slot
+            {
+                uint8_t data[32];
+            };
+
+            std::shared_ptr<native_module> _module;
+            std::vector<arg_slot> _args;
+            std::vector<void*> _arg_pointers;
+        };
+
+        /// Spark Kernel
+
+        struct spark_kernel
+        {
+            spark_kernel(std::string&& source);
+
+            void set_arg(uint32_t index, const spark_buffer* buffer);
+            void set_arg(uint32_t index, size_t size, const void* data);
+            void bind_arg(uint32_t index, const spark_buffer* buffer, size_t size, const void* data);
+
+            // work_size must have been through normalize_work_size
+            void run(const spark_work_size_t& work_size);
+            // enqueue without blocking, returning the launch's event (null if already complete)
+            cl_event enqueue(const spark_work_size_t& work_size, const std::vector<cl_event>& waitList);
+
+            // enqueues one partition per split device and returns a marker on the current
+            // queue that completes with all of them
+            cl_event enqueue_split(spark_context* currentContext, const spark_work_size_t& work_size, const size_t* localSize, const std::vector<cl_event>& waitList);
+            // whether the bound arguments let the launch be divided between devices
+            bool can_split() const;
+            bool writes_arg(size_t index) const;
+            size_t get_max_work_group_size(spark_context* currentContext);
+            // blocks until the background build finishes and creates the kernel object,
+            // everything touching _kernel or _native calls this first
+            void wait_for_build();
+
+            // builds source and adds it to the context's shared programs (or native modules)
+            static void build(spark_context* currentContext, const std::string& source);
+            static void buildProgram(spark_context* currentContext, const std::string& source, unique_cl_program& program);
+            static void buildFromSource(spark_context* currentContext, const std::string& source, unique_cl_program& program);
+
+            std::string _source;
+            // reported by the profiler, defaults to a hash of the source
+            std::string _name;
+            spark_context* _context = nullptr;
+            // build of this kernel's source, possibly shared with other kernels
+            std::shared_future<void> _build;
+            bool _built = false;
+            unique_cl_program _program;
+            unique_cl_kernel _kernel;
+            std::unique_ptr<native_kernel> _native;
+            // id of the recorded command whose arguments are currently bound, 0 if set directly
+            uint64_t _arg_owner = 0;
+            // CL_KERNEL_WORK_GROUP_SIZE, queried on first use
+            size_t _max_work_group_size = 0;
+            // set while autotuning launches without an explicit local size
+            std::unique_ptr<work_group_tuner> _tuner;
+            // last value bound to each argument index, rebinding an unchanged one is skipped
+            struct bound_arg
+            {
+                // null for primitives
+                const spark_buffer* buffer = nullptr;
+                // buffer's _generation, 0 for primitives
+                uint64_t generation = 0;
+                uint32_t size = 0;
+                alignas(8) uint8_t data[32];
+            };
+            std::vector<bound_arg> _args;
+            // arguments actually passed to clSetKernelArg (or the native kernel) and rebinds skipped
+            uint64_t _arg_updates = 0;
+            uint64_t _arg_skips = 0;
+            // per argument whether the kernel may write through it, empty if unknown
+            std::vector<bool> _written_args;
+            // functions other than the entry point reading the global size would see their
+            // partition's instead, so those kernels always run whole
+            bool _splittable = true;
+            // index of the extra argument the opencl entry point takes the launch's global
+            // size through (see NormalizedIndex), no_argument if it doesn't read it
+            static const uint32_t no_argument = ~0u;
+            uint32_t _global_size_arg = no_argument;
+            // declared per argument index, replicated unless set
+            std::vector<spark::shared::Partition> _partitions;
+            // concurrent writes to one memory object from several devices are undefined, so
+            // every split device but the first writes its slices of a partitioned buffer to a
+            // copy of it (keyed by argument index, one per device), gathered after the launch
+            struct replica
+            {
+                size_t size = 0;
+                unique_cl_mem mem;
+            };
+            std::unordered_map<uint32_t, std::vector<replica>> _split_replicas;
+            // measured work-items per nanosecond on each split device, starts from compute units
+            std::vector<double> _split_throughput;
+            bool _split_measured = false;
+            // partitions of the previous split launch, measured on the next one
+            std::deque<unique_cl_event> _split_events;
+            std::vector<size_t> _split_items;
+        };
+
+        /// Spark Command List
+
+        // kernel launches recorded once and replayed with a single call
+        struct spark_command_list
+        {
+            struct recorded_arg
+            {
+                uint32_t index;
+                const spark_buffer* buffer;
+                std::vector<uint8_t> data;
+            };
+
+            struct command
+            {
+                uint64_t id;
+                spark_kernel* kernel;
+                spark_work_size_t work_size;
+                std::vector<recorded_arg> args;
+            };
+
+            void add_kernel(spark_kernel* kernel, const spark_work_size_t& work_size);
+            void set_arg(uint32_t index, const spark_buffer* buffer);
+            void set_arg(uint32_t index, size_t size, const void* data);
+
+            // returns the event of the final launch
+            cl_event enqueue(const std::vector<cl_event>& waitList);
+
+            std::vector<command> _commands;
+        };
     }
 }
 
 typedef struct spark::lib::spark_context spark_context_t;
 typedef struct spark::lib::spark_kernel spark_kernel_t;
-typedef struct spark::lib::spark_buffer spark_buffer_t;
\ No newline at end of file
+typedef struct spark::lib::spark_buffer spark_buffer_t;
+typedef struct spark::lib::spark_event spark_event_t;
+typedef struct spark::lib::spark_command_list spark_command_list_t;
\ No newline at end of file
@@ -1,15 +1,32 @@
 #pragma once
 
 // std
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
 #include <csignal>
 #include <cstdint>
+#include <cstdlib>
 #include <cstring>
 #include <cstdarg>
+#include <cstddef>
+#include <deque>
 #include <functional>
+#include <limits>
+#include <future>
 #include <vector>
 #include <memory>
+#include <mutex>
+#include <new>
 #include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
 #include <utility>
+#include <unordered_map>
 #include <unordered_set>
 
 // ruff
@@ -18,6 +35,10 @@
 
 // spark
 #include "spark/enums.h"
+#include "spark/device.h"
+#include "spark/work_size.h"
+#include "spark/profile.h"
+#include "spark/log.h"
 
 // opencl
 #define CL_USE_DEPRECATED_OPENCL_1_2_APIS
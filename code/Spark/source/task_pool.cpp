@@ -0,0 +1,63 @@
+#include "spark.hpp"
+
+#include "task_pool.hpp"
+
+namespace spark
+{
+    namespace lib
+    {
+        task_pool::task_pool(size_t thread_count)
+        {
+            for(size_t k = 0; k < thread_count; k++)
+            {
+                _threads.emplace_back([this] { this->worker_main(); });
+            }
+        }
+
+        task_pool::~task_pool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _shutdown = true;
+            }
+            _wake.notify_all();
+
+            for(auto& thread : _threads)
+            {
+                thread.join();
+            }
+        }
+
+        std::shared_future<void> task_pool::submit(std::function<void()> task)
+        {
+            std::packaged_task<void()> packaged(std::move(task));
+            std::shared_future<void> result = packaged.get_future().share();
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _tasks.push_back(std::move(packaged));
+            }
+            _wake.notify_one();
+            return result;
+        }
+
+        void task_pool::worker_main()
+        {
+            while(true)
+            {
+                std::packaged_task<void()> task;
+                {
+                    std::unique_lock<std::mutex> lock(_mutex);
+                    _wake.wait(lock, [this] { return _shutdown || !_tasks.empty(); });
+                    // drain the queue before exiting so nobody waits on a task that never runs
+                    if(_tasks.empty())
+                    {
+                        return;
+                    }
+                    task = std::move(_tasks.front());
+                    _tasks.pop_front();
+                }
+                task();
+            }
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,32 @@
+#pragma once
+
+namespace spark
+{
+    namespace lib
+    {
+        // fixed size pool of threads running queued tasks in submission order, used to
+        // build kernels in the background; the destructor finishes queued tasks first
+        class task_pool
+        {
+        public:
+            explicit task_pool(size_t thread_count);
+            ~task_pool();
+
+            task_pool(const task_pool&) = delete;
+            task_pool& operator=(const task_pool&) = delete;
+
+            // the returned future rethrows anything the task threw
+            std::shared_future<void> submit(std::function<void()> task);
+
+        private:
+            void worker_main();
+
+            std::vector<std::thread> _threads;
+
+            std::mutex _mutex;
+            std::condition_variable _wake;
+            std::deque<std::packaged_task<void()>> _tasks;
+            bool _shutdown = false;
+        };
+    }
+}
\ No newline at end of file
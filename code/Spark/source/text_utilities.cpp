@@ -7,6 +7,75 @@ namespace spark
 {
     namespace lib
     {
+        string_builder::string_builder()
+        {
+            // most kernels fit without growing
+            _buffer.reserve(4096);
+        }
+
+        void string_builder::append_int(int64_t value)
+        {
+            if(value < 0)
+            {
+                _buffer.push_back('-');
+                // negate as unsigned so INT64_MIN doesn't overflow
+                this->append_uint(0 - static_cast<uint64_t>(value));
+            }
+            else
+            {
+                this->append_uint(static_cast<uint64_t>(value));
+            }
+        }
+
+        void string_builder::append_uint(uint64_t value)
+        {
+            // digits are produced least significant first
+            char digits[20];
+            size_t count = 0;
+            do
+            {
+                digits[sizeof(digits) - 1 - count++] = static_cast<char>('0' + value % 10);
+                value /= 10;
+            } while(value != 0);
+            _buffer.append(digits + sizeof(digits) - count, count);
+        }
+
+        void string_builder::append_format(const char* format, ...)
+        {
+            va_list args1, args2;
+
+            va_start(args1, format);
+            va_copy(args2, args1);
+            char local[128];
+            auto len = vsnprintf(local, sizeof(local), format, args1);
+            va_end(args1);
+            SPARK_ASSERT(len >= 0);
+
+            if(static_cast<size_t>(len) < sizeof(local))
+            {
+                _buffer.append(local, len);
+            }
+            else
+            {
+                // only formatted again when it didn't fit on the stack
+                const auto offset = _buffer.size();
+                _buffer.resize(offset + len);
+                vsnprintf(&_buffer[offset], len + 1, format, args2);
+            }
+            va_end(args2);
+        }
+
+        int32_t copy_to_buffer(const std::string& source, char* out_buffer, int32_t buffer_size)
+        {
+            const auto required = static_cast<int32_t>(source.size() + 1);
+            if(out_buffer != nullptr)
+            {
+                SPARK_ASSERT(buffer_size >= required);
+                std::memcpy(out_buffer, source.c_str(), required);
+            }
+            return required;
+        }
+
         std::string string_format(const char* format, ...)
         {
             va_list args1, args2;
@@ -4,59 +4,80 @@ namespace spark
 {
     namespace lib
     {
+        // growable output buffer the code generators write into in a single pass
+        class string_builder
+        {
+        public:
+            string_builder();
+
+            void append(const char* str, size_t len)
+            {
+                _buffer.append(str, len);
+            }
+
+            // N includes terminating null, which we don't copy
+            template<size_t N>
+            void append(const char (&literal)[N])
+            {
+                _buffer.append(literal, N - 1);
+            }
+
+            void append_string(const char* str)
+            {
+                _buffer.append(str);
+            }
+
+            void append_int(int64_t value);
+            void append_uint(uint64_t value);
+            void append_format(const char* format, ...);
+
+            size_t size() const { return _buffer.size(); }
+            std::string release() { return std::move(_buffer); }
+
+        private:
+            std::string _buffer;
+        };
+
         template<typename T>
         struct codegen_context : public T
         {
-            char* buffer = nullptr;
-            int32_t capacity = 0;
-            int32_t written = 0;
+            string_builder out;
         };
 
-        template<int32_t N, typename... Args>
-        int32_t doSnprintf(char* buffer, int32_t buffer_size, int32_t written, const char (&format)[N], const Args... args)
+        template<typename Context, size_t N>
+        void emit(codegen_context<Context>& ctx, const char (&literal)[N])
         {
-            auto nullOrOffset = [](char* buffer, uint32_t offset) -> char*
-            {
-                return buffer + (buffer ? 1 : 0) * offset;
-            };
-
-            SPARK_ASSERT(written >= 0);
-            auto len = snprintf(nullOrOffset(buffer, written),  buffer_size == 0 ? 0 : buffer_size - written, format, args...);
+            ctx.out.append(literal);
+        }
 
-            SPARK_ASSERT(len >= 0);
-            SPARK_ASSERT(buffer_size == 0 || (written + len < buffer_size));
+        template<typename Context, typename Arg, typename... Args>
+        void emit(codegen_context<Context>& ctx, const char* format, const Arg arg, const Args... args)
+        {
+            ctx.out.append_format(format, arg, args...);
+        }
 
-            return (written + len);
+        template<typename Context>
+        void emit_string(codegen_context<Context>& ctx, const char* str)
+        {
+            ctx.out.append_string(str);
         }
 
-        template<int32_t N>
-        int32_t doSnprintf(char* buffer, int32_t buffer_size, int32_t written, const char (&literal)[N])
+        template<typename Context>
+        void emit_int(codegen_context<Context>& ctx, int64_t value)
         {
-            // N includes terminating null, which we don't count here
-            const auto len = N - 1;
-            if(buffer == nullptr)
-            {
-                SPARK_ASSERT(buffer_size == 0);
-            }
-            else
-            {
-                SPARK_ASSERT(written + len < buffer_size);
-                memcpy(buffer + written, (void*)literal, (N));
-            }
-            return (written + len);
+            ctx.out.append_int(value);
         }
 
-        template<typename Context, int32_t N, typename... Args>
-        void doSnprintf(codegen_context<Context>& ctx, const char (&format)[N], const Args... args)
+        template<typename Context>
+        void emit_uint(codegen_context<Context>& ctx, uint64_t value)
         {
-            ctx.written = doSnprintf(
-                ctx.buffer,
-                ctx.capacity,
-                ctx.written,
-                format,
-                args...);
+            ctx.out.append_uint(value);
         }
 
+        // copies source into out_buffer when it is large enough and returns the size
+        // required including the null terminator, for the measure-then-write c api
+        int32_t copy_to_buffer(const std::string& source, char* out_buffer, int32_t buffer_size);
+
         std::string string_format(const char* format, ...);
     }
 }
\ No newline at end of file
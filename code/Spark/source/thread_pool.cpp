@@ -0,0 +1,112 @@
+#include "spark.hpp"
+
+#include "thread_pool.hpp"
+
+namespace spark
+{
+    namespace lib
+    {
+        thread_pool::thread_pool(size_t thread_count)
+        : _next(0)
+        {
+            // calling thread participates in parallel_for, so only spin up the remainder
+            for(size_t k = 1; k < thread_count; k++)
+            {
+                _threads.emplace_back([this] { this->worker_main(); });
+            }
+        }
+
+        thread_pool::~thread_pool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _shutdown = true;
+            }
+            _wake.notify_all();
+
+            for(auto& thread : _threads)
+            {
+                thread.join();
+            }
+        }
+
+        size_t thread_pool::thread_count() const
+        {
+            return _threads.size() + 1;
+        }
+
+        void thread_pool::parallel_for(size_t count, size_t grain, const std::function<void(size_t, size_t)>& func)
+        {
+            if(count == 0)
+            {
+                return;
+            }
+            grain = std::max<size_t>(grain, 1);
+
+            // nothing to share, run inline
+            if(_threads.empty() || count <= grain)
+            {
+                func(0, count);
+                return;
+            }
+
+            std::lock_guard<std::mutex> submitLock(_submit_mutex);
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _func = &func;
+                _count = count;
+                _grain = grain;
+                _next.store(0);
+                _active = _threads.size();
+                _generation++;
+            }
+            _wake.notify_all();
+
+            this->run_chunks();
+
+            // wait for the workers to drain out
+            std::unique_lock<std::mutex> lock(_mutex);
+            _done.wait(lock, [this] { return _active == 0; });
+            _func = nullptr;
+        }
+
+        void thread_pool::run_chunks()
+        {
+            while(true)
+            {
+                const size_t begin = _next.fetch_add(_grain);
+                if(begin >= _count)
+                {
+                    break;
+                }
+                const size_t end = std::min(begin + _grain, _count);
+                (*_func)(begin, end);
+            }
+        }
+
+        void thread_pool::worker_main()
+        {
+            uint64_t seenGeneration = 0;
+            while(true)
+            {
+                {
+                    std::unique_lock<std::mutex> lock(_mutex);
+                    _wake.wait(lock, [&] { return _shutdown || _generation != seenGeneration; });
+                    if(_shutdown)
+                    {
+                        return;
+                    }
+                    seenGeneration = _generation;
+                }
+
+                this->run_chunks();
+
+                {
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    _active--;
+                }
+                _done.notify_one();
+            }
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,49 @@
+#pragma once
+
+namespace spark
+{
+    namespace lib
+    {
+        // fixed size pool of worker threads used to execute kernels on the cpu backend
+        class thread_pool
+        {
+        public:
+            explicit thread_pool(size_t thread_count);
+            ~thread_pool();
+
+            thread_pool(const thread_pool&) = delete;
+            thread_pool& operator=(const thread_pool&) = delete;
+
+            // number of threads participating in parallel_for (including the calling thread)
+            size_t thread_count() const;
+
+            // invokes func(begin, end) over [0, count) in chunks of at most grain items;
+            // idle threads keep claiming the next unprocessed chunk until the range is
+            // exhausted, so uneven work items balance out across the pool
+            // blocks until every chunk has completed
+            void parallel_for(size_t count, size_t grain, const std::function<void(size_t, size_t)>& func);
+
+        private:
+            void worker_main();
+            void run_chunks();
+
+            std::vector<std::thread> _threads;
+
+            // serializes concurrent parallel_for callers
+            std::mutex _submit_mutex;
+
+            std::mutex _mutex;
+            std::condition_variable _wake;
+            std::condition_variable _done;
+            uint64_t _generation = 0;
+            size_t _active = 0;
+            bool _shutdown = false;
+
+            // current job
+            const std::function<void(size_t, size_t)>* _func = nullptr;
+            size_t _count = 0;
+            size_t _grain = 0;
+            std::atomic<size_t> _next;
+        };
+    }
+}
\ No newline at end of file
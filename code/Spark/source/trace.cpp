@@ -0,0 +1,192 @@
+#include "spark.hpp"
+
+#include "trace.hpp"
+#include "error.hpp"
+
+// posix
+#include <unistd.h>
+#include <sys/syscall.h>
+
+using std::string;
+
+namespace spark
+{
+    namespace lib
+    {
+        namespace trace
+        {
+            // spans kept per thread, older ones are overwritten
+            static const size_t ringCapacity = 16384;
+
+            struct span
+            {
+                const char* category;
+                char name[56];
+                uint64_t start;
+                uint64_t end;
+            };
+
+            struct ring
+            {
+                // only contended while a trace is being written
+                std::mutex mutex;
+                std::vector<span> spans;
+                size_t next = 0;
+                uint64_t thread_id = 0;
+            };
+
+            static const char* getTracePath()
+            {
+                const char* path = ::getenv("SPARK_TRACE");
+                return (path != nullptr && *path != 0) ? path : nullptr;
+            }
+
+            static std::atomic<bool> g_enabled(getTracePath() != nullptr);
+
+            // rings outlive their threads so spans from finished threads still get written
+            static std::mutex g_ringsMutex;
+            static std::vector<std::shared_ptr<ring>> g_rings;
+
+            static ring& getThreadRing()
+            {
+                thread_local std::shared_ptr<ring> threadRing;
+                if(!threadRing)
+                {
+                    threadRing = std::make_shared<ring>();
+                    threadRing->spans.reserve(ringCapacity);
+                    threadRing->thread_id = static_cast<uint64_t>(::syscall(SYS_gettid));
+
+                    std::lock_guard<std::mutex> lock(g_ringsMutex);
+                    g_rings.push_back(threadRing);
+                }
+                return *threadRing;
+            }
+
+            bool enabled()
+            {
+                return g_enabled.load(std::memory_order_relaxed);
+            }
+
+            void set_enabled(bool enabled)
+            {
+                g_enabled.store(enabled);
+            }
+
+            uint64_t now()
+            {
+                return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+            }
+
+            void record(const char* category, const char* name, uint64_t start, uint64_t end)
+            {
+                auto& threadRing = getThreadRing();
+
+                span entry;
+                entry.category = category;
+                ::snprintf(entry.name, sizeof(entry.name), "%s", name);
+                entry.start = start;
+                entry.end = end;
+
+                std::lock_guard<std::mutex> lock(threadRing.mutex);
+                if(threadRing.spans.size() < ringCapacity)
+                {
+                    threadRing.spans.push_back(entry);
+                }
+                else
+                {
+                    threadRing.spans[threadRing.next] = entry;
+                    threadRing.next = (threadRing.next + 1) % ringCapacity;
+                }
+            }
+
+            // names come from users (kernel names) so may need escaping
+            static void writeEscaped(FILE* file, const char* str)
+            {
+                for(; *str != 0; str++)
+                {
+                    const char c = *str;
+                    if(c == '"' || c == '\\')
+                    {
+                        ::fputc('\\', file);
+                        ::fputc(c, file);
+                    }
+                    else if(static_cast<unsigned char>(c) < 0x20)
+                    {
+                        ::fprintf(file, "\\u%04x", c);
+                    }
+                    else
+                    {
+                        ::fputc(c, file);
+                    }
+                }
+            }
+
+            bool write(const string& path)
+            {
+                FILE* file = ::fopen(path.c_str(), "w");
+                if(file == nullptr)
+                {
+                    return false;
+                }
+
+                std::vector<std::shared_ptr<ring>> rings;
+                {
+                    std::lock_guard<std::mutex> lock(g_ringsMutex);
+                    rings = g_rings;
+                }
+
+                const auto processId = static_cast<unsigned long long>(::getpid());
+                bool first = true;
+                ::fprintf(file, "{\"traceEvents\":[\n");
+                for(auto& threadRing : rings)
+                {
+                    std::lock_guard<std::mutex> lock(threadRing->mutex);
+                    for(const auto& entry : threadRing->spans)
+                    {
+                        ::fprintf(file, "%s{\"name\":\"", first ? "" : ",\n");
+                        writeEscaped(file, entry.name);
+                        ::fprintf(file, "\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%llu,\"dur\":%llu,\"pid\":%llu,\"tid\":%llu}",
+                            entry.category,
+                            static_cast<unsigned long long>(entry.start),
+                            static_cast<unsigned long long>(entry.end - entry.start),
+                            processId,
+                            static_cast<unsigned long long>(threadRing->thread_id));
+                        first = false;
+                    }
+                }
+                ::fprintf(file, "\n],\"displayTimeUnit\":\"ms\"}\n");
+
+                return ::fclose(file) == 0;
+            }
+
+            void write_default()
+            {
+                if(const char* path = getTracePath())
+                {
+                    write(path);
+                }
+            }
+        }
+    }
+}
+
+RUFF_EXPORT void spark_set_tracing(bool enabled, spark_error_t** error)
+{
+    return TranslateExceptions(
+        error,
+        [&]
+        {
+            spark::lib::trace::set_enabled(enabled);
+        });
+}
+
+RUFF_EXPORT void spark_write_trace(const char* path, spark_error_t** error)
+{
+    return TranslateExceptions(
+        error,
+        [&]
+        {
+            THROW_IF_NULL(path);
+            THROW_IF_FALSE(spark::lib::trace::write(path));
+        });
+}
\ No newline at end of file
@@ -0,0 +1,56 @@
+#pragma once
+
+namespace spark
+{
+    namespace lib
+    {
+        // timeline of host-side spark activity (ast construction, codegen, program builds,
+        // transfers, launches and waits) written as chrome trace-event json
+        // setting SPARK_TRACE to a path enables tracing at startup and writes the trace
+        // there whenever a context is destroyed
+        namespace trace
+        {
+            bool enabled();
+            void set_enabled(bool enabled);
+
+            // monotonic microseconds
+            uint64_t now();
+
+            // records a complete span on the calling thread's ring buffer; name is copied
+            // (truncated if long) so it need not outlive the call
+            void record(const char* category, const char* name, uint64_t start, uint64_t end);
+
+            // writes every recorded span as trace-event json, returns false on io failure
+            bool write(const std::string& path);
+            // writes to $SPARK_TRACE if set
+            void write_default();
+
+            // records its own lifetime as a span when tracing is enabled
+            class scope
+            {
+            public:
+                scope(const char* category, const char* name)
+                : _category(category)
+                , _name(name)
+                , _start(enabled() ? now() : 0)
+                { }
+
+                ~scope()
+                {
+                    if(this->_start != 0)
+                    {
+                        record(this->_category, this->_name, this->_start, now());
+                    }
+                }
+
+                scope(const scope&) = delete;
+                scope& operator=(const scope&) = delete;
+
+            private:
+                const char* _category;
+                const char* _name;
+                uint64_t _start;
+            };
+        }
+    }
+}
\ No newline at end of file
@@ -1,11 +1,25 @@
+#include <algorithm>
 #include <cmath>
 #include <cstdio>
+#include <cstring>
 #include <memory>
 #include <iostream>
+#include <fstream>
+#include <iterator>
+#include <limits>
 #include <functional>
 #include <typeinfo>
 #include <vector>
 #include <set>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <exception>
+
+// posix
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 using std::cout;
 using std::endl;
@@ -24,6 +38,11 @@ using std::unique_ptr;
 #include <spark.h>
 using namespace spark;
 using namespace spark::client;
+using spark::shared::Backend;
+using spark::shared::BufferFlags;
+using spark::shared::DeviceType;
+using spark::shared::MapAccess;
+using spark::shared::Partition;
 
 // EasyBMP
 #include <EasyBMP.h>
@@ -83,7 +102,8 @@ void make_mandelbrot()
     auto context = spark_create_context(SPARK_THROW_ON_ERROR());
     spark_set_current_context(context, SPARK_THROW_ON_ERROR());
 
-    device_buffer2d<uint8_t> device_fractal(2800, 1600, nullptr);
+    // every pixel is written by the kernel
+    device_buffer2d<uint8_t> device_fractal(2800, 1600, uninitialized);
     const int32_t max_iterations = 1024;
 
     // mandelbrot generating code
@@ -114,15 +134,16 @@ void make_mandelbrot()
         main.SetEntryPoint();
     };
     mandelbrot.set_work_dimensions(device_fractal.width(), device_fractal.height());
+    // each row of the launch writes its own row of the fractal, so a multi-device context can split it
+    mandelbrot.set_partition(2, Partition::Partitioned);
 
     // call kernel
     float2 min = {2.5f, 1.0f};
     float2 max = {-1.0f, -1.0f};
     mandelbrot(min, max, device_fractal);
 
-    // bring fractal to device memory
-    unique_ptr<uint8_t[]> host_fractal(new uint8_t[device_fractal.count()]);
-    device_fractal.read(host_fractal.get());
+    // view fractal in host memory
+    auto host_fractal = device_fractal.map(MapAccess::Read);
 
     // write to bmp
     BMP bmp_fractal;
@@ -258,6 +279,1568 @@ void verify_buffer_view2d()
 
 #define RUN_TEST(X) current_test = #X; if(tests.find(current_test) != tests.end() || tests.size() == 0) X();
 
+// a context made current for the rest of a test, destroyed at the end of the scope
+// with the previously current context restored so later tests don't inherit it
+struct test_context
+{
+    template<typename CREATE>
+    test_context(CREATE create)
+    : previous(spark_get_current_context(SPARK_THROW_ON_ERROR()))
+    , context(create())
+    {
+        spark_set_current_context(context, SPARK_THROW_ON_ERROR());
+    }
+
+    ~test_context()
+    {
+        spark_destroy_context(context, nullptr);
+        if(previous != nullptr)
+        {
+            spark_set_current_context(previous, nullptr);
+        }
+    }
+
+    operator spark_context_t*() const
+    {
+        return context;
+    }
+
+    spark_context_t* previous;
+    spark_context_t* context;
+};
+
+// a private SPARK_CACHE_DIR for the rest of a test, removed along with its contents
+// at the end of the scope
+struct test_cache_directory
+{
+    test_cache_directory()
+    : previous(::getenv("SPARK_CACHE_DIR") ? ::getenv("SPARK_CACHE_DIR") : "")
+    , had_previous(::getenv("SPARK_CACHE_DIR") != nullptr)
+    {
+        char pattern[] = "/tmp/spark-cache-XXXXXX";
+        SPARK_VERIFY(::mkdtemp(pattern) != nullptr);
+        path = pattern;
+        ::setenv("SPARK_CACHE_DIR", path.c_str(), 1);
+    }
+
+    ~test_cache_directory()
+    {
+        for(const auto& file : files(""))
+        {
+            ::unlink(file.c_str());
+        }
+        ::rmdir(path.c_str());
+        if(had_previous)
+        {
+            ::setenv("SPARK_CACHE_DIR", previous.c_str(), 1);
+        }
+        else
+        {
+            ::unsetenv("SPARK_CACHE_DIR");
+        }
+    }
+
+    // paths of the cached files ending in suffix
+    std::vector<std::string> files(const std::string& suffix) const
+    {
+        std::vector<std::string> result;
+        DIR* dir = ::opendir(path.c_str());
+        SPARK_ASSERT(dir != nullptr);
+        while(dirent* entry = ::readdir(dir))
+        {
+            const std::string name = entry->d_name;
+            if(name[0] != '.' && name.size() >= suffix.size() && name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0)
+            {
+                result.push_back(path + "/" + name);
+            }
+        }
+        ::closedir(dir);
+        return result;
+    }
+
+    std::string path;
+    std::string previous;
+    bool had_previous;
+};
+
+// generated entry point of a kernel, which has the same shape on both backends
+std::string entry_source(const char* source)
+{
+    const std::string text = source;
+    const auto begin = text.find(" entry_point(");
+    SPARK_ASSERT(begin != std::string::npos);
+    return text.substr(begin, text.find("\n}\n", begin) - begin);
+}
+
+// SPARK_OPTIMIZE=0 leaves kernels as written, so there's nothing to check in their source
+bool optimizer_enabled()
+{
+    const char* optimize = ::getenv("SPARK_OPTIMIZE");
+    return optimize == nullptr || ::strcmp(optimize, "0") != 0;
+}
+
+size_t count_of(const std::string& text, const std::string& pattern)
+{
+    size_t count = 0;
+    for(size_t pos = text.find(pattern); pos != std::string::npos; pos = text.find(pattern, pos + pattern.size()))
+    {
+        count++;
+    }
+    return count;
+}
+
+void verify_command_list()
+{
+    const size_t count = 64;
+    const int32_t iterations = 3;
+
+    int32_t initial[count];
+    for(size_t k = 0; k < count; k++)
+    {
+        initial[k] = k;
+    }
+    device_buffer1d<int32_t> values(count, initial);
+
+    Kernel<Void(BufferView1D<Int>, Int)> add = []()
+    {
+        auto main = MakeFunction([](BufferView1D<Int> values, Int amount)
+        {
+            Int idx = Index().X;
+            values[idx] = values[idx] + amount;
+        });
+        main.SetEntryPoint();
+    };
+    add.set_work_dimensions(count);
+
+    Kernel<Void(BufferView1D<Int>)> twice = []()
+    {
+        auto main = MakeFunction([](BufferView1D<Int> values)
+        {
+            Int idx = Index().X;
+            values[idx] = values[idx] * 2;
+        });
+        main.SetEntryPoint();
+    };
+    twice.set_work_dimensions(count);
+
+    command_list commands;
+    add.record(commands, values, 1);
+    twice.record(commands, values);
+
+    for(int32_t k = 0; k < iterations; k++)
+    {
+        commands.run();
+        // direct launch in between forces the recorded arguments to be rebound
+        add(values, 0);
+    }
+
+    int32_t result[count];
+    values.read(result);
+
+    for(size_t k = 0; k < count; k++)
+    {
+        int32_t expected = k;
+        for(int32_t i = 0; i < iterations; i++)
+        {
+            expected = (expected + 1) * 2;
+        }
+        SPARK_ASSERT(result[k] == expected);
+    }
+}
+
+
+void verify_local_size()
+{
+    // whether launch got past the runtime's work size checks
+    auto launches = [](std::function<void()> launch)
+    {
+        try
+        {
+            launch();
+            return true;
+        }
+        catch(std::exception&)
+        {
+            return false;
+        }
+    };
+
+    const size_t width = 64;
+    const size_t height = 32;
+    device_buffer1d<int32_t> values(width * height);
+
+    Kernel<Void(BufferView1D<Int>)> fill = []()
+    {
+        auto main = MakeFunction([](BufferView1D<Int> values)
+        {
+            Int idx = Index().X;
+            values[idx] = idx * 3;
+        });
+        main.SetEntryPoint();
+    };
+
+    Kernel<Void(Buffer2D<Int>)> fill2d = []()
+    {
+        auto main = MakeFunction([](Buffer2D<Int> values)
+        {
+            Int2 idx = Index();
+            values[idx] = idx.Y * 1000 + idx.X;
+        });
+        main.SetEntryPoint();
+    };
+
+    // a local size has to divide the global size
+    fill.set_work_dimensions(width);
+    fill.set_local_size(24);
+    SPARK_ASSERT(!launches([&]{ fill(values); }));
+
+    fill2d.set_work_dimensions(width, height);
+    fill2d.set_local_size(8, 5);
+    device_buffer2d<int32_t> grid(width, height);
+    SPARK_ASSERT(!launches([&]{ fill2d(grid); }));
+
+    // valid explicit shapes in one and two dimensions
+    fill.set_local_size(16);
+    fill(values);
+    std::vector<int32_t> result(width);
+    values.read(0, width, result.data());
+    for(size_t k = 0; k < width; k++)
+    {
+        SPARK_ASSERT(result[k] == int32_t(k * 3));
+    }
+
+    fill2d.set_local_size(8, 4);
+    fill2d(grid);
+    std::vector<int32_t> cells(width * height);
+    grid.read(cells.data());
+    for(size_t y = 0; y < height; y++)
+    {
+        for(size_t x = 0; x < width; x++)
+        {
+            SPARK_ASSERT(cells[y * width + x] == int32_t(y * 1000 + x));
+        }
+    }
+
+    // the cpu backend has no work-groups, so there is no group size limit to exceed
+    spark_device_info_t info;
+    spark_get_context_device_info(spark_get_current_context(SPARK_THROW_ON_ERROR()), &info, SPARK_THROW_ON_ERROR());
+    if(std::string(info.name) == "host")
+    {
+        return;
+    }
+
+    // no kernel fits more work-items in a group than its device
+    const size_t oversized = info.max_work_group_size * 2;
+    device_buffer1d<int32_t> large(oversized);
+    fill.set_work_dimensions(oversized);
+    fill.set_local_size(oversized);
+    SPARK_ASSERT(!launches([&]{ fill(large); }));
+}
+void verify_pinned_transfers()
+{
+    const size_t count = 256;
+
+    pinned_buffer<float> staging(count);
+    for(size_t k = 0; k < count; k++)
+    {
+        staging[k] = k;
+    }
+
+    Kernel<Void(BufferView1D<Float>)> square = []()
+    {
+        auto main = MakeFunction([](BufferView1D<Float> values)
+        {
+            Int idx = Index().X;
+            values[idx] = values[idx] * values[idx];
+        });
+        main.SetEntryPoint();
+    };
+    square.set_work_dimensions(count);
+
+    device_buffer1d<float> values(count);
+    auto written = values.write_async(staging.data());
+    auto squared = square.run_async({written}, values);
+    values.read_async(staging.data(), {squared}).wait();
+
+    for(size_t k = 0; k < count; k++)
+    {
+        SPARK_ASSERT(staging[k] == float(k) * float(k));
+    }
+
+    // kernel writes straight into caller memory, so read-only memory can't be wrapped
+    static_assert(!std::is_constructible<device_buffer1d<float>, size_t, const float*, use_host_ptr_t>::value, "const memory wrapped");
+    device_buffer1d<float> wrapped(count, staging.data(), use_host_ptr);
+    square(wrapped);
+    {
+        auto view = wrapped.map(MapAccess::Read);
+        for(size_t k = 0; k < count; k++)
+        {
+            const float squared = float(k) * float(k);
+            SPARK_ASSERT(view[k] == squared * squared);
+        }
+    }
+}
+
+void verify_buffer_pool()
+{
+    // fresh context so the statistics only reflect this test
+    test_context context([]()
+    {
+        return spark_create_context(SPARK_THROW_ON_ERROR());
+    });
+
+    const size_t count = 1000;
+    {
+        device_buffer1d<int32_t> scratch(count);
+        int32_t ones[count];
+        std::fill(ones, ones + count, 1);
+        scratch.write(ones);
+    }
+
+    uint64_t hits = 0;
+    uint64_t cached_bytes = 0;
+    spark_get_buffer_pool_stats(context, &hits, nullptr, &cached_bytes, SPARK_THROW_ON_ERROR());
+    SPARK_ASSERT(hits == 0);
+    SPARK_ASSERT(cached_bytes >= count * sizeof(int32_t));
+
+    // same size class reuses the released allocation, which must come back zeroed
+    device_buffer1d<int32_t> reused(count - 1);
+    spark_get_buffer_pool_stats(context, &hits, nullptr, &cached_bytes, SPARK_THROW_ON_ERROR());
+    SPARK_ASSERT(hits == 1);
+    SPARK_ASSERT(cached_bytes == 0);
+
+    int32_t result[count - 1];
+    reused.read(result);
+    for(size_t k = 0; k < count - 1; k++)
+    {
+        SPARK_ASSERT(result[k] == 0);
+    }
+
+    // 5000 bytes lands in the 5120 byte class between 4096 and 8192
+    {
+        device_buffer1d<int32_t> odd(1250);
+    }
+    spark_get_buffer_pool_stats(context, nullptr, nullptr, &cached_bytes, SPARK_THROW_ON_ERROR());
+    SPARK_ASSERT(cached_bytes == 5120);
+}
+
+void verify_profiling()
+{
+    test_context context([]()
+    {
+        return spark_create_context(SPARK_THROW_ON_ERROR());
+    });
+    spark_set_profiling(context, true, SPARK_THROW_ON_ERROR());
+
+    const size_t count = 128;
+    const uint64_t launches = 3;
+
+    Kernel<Void(BufferView1D<Int>)> increment = []()
+    {
+        auto main = MakeFunction([](BufferView1D<Int> values)
+        {
+            Int idx = Index().X;
+            values[idx] = values[idx] + 1;
+        });
+        main.SetEntryPoint();
+    };
+    increment.set_name("increment");
+    increment.set_work_dimensions(count);
+
+    device_buffer1d<int32_t> values(count);
+    for(uint64_t k = 0; k < launches; k++)
+    {
+        increment(values);
+    }
+
+    spark_profile_stats_t stats[8];
+    const size_t statsCount = spark_get_profile_stats(context, stats, 8, SPARK_THROW_ON_ERROR());
+    SPARK_ASSERT(statsCount <= 8);
+
+    bool found = false;
+    for(size_t k = 0; k < statsCount; k++)
+    {
+        if(std::string(stats[k].name) == "increment")
+        {
+            found = true;
+            SPARK_ASSERT(stats[k].count == launches);
+            SPARK_ASSERT(stats[k].min_ns <= stats[k].p50_ns);
+            SPARK_ASSERT(stats[k].p50_ns <= stats[k].p99_ns);
+            SPARK_ASSERT(stats[k].p99_ns <= stats[k].max_ns);
+        }
+    }
+    SPARK_ASSERT(found);
+
+    spark_reset_profile_stats(context, SPARK_THROW_ON_ERROR());
+    SPARK_ASSERT(spark_get_profile_stats(context, nullptr, 0, SPARK_THROW_ON_ERROR()) == 0);
+}
+
+void verify_logging()
+{
+    static const spark_log_callback_t collect = [](spark_log_level_t, const char* message, void* user_data)
+    {
+        static_cast<std::vector<std::string>*>(user_data)->push_back(message);
+    };
+    std::vector<std::string> messages;
+    spark_set_log_callback(collect, &messages, SPARK_THROW_ON_ERROR());
+
+    // kernel source is only reported at debug level
+    spark_set_log_level(static_cast<spark_log_level_t>(spark::shared::LogLevel::Debug), SPARK_THROW_ON_ERROR());
+    Kernel<Void(BufferView1D<Int>)> clear = []()
+    {
+        auto main = MakeFunction([](BufferView1D<Int> values)
+        {
+            values[Index().X] = 0;
+        });
+        main.SetEntryPoint();
+    };
+    spark_set_log_level(static_cast<spark_log_level_t>(spark::shared::LogLevel::Warning), SPARK_THROW_ON_ERROR());
+    spark_set_log_callback(nullptr, nullptr, SPARK_THROW_ON_ERROR());
+
+    bool found = false;
+    for(const auto& message : messages)
+    {
+        found |= message.find(" source:\n") != std::string::npos;
+    }
+    SPARK_ASSERT(found);
+
+    // callbacks run outside the sink's lock, so one may replace itself without deadlocking
+    messages.clear();
+    spark_set_log_callback([](spark_log_level_t level, const char* message, void* user_data)
+        {
+            spark_set_log_callback(collect, user_data, nullptr);
+            collect(level, message, user_data);
+        }, &messages, SPARK_THROW_ON_ERROR());
+    spark_set_log_level(static_cast<spark_log_level_t>(spark::shared::LogLevel::Debug), SPARK_THROW_ON_ERROR());
+    Kernel<Void(BufferView1D<Int>)> fill = []()
+    {
+        auto main = MakeFunction([](BufferView1D<Int> values)
+        {
+            values[Index().X] = 1;
+        });
+        main.SetEntryPoint();
+    };
+    spark_set_log_level(static_cast<spark_log_level_t>(spark::shared::LogLevel::Warning), SPARK_THROW_ON_ERROR());
+    spark_set_log_callback(nullptr, nullptr, SPARK_THROW_ON_ERROR());
+    SPARK_ASSERT(std::any_of(messages.begin(), messages.end(), [](const std::string& message)
+    {
+        return message.find(" source:\n") != std::string::npos;
+    }));
+
+    // source is reported even when a synchronous build throws; a bad compiler flag
+    // fails the cpu backend's build
+    spark_device_info_t info;
+    spark_get_context_device_info(spark_get_current_context(SPARK_THROW_ON_ERROR()), &info, SPARK_THROW_ON_ERROR());
+    if(std::string(info.name) == "host")
+    {
+        test_cache_directory directory;
+        ::setenv("SPARK_BUILD_THREADS", "0", 1);
+        ::setenv("SPARK_CPU_CXXFLAGS", "--not-a-flag", 1);
+        test_context context([]()
+        {
+            return spark_create_context(SPARK_THROW_ON_ERROR());
+        });
+
+        messages.clear();
+        spark_set_log_callback(collect, &messages, SPARK_THROW_ON_ERROR());
+        spark_set_log_level(static_cast<spark_log_level_t>(spark::shared::LogLevel::Debug), SPARK_THROW_ON_ERROR());
+        bool threw = false;
+        try
+        {
+            Kernel<Void(BufferView1D<Int>)> broken = []()
+            {
+                auto main = MakeFunction([](BufferView1D<Int> values)
+                {
+                    values[Index().X] = 2;
+                });
+                main.SetEntryPoint();
+            };
+        }
+        catch(std::exception&)
+        {
+            threw = true;
+        }
+        spark_set_log_level(static_cast<spark_log_level_t>(spark::shared::LogLevel::Warning), SPARK_THROW_ON_ERROR());
+        spark_set_log_callback(nullptr, nullptr, SPARK_THROW_ON_ERROR());
+        ::unsetenv("SPARK_CPU_CXXFLAGS");
+        ::unsetenv("SPARK_BUILD_THREADS");
+
+        SPARK_ASSERT(threw);
+        SPARK_ASSERT(std::any_of(messages.begin(), messages.end(), [](const std::string& message)
+        {
+            return message.find(" source:\n") != std::string::npos;
+        }));
+    }
+}
+
+void verify_tracing()
+{
+    spark_set_tracing(true, SPARK_THROW_ON_ERROR());
+
+    Kernel<Void(BufferView1D<Int>)> negate = []()
+    {
+        auto main = MakeFunction([](BufferView1D<Int> values)
+        {
+            Int idx = Index().X;
+            values[idx] = -values[idx];
+        });
+        main.SetEntryPoint();
+    };
+    negate.set_name("negate");
+    negate.set_work_dimensions(16);
+
+    device_buffer1d<int32_t> values(16);
+    negate(values);
+
+    spark_set_tracing(false, SPARK_THROW_ON_ERROR());
+
+    // written somewhere private rather than the working directory
+    char path[] = "/tmp/spark-trace-XXXXXX";
+    const int descriptor = ::mkstemp(path);
+    SPARK_ASSERT(descriptor != -1);
+    ::close(descriptor);
+    spark_write_trace(path, SPARK_THROW_ON_ERROR());
+
+    std::ifstream file(path);
+    std::string trace((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    ::unlink(path);
+
+    // every span category should have made it onto the timeline
+    SPARK_ASSERT(trace.find("{\"traceEvents\":[") == 0);
+    SPARK_ASSERT(trace.find("\"cat\":\"dsl\"") != std::string::npos);
+    SPARK_ASSERT(trace.find("\"cat\":\"codegen\"") != std::string::npos);
+    SPARK_ASSERT(trace.find("\"cat\":\"transfer\"") != std::string::npos);
+    SPARK_ASSERT(trace.find("\"name\":\"negate\"") != std::string::npos);
+}
+
+void verify_queues()
+{
+    test_context context([]()
+    {
+        return spark_create_context(SPARK_THROW_ON_ERROR());
+    });
+
+    const size_t count = 256;
+    const uint32_t producer = spark_create_queue(context, false, SPARK_THROW_ON_ERROR());
+    const uint32_t consumer = spark_create_queue(context, true, SPARK_THROW_ON_ERROR());
+
+    Kernel<Void(BufferView1D<Int>)> fill = []()
+    {
+        auto main = MakeFunction([](BufferView1D<Int> values)
+        {
+            Int idx = Index().X;
+            values[idx] = idx * 3;
+        });
+        main.SetEntryPoint();
+    };
+    fill.set_work_dimensions(count);
+
+    Kernel<Void(BufferView1D<Int>, BufferView1D<Int>)> copy_plus_one = []()
+    {
+        auto main = MakeFunction([](BufferView1D<Int> source, BufferView1D<Int> dest)
+        {
+            Int idx = Index().X;
+            dest[idx] = source[idx] + 1;
+        });
+        main.SetEntryPoint();
+    };
+    copy_plus_one.set_work_dimensions(count);
+
+    device_buffer1d<int32_t> first(count, uninitialized);
+    device_buffer1d<int32_t> second(count, uninitialized);
+
+    // no events passed around, the consumer waits on the producer's write to first
+    spark_set_current_queue(context, producer, SPARK_THROW_ON_ERROR());
+    fill(first);
+    spark_set_current_queue(context, consumer, SPARK_THROW_ON_ERROR());
+    copy_plus_one(first, second);
+    // and overwriting first waits for the consumer to finish reading it
+    spark_set_current_queue(context, producer, SPARK_THROW_ON_ERROR());
+    first.zero(count);
+
+    spark_set_current_queue(context, 0, SPARK_THROW_ON_ERROR());
+    int32_t result[count];
+    second.read(result);
+    for(size_t k = 0; k < count; k++)
+    {
+        SPARK_ASSERT(result[k] == int32_t(k * 3 + 1));
+    }
+}
+
+void verify_multi_device()
+{
+    // prefers a platform with two devices, otherwise divides a lone device into sub-devices
+    // (when its driver supports partitioning) so the split path runs on one device too
+    std::vector<spark_device_info_t> infos(spark_enumerate_devices(static_cast<spark_device_type_t>(DeviceType::All), nullptr, 0, SPARK_THROW_ON_ERROR()));
+    spark_enumerate_devices(static_cast<spark_device_type_t>(DeviceType::All), infos.data(), infos.size(), SPARK_THROW_ON_ERROR());
+    if(infos.empty())
+    {
+        return;
+    }
+    uint32_t platform_index = infos.front().platform_index;
+    for(const auto& info : infos)
+    {
+        if(info.device_index == 1)
+        {
+            platform_index = info.platform_index;
+            break;
+        }
+    }
+
+    const size_t width = 96;
+    const size_t height = 64;
+
+    struct results
+    {
+        std::vector<int32_t> values;
+        std::vector<float> gradient;
+        std::set<std::string> names;
+    };
+
+    // writes a grid of coordinates, updates it in place and writes a gradient over the
+    // normalized index, each into a buffer declared partitioned, then reads one back whole
+    auto run = [&]()
+    {
+        results result;
+
+        Kernel<Void(BufferView1D<Int>, Int)> coordinates = []()
+        {
+            auto main = MakeFunction([](BufferView1D<Int> values, Int width)
+            {
+                Int2 idx = Index();
+                values[idx.Y * width + idx.X] = idx.Y * 1000 + idx.X;
+            });
+            main.SetEntryPoint();
+        };
+        coordinates.set_name("coordinates");
+        coordinates.set_work_dimensions(width, height);
+        coordinates.set_local_size(8, 8);
+        coordinates.set_partition(0, Partition::Partitioned);
+
+        // reads what it writes, so each device must see its slice's previous contents
+        Kernel<Void(BufferView1D<Int>, Int)> scale = []()
+        {
+            auto main = MakeFunction([](BufferView1D<Int> values, Int width)
+            {
+                Int2 idx = Index();
+                Int offset = idx.Y * width + idx.X;
+                values[offset] = values[offset] * 3 + 1;
+            });
+            main.SetEntryPoint();
+        };
+        scale.set_name("scale");
+        scale.set_work_dimensions(width, height);
+        scale.set_partition(0, Partition::Partitioned);
+
+        // normalizes over the whole launch, not a device's part of it
+        Kernel<Void(Buffer2D<Float>)> gradient = []()
+        {
+            auto main = MakeFunction([](Buffer2D<Float> output)
+            {
+                Float2 normalized = NormalizedIndex();
+                output[Index()] = normalized.X + normalized.Y * 10.0f;
+            });
+            main.SetEntryPoint();
+        };
+        gradient.set_name("gradient");
+        gradient.set_work_dimensions(width, height);
+        gradient.set_partition(0, Partition::Partitioned);
+
+        // only reads, so it's split without any declaration
+        Kernel<Void(BufferView1D<Int>)> probe = []()
+        {
+            auto main = MakeFunction([](BufferView1D<Int> values)
+            {
+                Int value = values[Index().X];
+            });
+            main.SetEntryPoint();
+        };
+        probe.set_name("probe");
+        probe.set_work_dimensions(width * height);
+
+        device_buffer1d<int32_t> values(width * height, uninitialized);
+        device_buffer2d<float> output(width, height, uninitialized);
+        for(int32_t launch = 0; launch < 4; launch++)
+        {
+            values.zero(width * height);
+            coordinates(values, int32_t(width));
+            scale(values, int32_t(width));
+            gradient(output);
+            probe(values);
+        }
+
+        result.values.resize(width * height);
+        values.read(result.values.data());
+        result.gradient.resize(width * height);
+        output.read(result.gradient.data());
+
+        auto context = spark_get_current_context(SPARK_THROW_ON_ERROR());
+        std::vector<spark_profile_stats_t> stats(spark_get_profile_stats(context, nullptr, 0, SPARK_THROW_ON_ERROR()));
+        spark_get_profile_stats(context, stats.data(), stats.size(), SPARK_THROW_ON_ERROR());
+        for(const auto& entry : stats)
+        {
+            result.names.insert(entry.name);
+        }
+        return result;
+    };
+
+    results split;
+    {
+        test_context context([platform_index]()
+        {
+            ::setenv("SPARK_SUBDEVICES", "2", 1);
+            auto created = spark_create_context_multi_device(static_cast<spark_device_type_t>(DeviceType::All), platform_index, SPARK_THROW_ON_ERROR());
+            ::unsetenv("SPARK_SUBDEVICES");
+            return created;
+        });
+        // nothing to split without a second device or sub-device
+        if(spark_get_split_device_count(context, SPARK_THROW_ON_ERROR()) < 2)
+        {
+            return;
+        }
+        // split launches are reported per device
+        spark_set_profiling(context, true, SPARK_THROW_ON_ERROR());
+        split = run();
+    }
+
+    results whole;
+    {
+        test_context context([platform_index]()
+        {
+            return spark_create_context_ex(static_cast<spark_device_type_t>(DeviceType::All), platform_index, 0, SPARK_THROW_ON_ERROR());
+        });
+        spark_set_profiling(context, true, SPARK_THROW_ON_ERROR());
+        whole = run();
+    }
+
+    // every launch was divided between at least two devices, none ran whole
+    for(const std::string name : {"coordinates", "scale", "gradient", "probe"})
+    {
+        SPARK_ASSERT(split.names.count(name) == 0);
+        SPARK_ASSERT(split.names.count(name + "@0") == 1);
+        SPARK_ASSERT(std::count_if(split.names.begin(), split.names.end(), [&](const std::string& entry)
+        {
+            return entry.compare(0, name.size() + 1, name + "@") == 0;
+        }) >= 2);
+        SPARK_ASSERT(whole.names.count(name) == 1);
+    }
+
+    // and the buffers hold what a single device computes
+    for(size_t y = 0; y < height; y++)
+    {
+        for(size_t x = 0; x < width; x++)
+        {
+            const size_t k = y * width + x;
+            SPARK_ASSERT(whole.values[k] == int32_t(y * 1000 + x) * 3 + 1);
+            SPARK_ASSERT(split.values[k] == whole.values[k]);
+            SPARK_ASSERT(std::abs(split.gradient[k] - whole.gradient[k]) <= 1e-5f);
+        }
+    }
+}
+
+void verify_concurrent_kernels()
+{
+    test_context context([]()
+    {
+        return spark_create_context(SPARK_THROW_ON_ERROR());
+    });
+
+    const size_t thread_count = 8;
+    const int32_t iterations = 4;
+    const size_t count = 512;
+
+    std::vector<std::exception_ptr> failures(thread_count);
+    std::vector<std::thread> threads;
+    for(size_t t = 0; t < thread_count; t++)
+    {
+        threads.emplace_back([&, t]()
+        {
+            try
+            {
+                // the current context is per thread
+                spark_set_current_context(context, SPARK_THROW_ON_ERROR());
+
+                for(int32_t k = 0; k < iterations; k++)
+                {
+                    // pairs of threads build identical kernels so the program cache is contended too
+                    const int32_t amount = int32_t(t / 2) + 1;
+                    Kernel<Void(BufferView1D<Int>)> add = [amount]()
+                    {
+                        auto main = MakeFunction([amount](BufferView1D<Int> values)
+                        {
+                            Int idx = Index().X;
+                            values[idx] = values[idx] + amount;
+                        });
+                        main.SetEntryPoint();
+                    };
+                    add.set_work_dimensions(count);
+
+                    device_buffer1d<int32_t> values(count);
+                    add(values);
+                    add(values);
+
+                    std::vector<int32_t> result(count);
+                    values.read(result.data());
+                    for(size_t i = 0; i < count; i++)
+                    {
+                        if(result[i] != amount * 2)
+                        {
+                            throw std::runtime_error("wrong result from concurrent launch");
+                        }
+                    }
+                }
+            }
+            catch(...)
+            {
+                failures[t] = std::current_exception();
+            }
+        });
+    }
+
+    for(auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    for(auto& failure : failures)
+    {
+        if(failure)
+        {
+            std::rethrow_exception(failure);
+        }
+    }
+}
+
+void verify_background_build()
+{
+    test_context context([]()
+    {
+        return spark_create_context(SPARK_THROW_ON_ERROR());
+    });
+
+    const size_t count = 32;
+    auto make_double = []()
+    {
+        auto main = MakeFunction([](BufferView1D<Int> values)
+        {
+            Int idx = Index().X;
+            values[idx] = values[idx] * 2;
+        });
+        main.SetEntryPoint();
+    };
+
+    // both constructors return before compilation finishes, the second shares the first's build
+    Kernel<Void(BufferView1D<Int>)> first = make_double;
+    Kernel<Void(BufferView1D<Int>)> second = make_double;
+
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    spark_get_program_cache_stats(context, &hits, &misses, SPARK_THROW_ON_ERROR());
+    SPARK_ASSERT(hits == 1);
+    SPARK_ASSERT(misses == 1);
+
+    first.set_work_dimensions(count);
+    second.set_work_dimensions(count);
+
+    int32_t initial[count];
+    for(size_t k = 0; k < count; k++)
+    {
+        initial[k] = k;
+    }
+    device_buffer1d<int32_t> values(count, initial);
+    second(values);
+    first(values);
+
+    int32_t result[count];
+    values.read(result);
+    for(size_t k = 0; k < count; k++)
+    {
+        SPARK_ASSERT(result[k] == int32_t(k * 4));
+    }
+}
+
+void verify_arg_caching()
+{
+    const size_t count = 64;
+
+    Kernel<Void(BufferView1D<Int>, Int)> add = []()
+    {
+        auto main = MakeFunction([](BufferView1D<Int> values, Int amount)
+        {
+            Int idx = Index().X;
+            values[idx] = values[idx] + amount;
+        });
+        main.SetEntryPoint();
+    };
+    add.set_work_dimensions(count);
+
+    // buffer, its length and the amount are bound once, then skipped while unchanged
+    device_buffer1d<int32_t> values(count);
+    add(values, 1);
+    add(values, 1);
+    add(values, 1);
+
+    uint64_t updates = 0;
+    uint64_t skips = 0;
+    add.get_arg_stats(&updates, &skips);
+    SPARK_ASSERT(updates == 3);
+    SPARK_ASSERT(skips == 6);
+
+    add(values, 2);
+    add.get_arg_stats(&updates, &skips);
+    SPARK_ASSERT(updates == 4);
+    SPARK_ASSERT(skips == 8);
+
+    int32_t result[count];
+    values.read(result);
+    for(size_t k = 0; k < count; k++)
+    {
+        SPARK_ASSERT(result[k] == 5);
+    }
+
+    // a replacement buffer is rebound even if the pool hands back the same handle
+    {
+        device_buffer1d<int32_t> first(count);
+        add(first, 2);
+    }
+    device_buffer1d<int32_t> second(count);
+    add(second, 2);
+    add.get_arg_stats(&updates, &skips);
+    SPARK_ASSERT(updates == 6);
+    SPARK_ASSERT(skips == 12);
+
+    second.read(result);
+    for(size_t k = 0; k < count; k++)
+    {
+        SPARK_ASSERT(result[k] == 2);
+    }
+}
+
+void verify_optimizer()
+{
+    const size_t count = 64;
+
+    int32_t initial[count];
+    for(size_t k = 0; k < count; k++)
+    {
+        initial[k] = static_cast<int32_t>(k) - 32;
+    }
+    device_buffer1d<int32_t> values(count, initial);
+
+    Kernel<Void(BufferView1D<Int>, Int)> compute = []()
+    {
+        auto main = MakeFunction([](BufferView1D<Int> values, Int scale)
+        {
+            Int idx = Index().X;
+            // folded to constants, rounding towards zero like the device
+            Int quotient = Int(-7) / Int(2);
+            Int remainder = Int(-7) % Int(2);
+            Int shifted = (Int(1) << Int(4)) >> Int(2);
+            // never read
+            Int unused = idx * 5;
+            unused = unused + 1;
+            // assigned in a loop so it keeps its variable
+            Int sum = 0;
+            For(Int i : Range<Int>(0, 4))
+            {
+                sum = sum + i;
+            }
+            Int value = values[idx];
+            // value * scale + ... repeats and is computed once
+            values[idx] = (value * scale + quotient) * (value * scale + remainder) + shifted * 1 + 0 * idx + sum;
+        });
+        main.SetEntryPoint();
+    };
+    compute.set_work_dimensions(count);
+    compute(values, 3);
+
+    if(optimizer_enabled())
+    {
+        const auto body = entry_source(compute.source());
+        // the division, remainder and shifts are literals
+        SPARK_ASSERT(count_of(body, " / ") == 0);
+        SPARK_ASSERT(count_of(body, " % ") == 0);
+        SPARK_ASSERT(count_of(body, " << ") == 0);
+        SPARK_ASSERT(count_of(body, " >> ") == 0);
+        SPARK_ASSERT(count_of(body, " + -3)") == 1);
+        SPARK_ASSERT(count_of(body, " + -1)") == 1);
+        SPARK_ASSERT(count_of(body, " + 4)") == 1);
+        // unused is gone
+        SPARK_ASSERT(count_of(body, " * 5") == 0);
+        // value * scale is a single temporary, the only other product is the one combining it
+        SPARK_ASSERT(count_of(body, " * ") == 2);
+    }
+
+    int32_t result[count];
+    values.read(result);
+    for(size_t k = 0; k < count; k++)
+    {
+        const int32_t scaled = initial[k] * 3;
+        SPARK_ASSERT(result[k] == (scaled - 3) * (scaled - 1) + 4 + 6);
+    }
+
+    // undefined or device-dependent operations are left for the device, so the kernel is only built
+    Kernel<Void(BufferView1D<Int>)> guarded = []()
+    {
+        auto main = MakeFunction([](BufferView1D<Int> values)
+        {
+            values[0] = Int(7) / Int(0);
+            values[1] = Int(std::numeric_limits<int32_t>::min()) / Int(-1);
+            values[2] = Int(1) << Int(32);
+        });
+        main.SetEntryPoint();
+    };
+    if(optimizer_enabled())
+    {
+        const auto body = entry_source(guarded.source());
+        SPARK_ASSERT(count_of(body, " / 0)") == 1);
+        SPARK_ASSERT(count_of(body, " / -1)") == 1);
+        SPARK_ASSERT(count_of(body, " << 32)") == 1);
+    }
+}
+
+void verify_range()
+{
+    const size_t count = 16;
+    device_buffer1d<int32_t> values(count);
+
+    Kernel<Void(BufferView1D<Int>)> loops = []()
+    {
+        auto main = MakeFunction([](BufferView1D<Int> values)
+        {
+            Int idx = Index().X;
+            Int stop = idx;
+            Int sum = 0;
+            // the bounds are read once, changing stop doesn't change the trip count
+            For(Int i : Range<Int>(1, stop + 1, 3))
+            {
+                stop = 0;
+                For(Int j : Range<Int>(0, 8))
+                {
+                    If(j == 2)
+                    {
+                        Break();
+                    }
+                    sum = sum + i;
+                }
+            }
+            values[idx] = sum;
+        });
+        main.SetEntryPoint();
+    };
+    loops.set_work_dimensions(count);
+    loops(values);
+
+    // both Range loops are emitted as counted for statements
+    const auto body = entry_source(loops.source());
+    SPARK_ASSERT(count_of(body, "for (") == 2);
+    // the outer bound is computed once ahead of the loop instead of in its condition
+    const auto outer = body.find("for (");
+    const auto header = body.substr(outer, body.find('\n', outer) - outer);
+    SPARK_ASSERT(count_of(header, " + 1)") == 0);
+    SPARK_ASSERT(count_of(body.substr(0, outer), " + 1);") == 1);
+
+    int32_t result[count];
+    values.read(result);
+    for(size_t k = 0; k < count; k++)
+    {
+        int32_t expected = 0;
+        for(int32_t i = 1; i < int32_t(k) + 1; i += 3)
+        {
+            expected += 2 * i;
+        }
+        SPARK_ASSERT(result[k] == expected);
+    }
+}
+
+void verify_unroll()
+{
+    const size_t count = 16;
+    device_buffer1d<int32_t> values(count);
+
+    Kernel<Void(BufferView1D<Int>)> loops = []()
+    {
+        auto main = MakeFunction([](BufferView1D<Int> values)
+        {
+            Int idx = Index().X;
+            Int sum = 0;
+            // 10 iterations as 3 of 3 copies and a leftover
+            For(Int i : Range<Int>(0, 10, Unroll(3)))
+            {
+                Int scaled = i * idx;
+                // short enough to be unrolled completely
+                For(Int j : Range<Int>(1, 7, 2))
+                {
+                    Int term = scaled + j;
+                    sum = sum + term;
+                }
+            }
+            // kept as a loop
+            For(Int i : Range<Int>(0, 5, Unroll(1)))
+            {
+                sum = sum + i;
+            }
+            // bound unknown at build time, left to the compiler
+            For(Int i : Range<Int>(0, idx, Unroll(4)))
+            {
+                sum = sum + 1;
+            }
+            values[idx] = sum;
+        });
+        main.SetEntryPoint();
+    };
+    loops.set_work_dimensions(count);
+    loops(values);
+
+    spark_device_info_t info;
+    spark_get_context_device_info(spark_get_current_context(SPARK_THROW_ON_ERROR()), &info, SPARK_THROW_ON_ERROR());
+    const bool host = std::string(info.name) == "host";
+
+    // the hint is emitted whether or not the optimizer runs
+    const auto body = entry_source(loops.source());
+    SPARK_ASSERT(count_of(body, host ? "#pragma GCC unroll 4\n" : "#pragma unroll 4\n") == 1);
+    if(optimizer_enabled())
+    {
+        // the Unroll(1) and runtime bound loops are all that's left besides the unrolled outer loop,
+        // so the inner j loop has no for of its own
+        SPARK_ASSERT(count_of(body, "for (") == 3);
+        SPARK_ASSERT(count_of(body, " < 9); ") == 1);
+        SPARK_ASSERT(count_of(body, " + 3))") == 1);
+        // three copies of the outer body in the loop plus one for the leftover iteration,
+        // each with the three j iterations inlined
+        SPARK_ASSERT(count_of(body, " + 5);") == 4);
+        // Unroll(1) stays rolled
+        SPARK_ASSERT(count_of(body, " < 5); ") == 1);
+    }
+
+    int32_t result[count];
+    values.read(result);
+    for(size_t k = 0; k < count; k++)
+    {
+        int32_t expected = 0;
+        for(int32_t i = 0; i < 10; i++)
+        {
+            for(int32_t j = 1; j < 7; j += 2)
+            {
+                expected += i * int32_t(k) + j;
+            }
+        }
+        expected += 0 + 1 + 2 + 3 + 4;
+        expected += int32_t(k);
+        SPARK_ASSERT(result[k] == expected);
+    }
+
+    // constant trip counts short enough to unroll, but a break or a write to the loop
+    // variable keeps each one a loop
+    Kernel<Void(BufferView1D<Int>)> blocked = []()
+    {
+        auto main = MakeFunction([](BufferView1D<Int> values)
+        {
+            Int idx = Index().X;
+            Int sum = 0;
+            For(Int i : Range<Int>(0, 4))
+            {
+                If(i == idx)
+                {
+                    Break();
+                }
+                sum = sum + i;
+            }
+            For(Int i : Range<Int>(0, 4))
+            {
+                sum = sum + i;
+                i = i + 1;
+            }
+            values[idx] = sum;
+        });
+        main.SetEntryPoint();
+    };
+    blocked.set_work_dimensions(count);
+    blocked(values);
+    SPARK_ASSERT(count_of(entry_source(blocked.source()), "for (") == 2);
+
+    values.read(result);
+    for(size_t k = 0; k < count; k++)
+    {
+        int32_t expected = 0;
+        for(int32_t i = 0; i < 4 && i != int32_t(k); i++)
+        {
+            expected += i;
+        }
+        // the second loop runs for i = 0 and i = 2
+        expected += 2;
+        SPARK_ASSERT(result[k] == expected);
+    }
+}
+
+void verify_cpu_backend()
+{
+    // selected directly rather than through SPARK_BACKEND
+    test_context context([]()
+    {
+        return spark_create_context_for_backend(static_cast<spark_backend_t>(Backend::Cpu), SPARK_THROW_ON_ERROR());
+    });
+
+    spark_device_info_t info;
+    spark_get_context_device_info(context, &info, SPARK_THROW_ON_ERROR());
+    SPARK_ASSERT(std::string(info.name) == "host");
+
+    const size_t count = 64;
+    Kernel<Void(BufferView1D<Float4>, BufferView1D<Float2>)> shade = []()
+    {
+        auto main = MakeFunction([](BufferView1D<Float4> colors, BufferView1D<Float2> points)
+        {
+            Int idx = Index().X;
+            Float x = idx.As<Float>();
+            Float2 point(x, x * 2.0f);
+            Float2 swapped = point.YX;
+
+            Float4 color(SquareRoot(x), Dot(point, swapped), Max(x, 8.0f), Floor(x / 3.0f));
+            color.Hi = color.Lo + swapped;
+            colors[idx] = color;
+            points[idx] = swapped + point;
+        });
+        main.SetEntryPoint();
+    };
+    shade.set_work_dimensions(count);
+
+    // compiled by the host compiler against the cpu prelude
+    SPARK_ASSERT(std::string(shade.source()).find("static void entry_point(") != std::string::npos);
+
+    device_buffer1d<float4> colors(count);
+    device_buffer1d<float2> points(count);
+    shade(colors, points);
+
+    std::vector<float4> color_result(count);
+    std::vector<float2> point_result(count);
+    colors.read(color_result.data());
+    points.read(point_result.data());
+
+    auto close = [](float left, float right)
+    {
+        return std::fabs(left - right) <= 1e-5f * std::max(1.0f, std::fabs(right));
+    };
+    for(size_t k = 0; k < count; k++)
+    {
+        const float x = float(k);
+        SPARK_ASSERT(close(color_result[k].x, std::sqrt(x)));
+        SPARK_ASSERT(close(color_result[k].y, 4.0f * x * x));
+        SPARK_ASSERT(close(color_result[k].z, std::sqrt(x) + 2.0f * x));
+        SPARK_ASSERT(close(color_result[k].w, 4.0f * x * x + x));
+        SPARK_ASSERT(close(point_result[k].x, 3.0f * x));
+        SPARK_ASSERT(close(point_result[k].y, 3.0f * x));
+    }
+}
+
+void verify_device_enumeration()
+{
+    const auto type = static_cast<spark_device_type_t>(DeviceType::All);
+
+    // the first call only counts, the second fills in at most the given number
+    const size_t count = spark_enumerate_devices(type, nullptr, 0, SPARK_THROW_ON_ERROR());
+    std::vector<spark_device_info_t> infos(count + 1);
+    ::memset(infos.data(), 0xff, infos.size() * sizeof(spark_device_info_t));
+    SPARK_ASSERT(spark_enumerate_devices(type, infos.data(), count, SPARK_THROW_ON_ERROR()) == count);
+    for(size_t k = 0; k < count; k++)
+    {
+        SPARK_ASSERT(::strnlen(infos[k].name, sizeof(infos[k].name)) < sizeof(infos[k].name));
+    }
+    // the slot past the requested count is left alone
+    SPARK_ASSERT(infos[count].platform_index == 0xffffffff);
+
+    if(count > 0)
+    {
+        SPARK_ASSERT(spark_enumerate_devices(type, infos.data(), 1, SPARK_THROW_ON_ERROR()) == count);
+
+        test_context context([&]()
+        {
+            return spark_create_context_ex(type, infos[0].platform_index, infos[0].device_index, SPARK_THROW_ON_ERROR());
+        });
+        spark_device_info_t info;
+        spark_get_context_device_info(context, &info, SPARK_THROW_ON_ERROR());
+        SPARK_ASSERT(::strcmp(info.name, infos[0].name) == 0);
+    }
+
+    // a device has the same index whichever type filter found it
+    infos.resize(count);
+    for(auto filter : {DeviceType::Cpu, DeviceType::Gpu, DeviceType::Accelerator})
+    {
+        std::vector<spark_device_info_t> filtered(spark_enumerate_devices(static_cast<spark_device_type_t>(filter), nullptr, 0, SPARK_THROW_ON_ERROR()));
+        spark_enumerate_devices(static_cast<spark_device_type_t>(filter), filtered.data(), filtered.size(), SPARK_THROW_ON_ERROR());
+        for(const auto& device : filtered)
+        {
+            SPARK_ASSERT(std::any_of(infos.begin(), infos.end(), [&](const spark_device_info_t& info)
+            {
+                return info.platform_index == device.platform_index &&
+                       info.device_index == device.device_index &&
+                       ::strcmp(info.name, device.name) == 0;
+            }));
+        }
+        if(!filtered.empty())
+        {
+            test_context context([&]()
+            {
+                return spark_create_context_ex(filtered[0].type, filtered[0].platform_index, filtered[0].device_index, SPARK_THROW_ON_ERROR());
+            });
+            spark_device_info_t info;
+            spark_get_context_device_info(context, &info, SPARK_THROW_ON_ERROR());
+            SPARK_ASSERT(info.device_index == filtered[0].device_index);
+        }
+    }
+
+    // one past the last device on any platform is out of range
+    spark_error_t* error = nullptr;
+    auto context = spark_create_context_ex(type, 0, static_cast<uint32_t>(count), &error);
+    SPARK_ASSERT(context == nullptr);
+    SPARK_ASSERT(error != nullptr);
+    spark_destroy_error(error);
+}
+
+void verify_kernel_cache()
+{
+    // a private cache directory, so the first build is always a miss
+    test_cache_directory directory;
+
+    // builds and runs the same kernel in a fresh context, returning the cache hits and misses
+    auto build = []()
+    {
+        test_context context([]()
+        {
+            return spark_create_context(SPARK_THROW_ON_ERROR());
+        });
+        spark_reset_kernel_cache_stats(SPARK_THROW_ON_ERROR());
+
+        const size_t count = 32;
+        Kernel<Void(BufferView1D<Int>)> fill = []()
+        {
+            auto main = MakeFunction([](BufferView1D<Int> values)
+            {
+                Int idx = Index().X;
+                values[idx] = idx * 7 + 5;
+            });
+            main.SetEntryPoint();
+        };
+        fill.set_work_dimensions(count);
+
+        device_buffer1d<int32_t> values(count);
+        fill(values);
+        std::vector<int32_t> result(count);
+        values.read(result.data());
+        for(size_t k = 0; k < count; k++)
+        {
+            SPARK_ASSERT(result[k] == int32_t(k * 7 + 5));
+        }
+
+        std::pair<uint64_t, uint64_t> stats;
+        spark_get_kernel_cache_stats(&stats.first, &stats.second, SPARK_THROW_ON_ERROR());
+        return stats;
+    };
+
+    // path of the single binary the cache holds
+    auto cached = [&]()
+    {
+        const auto files = directory.files("");
+        SPARK_ASSERT(files.size() == 1);
+        return files[0];
+    };
+
+    SPARK_ASSERT(build() == std::make_pair(uint64_t(0), uint64_t(1)));
+    SPARK_ASSERT(build() == std::make_pair(uint64_t(1), uint64_t(0)));
+
+    // damaged entries are misses that rebuild and replace the file
+    struct stat info;
+    SPARK_VERIFY(::stat(cached().c_str(), &info) == 0);
+    SPARK_VERIFY(::truncate(cached().c_str(), info.st_size / 2) == 0);
+    SPARK_ASSERT(build() == std::make_pair(uint64_t(0), uint64_t(1)));
+
+    SPARK_VERIFY(::truncate(cached().c_str(), 0) == 0);
+    SPARK_ASSERT(build() == std::make_pair(uint64_t(0), uint64_t(1)));
+    SPARK_ASSERT(build() == std::make_pair(uint64_t(1), uint64_t(0)));
+
+    // an intact entry the driver (or dlopen) rejects is a miss too
+    {
+        // same layout and FNV-1a checksum as the cache's trailer
+        const std::string payload = "not a binary";
+        uint64_t checksum = 14695981039346656037ull;
+        for(char c : payload)
+        {
+            checksum ^= static_cast<uint8_t>(c);
+            checksum *= 1099511628211ull;
+        }
+        const uint64_t trailer[] = {0x65686361636b7073ull, payload.size(), checksum};
+        std::ofstream binary(cached(), std::ios::binary | std::ios::trunc);
+        binary.write(payload.data(), payload.size());
+        binary.write(reinterpret_cast<const char*>(trailer), sizeof(trailer));
+    }
+    SPARK_ASSERT(build() == std::make_pair(uint64_t(0), uint64_t(1)));
+    SPARK_ASSERT(build() == std::make_pair(uint64_t(1), uint64_t(0)));
+}
+
+void verify_program_cache()
+{
+    const size_t count = 16;
+    auto make_scale = [](int32_t amount)
+    {
+        return [amount]()
+        {
+            auto main = MakeFunction([amount](BufferView1D<Int> values)
+            {
+                Int idx = Index().X;
+                values[idx] = idx * amount;
+            });
+            main.SetEntryPoint();
+        };
+    };
+    auto stats = [](spark_context_t* context)
+    {
+        std::pair<uint64_t, uint64_t> result;
+        spark_get_program_cache_stats(context, &result.first, &result.second, SPARK_THROW_ON_ERROR());
+        return result;
+    };
+    auto check = [&](Kernel<Void(BufferView1D<Int>)>& scale, int32_t amount)
+    {
+        scale.set_work_dimensions(count);
+        device_buffer1d<int32_t> values(count);
+        scale(values);
+        std::vector<int32_t> result(count);
+        values.read(result.data());
+        for(size_t k = 0; k < count; k++)
+        {
+            SPARK_ASSERT(result[k] == int32_t(k) * amount);
+        }
+    };
+
+    test_context first([]()
+    {
+        return spark_create_context(SPARK_THROW_ON_ERROR());
+    });
+
+    // identical source shares the program
+    Kernel<Void(BufferView1D<Int>)> double1 = make_scale(2);
+    SPARK_ASSERT(stats(first) == std::make_pair(uint64_t(0), uint64_t(1)));
+    Kernel<Void(BufferView1D<Int>)> double2 = make_scale(2);
+    SPARK_ASSERT(stats(first) == std::make_pair(uint64_t(1), uint64_t(1)));
+
+    // a different constant is different source
+    Kernel<Void(BufferView1D<Int>)> triple = make_scale(3);
+    SPARK_ASSERT(stats(first) == std::make_pair(uint64_t(1), uint64_t(2)));
+
+    check(double1, 2);
+    check(double2, 2);
+    check(triple, 3);
+
+    // programs aren't shared between contexts
+    {
+        test_context second([]()
+        {
+            return spark_create_context(SPARK_THROW_ON_ERROR());
+        });
+        Kernel<Void(BufferView1D<Int>)> double3 = make_scale(2);
+        SPARK_ASSERT(stats(second) == std::make_pair(uint64_t(0), uint64_t(1)));
+        check(double3, 2);
+    }
+    SPARK_ASSERT(stats(first) == std::make_pair(uint64_t(1), uint64_t(2)));
+}
+
+void verify_uninitialized_buffer()
+{
+    // fresh context so the pool only holds what this test releases
+    test_context context([]()
+    {
+        return spark_create_context(SPARK_THROW_ON_ERROR());
+    });
+
+    const size_t count = 500;
+    {
+        std::vector<int32_t> pattern(count, 0x5a5a5a5a);
+        device_buffer1d<int32_t> previous(count, pattern.data());
+    }
+
+    // the recycled allocation still holds the previous owner's data since nothing zeroed it
+    device_buffer1d<int32_t> reused(count, uninitialized);
+    uint64_t hits = 0;
+    spark_get_buffer_pool_stats(context, &hits, nullptr, nullptr, SPARK_THROW_ON_ERROR());
+    SPARK_ASSERT(hits == 1);
+
+    std::vector<int32_t> result(count);
+    reused.read(result.data());
+    for(size_t k = 0; k < count; k++)
+    {
+        SPARK_ASSERT(result[k] == 0x5a5a5a5a);
+    }
+}
+
+void verify_autotune()
+{
+    // set_autotune does nothing on the cpu backend, which has no work-groups
+    spark_device_info_t info;
+    spark_get_context_device_info(spark_get_current_context(SPARK_THROW_ON_ERROR()), &info, SPARK_THROW_ON_ERROR());
+    if(std::string(info.name) == "host")
+    {
+        return;
+    }
+
+    // tuning results are stored next to the kernel binaries
+    test_cache_directory directory;
+
+    // builds the kernel in a fresh context and launches it count times with autotuning,
+    // returning the kernel cache hits and misses
+    auto run = [](size_t launches)
+    {
+        test_context context([]()
+        {
+            return spark_create_context(SPARK_THROW_ON_ERROR());
+        });
+        // tuning times launches on the device when the queue is profiled
+        spark_set_profiling(context, true, SPARK_THROW_ON_ERROR());
+        spark_reset_kernel_cache_stats(SPARK_THROW_ON_ERROR());
+
+        const size_t count = 1024;
+        Kernel<Void(BufferView1D<Int>)> increment = []()
+        {
+            auto main = MakeFunction([](BufferView1D<Int> values)
+            {
+                Int idx = Index().X;
+                values[idx] = values[idx] + 1;
+            });
+            main.SetEntryPoint();
+        };
+        increment.set_work_dimensions(count);
+        increment.set_autotune(true);
+
+        device_buffer1d<int32_t> values(count);
+        for(size_t k = 0; k < launches; k++)
+        {
+            increment(values);
+        }
+        std::vector<int32_t> result(count);
+        values.read(result.data());
+        for(size_t k = 0; k < count; k++)
+        {
+            SPARK_ASSERT(result[k] == int32_t(launches));
+        }
+
+        std::pair<uint64_t, uint64_t> stats;
+        spark_get_kernel_cache_stats(&stats.first, &stats.second, SPARK_THROW_ON_ERROR());
+        return stats;
+    };
+
+    // the binary and the tuning both miss, and the tuning is written once every
+    // candidate has had its warm-up and timed samples (at most 7 shapes of 4 launches)
+    SPARK_ASSERT(run(64) == std::make_pair(uint64_t(0), uint64_t(2)));
+    SPARK_ASSERT(directory.files(".tune").size() == 1);
+
+    // the stored tuning is loaded rather than tuned again
+    SPARK_ASSERT(run(1) == std::make_pair(uint64_t(2), uint64_t(0)));
+
+    // an unreadable tuning file is a miss
+    {
+        std::ofstream tuning(directory.files(".tune")[0], std::ios::trunc);
+        tuning << "32 1 1\n";
+    }
+    SPARK_ASSERT(run(1) == std::make_pair(uint64_t(1), uint64_t(1)));
+}
+
 int main(int argc, char** argv)
 {
     std::set<std::string> tests;
@@ -275,6 +1858,27 @@ int main(int argc, char** argv)
         RUN_TEST(make_mandelbrot);
         RUN_TEST(verify_buffer_view1d);
         RUN_TEST(verify_buffer_view2d);
+        RUN_TEST(verify_command_list);
+        RUN_TEST(verify_local_size);
+        RUN_TEST(verify_pinned_transfers);
+        RUN_TEST(verify_buffer_pool);
+        RUN_TEST(verify_profiling);
+        RUN_TEST(verify_logging);
+        RUN_TEST(verify_tracing);
+        RUN_TEST(verify_queues);
+        RUN_TEST(verify_multi_device);
+        RUN_TEST(verify_concurrent_kernels);
+        RUN_TEST(verify_background_build);
+        RUN_TEST(verify_arg_caching);
+        RUN_TEST(verify_optimizer);
+        RUN_TEST(verify_range);
+        RUN_TEST(verify_unroll);
+        RUN_TEST(verify_cpu_backend);
+        RUN_TEST(verify_device_enumeration);
+        RUN_TEST(verify_kernel_cache);
+        RUN_TEST(verify_program_cache);
+        RUN_TEST(verify_uninitialized_buffer);
+        RUN_TEST(verify_autotune);
 
         // end spark session
         spark_destroy_context(context, SPARK_THROW_ON_ERROR());
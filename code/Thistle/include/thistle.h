@@ -5,6 +5,7 @@ extern "C" void thistle_free_error(thistle_error_t*);
 extern "C" const char* thistle_get_error_message(thistle_error_t*);
 
 extern "C" void thistle_begin_session(thistle_error_t**);
+extern "C" void thistle_join_session(thistle_error_t**);
 extern "C" void thistle_end_session(thistle_error_t**);
 
 // thistle buffer type and functions
@@ -16,6 +16,16 @@ RUFF_EXPORT void thistle_begin_session(thistle_error_t** error)
     });
 }
 
+// makes the session usable from the calling thread, spark's current context is per thread
+RUFF_EXPORT void thistle_join_session(thistle_error_t** error)
+{
+    return translate_exceptions(error, [&]()
+    {
+        RUFF_THROW_IF_NULL(g_spark_context);
+        spark_set_current_context(g_spark_context, SPARK_THROW_ON_ERROR());
+    });
+}
+
 RUFF_EXPORT void thistle_end_session(thistle_error_t** error)
 {
     return translate_exceptions(error, [&]()
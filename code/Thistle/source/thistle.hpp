@@ -4,6 +4,7 @@
 #include <cstddef>
 #include <stdexcept>
 #include <memory>
+#include <vector>
 #include <iostream>
 #define LOG_VAL(X) std::cout << #X " : " << (X) << std::endl
 
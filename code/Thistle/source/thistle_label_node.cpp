@@ -59,7 +59,8 @@ _calc_input_deltas_kernel([&]()
     entry.SetEntryPoint();
 })
 {
-
+    _calc_error_kernel.set_name("label.calc_error");
+    _calc_input_deltas_kernel.set_name("label.calc_input_deltas");
 }
 
 size_t thistle_label_node::get_parameter_count() const
@@ -100,7 +101,7 @@ void thistle_label_node::calc_output(
     device_buffer2d<float> label_buffer(this->labels, batchSize, labelBatch->data);
 
     _calc_error_kernel.set_work_dimensions(this->labels);
-    _calc_error_kernel(input_buffer, label_buffer, outputBatch->data);
+    _calc_error_kernel.run_async(input_buffer, label_buffer, outputBatch->data);
 }
 
 void thistle_label_node::calc_parameter_deltas(
@@ -145,7 +146,7 @@ void thistle_label_node::calc_input_deltas(
     device_buffer2d<float> input_delta_buffer(this->labels, batchSize, inputBatchDeltas->data);
 
     _calc_input_deltas_kernel.set_work_dimensions(this->labels, batchSize);
-    _calc_input_deltas_kernel(input_buffer, label_buffer, input_delta_buffer);
+    _calc_input_deltas_kernel.run_async(input_buffer, label_buffer, input_delta_buffer);
 }
 
 RUFF_EXPORT thistle_node_t* thistle_create_label_node(
@@ -26,7 +26,7 @@ thistle_linear_transform_node::thistle_linear_transform_node(
         BufferView1D<Float> x = input_buffer[batch_idx];
 
         Float sum = 0.0f;
-        For(Int i : Range<Int>(0, inputs))
+        For(Int i : Range<Int>(0, inputs, Unroll(4)))
         {
             Float x_i = x[i];
             Float w_ji = w_j[i];
@@ -103,7 +103,7 @@ thistle_linear_transform_node::thistle_linear_transform_node(
         auto& w = weights;
 
         Float sum = 0.0f;
-        For(Int j : Range<Int>(0, outputs))
+        For(Int j : Range<Int>(0, outputs, Unroll(4)))
         {
             Float dy_j = dy[j];
             Float w_ji = w[j][i];
@@ -117,6 +117,10 @@ thistle_linear_transform_node::thistle_linear_transform_node(
 })
 {
     RUFF_THROW_IF_FALSE(weight_count == ((inputs + 1) * outputs));
+
+    _calc_output_kernel.set_name("linear_transform.calc_output");
+    _calc_parameter_deltas_kernel.set_name("linear_transform.calc_parameter_deltas");
+    _calc_input_deltas_kernel.set_name("linear_transform.calc_input_deltas");
 }
 
 size_t thistle_linear_transform_node::get_parameter_count() const
@@ -152,8 +156,10 @@ void thistle_linear_transform_node::calc_output(
     device_buffer2d<float> input_buffer(inputBatch->element_size(), batchSize, inputBatch->data);
     device_buffer2d<float> output_buffer(outputBatch->element_size(), batchSize, outputBatch->data);
 
+    // launches queue back-to-back; the in-order queue orders them against later
+    // launches and the blocking reads that observe their results
     _calc_output_kernel.set_work_dimensions(this->outputs(), batchSize);
-    _calc_output_kernel(_weights, input_buffer, output_buffer);
+    _calc_output_kernel.run_async(_weights, input_buffer, output_buffer);
 }
 
 void thistle_linear_transform_node::calc_parameter_deltas(
@@ -184,7 +190,7 @@ void thistle_linear_transform_node::calc_parameter_deltas(
     device_buffer2d<float> weight_delta_buffer(_weights.width(), _weights.height(), parameterDeltas->data);
 
     _calc_parameter_deltas_kernel.set_work_dimensions(weight_delta_buffer.width(), weight_delta_buffer.height());
-    _calc_parameter_deltas_kernel(input_buffer, output_delta_buffer, weight_delta_buffer);
+    _calc_parameter_deltas_kernel.run_async(input_buffer, output_delta_buffer, weight_delta_buffer);
 }
 
 void thistle_linear_transform_node::calc_input_deltas(
@@ -212,7 +218,7 @@ void thistle_linear_transform_node::calc_input_deltas(
     device_buffer2d<float> input_delta_buffer(inputBatchDelta->element_size(), batchSize, inputBatchDelta->data);
 
     _calc_input_deltas_kernel.set_work_dimensions(this->inputs(), batchSize);
-    _calc_input_deltas_kernel(_weights, output_delta_buffer, input_delta_buffer);
+    _calc_input_deltas_kernel.run_async(_weights, output_delta_buffer, input_delta_buffer);
 }
 
 RUFF_EXPORT thistle_node_t* thistle_create_linear_transform_node(size_t inputs, size_t outputs, const float* weights, size_t weight_count, thistle_error_t** error)
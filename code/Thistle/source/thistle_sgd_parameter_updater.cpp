@@ -30,6 +30,7 @@ thistle_sgd_parameter_updater::thistle_sgd_parameter_updater(size_t parameterCou
     entry.SetEntryPoint();
 })
 {
+    _update_parameters_kernel.set_name("sgd.update_parameters");
     _update_parameters_kernel.set_work_dimensions(parameterCount);
 }
 
@@ -41,7 +42,7 @@ void thistle_sgd_parameter_updater::update_parameters(
     RUFF_THROW_IF_FALSE(paramCount == paramBuffer.count());
     RUFF_THROW_IF_FALSE(paramCount == paramDeltaBuffer.count());
 
-    _update_parameters_kernel(paramBuffer, paramDeltaBuffer, _prev_parameter_delta_buffer, learning_rate, momentum);
+    _update_parameters_kernel.run_async(paramBuffer, paramDeltaBuffer, _prev_parameter_delta_buffer, learning_rate, momentum);
 }
 
 